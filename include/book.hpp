@@ -0,0 +1,84 @@
+#pragma once
+
+#include "chess.hpp"
+#include "eventlog.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+// a book is the header followed by its entries, sorted by key and then by move
+struct BookHeader {
+	static constexpr char MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'B', 'O', 'K'};
+	static constexpr uint32_t VERSION = 1;
+
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t num_entries;
+};
+
+struct BookEntry {
+	// Field::calculateKey of the position the move is played in
+	uint64_t key;
+	uint16_t from;
+	uint16_t to;
+	GameEvent::Kind kind;
+	Figure promotion;
+	// relative chance of the move being picked among the entries of its position
+	uint16_t weight;
+};
+
+static_assert(sizeof(BookEntry) == 16);
+
+struct BookBuildStats {
+	uint64_t positions = 0;
+	uint64_t entries = 0;
+};
+
+class OpeningExplorer;
+
+// moves for the start of a game that engines play without searching, memory mapped and probed with a binary search
+class OpeningBook {
+public:
+	OpeningBook() = default;
+	~OpeningBook();
+
+	OpeningBook(const OpeningBook&) = delete;
+	OpeningBook &operator=(const OpeningBook&) = delete;
+
+	bool open(const std::string &path);
+
+	inline uint64_t getEntryCount() const {
+		return entries.size();
+	}
+
+	// all entries of a position, empty if it isn't in the book
+	std::span<const BookEntry> getEntries(uint64_t key) const;
+
+	// one of the position's moves, picked at random by weight
+	std::optional<BookEntry> probe(uint64_t key, std::mt19937_64 &random) const;
+
+	// takes the moves of the explorer that were played in at least min_games games, following them from the start
+	// positions of the player counts that are given; a move is weighted by how well it did for the player making it
+	static bool build(const OpeningExplorer &explorer, const std::string &path, uint32_t min_games, std::span<const uint32_t> player_counts, BookBuildStats &stats);
+
+	// build <book> <explorer> [--min-games N] [--players N]...
+	// self-play <explorer> [--games N] [--players N]... [--plies N] [--depth N] [--think-ms N] [--threads N] [--book <book>]
+	// show <book> <players> | --key <hex>
+	static int run(const std::vector<std::string> &args);
+
+private:
+	BookHeader header = {};
+	std::span<const BookEntry> entries;
+
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+
+#if defined(_WIN32)
+	std::vector<uint8_t> contents;
+#endif
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "chess.hpp"
+#include "net.hpp"
+#include "websocket.hpp"
+
+#include "SDL3_net/SDL_net.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// headless client that talks to the websocket listener like a browser would and plays random moves,
+// for trying out the gateway without a browser
+class Bot {
+public:
+	Bot(const std::vector<std::string> &args);
+	~Bot();
+
+	static inline int run(const std::vector<std::string> &args) {
+		return Bot(args).run();
+	}
+
+	int run();
+
+private:
+	bool connect();
+	bool send(std::span<const uint8_t> data);
+	bool sendMessage(const Message &msg);
+
+	// reassembles messages and the tiles following an accept from the unwrapped payloads
+	void receive(std::span<const uint8_t> payload);
+	void handleMessage(const Message &msg);
+	void makeMove();
+
+	std::string hostname = "127.0.0.1";
+	uint16_t port = 8081;
+	uint64_t session = 0;
+	std::string name = "bot";
+	bool spectate = false;
+	uint32_t max_moves = ~0u;
+	bool valid = true;
+
+	SDLNet_StreamSocket *socket = nullptr;
+	WebSocketCodec websocket{WebSocketCodec::Client};
+	std::vector<uint8_t> stream;
+	size_t tiles_expected = 0;
+
+	Field field;
+	uint32_t player = ~0u;
+	bool joined = false;
+	bool done = false;
+
+	// a move was sent and the server didn't echo it yet
+	bool waiting = false;
+	uint32_t moves = 0;
+
+	std::mt19937 random{std::random_device()()};
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "net.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+// a capture starts with a header, followed by records that are appended while the server runs;
+// every recording run appends a Start record, so several runs can share a file
+struct CaptureHeader {
+	static constexpr char MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'C', 'A', 'P'};
+	static constexpr uint32_t VERSION = 1;
+
+	char magic[8];
+	uint32_t version;
+
+	// a capture can only be replayed by builds with the same message layout
+	uint32_t message_size;
+};
+
+struct CaptureRecord {
+	enum Kind : uint32_t {
+		Start,
+		Connect,
+		Frame,
+		Disconnect,
+		Create,
+		Destroy,
+		Digest,
+	} kind;
+
+	// bytes of payload following the record, the next record starts 8 byte aligned
+	uint32_t size;
+
+	// since the Start record of the run
+	uint64_t time_us;
+
+	// connection of Connect, Frame and Disconnect records, session of Create, Destroy and Digest records,
+	// wall clock time of a Start record
+	uint64_t id;
+};
+
+// state of a session when its game ended, it hibernated, it was destroyed or the server shut down, a replay has to end up with the same
+struct CaptureDigest {
+	uint64_t seq;
+	uint64_t hash;
+};
+
+// appends records to a capture file, can be called from any thread
+class CaptureWriter {
+public:
+	CaptureWriter() = default;
+	~CaptureWriter();
+
+	CaptureWriter(const CaptureWriter&) = delete;
+	CaptureWriter &operator=(const CaptureWriter&) = delete;
+
+	// a file cut off by a crash is truncated to its last complete record first, so the appended records stay aligned
+	bool open(const std::string &path);
+
+	void write(CaptureRecord::Kind kind, uint64_t id, std::span<const uint8_t> payload = {});
+
+	template <typename T>
+	inline void writeObject(CaptureRecord::Kind kind, uint64_t id, const T &value) {
+		write(kind, id, asBytes(value));
+	}
+
+	// connections are told apart by their address in memory, which can only be reused after the disconnect was recorded
+	static inline uint64_t getConnectionId(const Connection *connection) {
+		return reinterpret_cast<uintptr_t>(connection);
+	}
+
+	// the records are buffered, a process that is killed loses what wasn't flushed
+	void flush();
+
+private:
+	std::mutex mutex;
+	FILE *file = nullptr;
+	uint64_t start_us = 0;
+};
+
+// maps a capture file into memory and walks its records
+class CaptureReader {
+public:
+	CaptureReader() = default;
+	~CaptureReader();
+
+	CaptureReader(const CaptureReader&) = delete;
+	CaptureReader &operator=(const CaptureReader&) = delete;
+
+	bool open(const std::string &path);
+
+	// false at the end of the file, a record cut off by a crash ends the capture as well
+	bool next(CaptureRecord &record, std::span<const uint8_t> &payload);
+
+	inline size_t getSize() const {
+		return size;
+	}
+
+	// end of the last record next() returned
+	inline size_t getOffset() const {
+		return offset;
+	}
+
+private:
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	size_t offset = 0;
+
+#if defined(_WIN32)
+	std::vector<uint8_t> contents;
+#endif
+};
+
+// stands in for a client while a capture is replayed, everything sent to it is counted and discarded
+class ReplayConnection : public Connection {
+public:
+	explicit ReplayConnection(uint64_t id);
+
+	std::string getAddress() const override;
+	void flush() override;
+	void close() override;
+	void abort() override;
+
+	static inline std::atomic<uint64_t> bytes_sent = 0;
+
+private:
+	const uint64_t id;
+};
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <format>
+#include <vector>
 
 #define getId(x, y, z) (((z)<<5) | ((y)<<3) | (x))
 #define getX(id) ((id) & 0b00000111)
@@ -83,6 +84,12 @@ struct Tile {
 	uint8_t move_count;
 };
 
+struct MoveCandidate {
+	uint32_t from;
+	uint32_t to;
+	MoveType type;
+};
+
 struct PlayerData {
 	bool is_checkmate;
 	uint32_t king_position;
@@ -118,8 +125,20 @@ struct Field {
 	bool isPlayerCheck(uint32_t player);
 	bool isPlayerCheckMate(uint32_t player);
 
+	// every move the player's figures can make, used by bots; clears the marks on the tiles
+	void collectMoves(uint32_t player, std::vector<MoveCandidate> &moves);
+
+	// whether the player's figure on from can make this move, for moves received over the network; keeps the marks on the tiles
+	bool isMoveLegal(uint32_t player, uint32_t from, uint32_t to, MoveType move);
+
+	// a pawn of the player on the last row that still has to be promoted, or UINT32_MAX
+	uint32_t findPendingPromotion(uint32_t player) const;
+
 	void switchToNextPlayer();
 
+	// zobrist key of the position: the figures, whether kings, rooks and pawns moved, who is out and whose turn it is
+	uint64_t calculateKey() const;
+
 	template <typename F>
 	void traverseReachableTiles(uint32_t start, Figure figure, F visitor) {
 		bool is_on_opposing_half = tiles[start].player != getZ(start);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "book.hpp"
+#include "chess.hpp"
+#include "eventlog.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <vector>
+
+struct EngineOptions {
+	// plies searched at most, the search deepens one ply at a time until it runs out of time
+	uint32_t max_depth = 4;
+	uint64_t think_ms = 250;
+	// probed before searching, nullptr plays without a book
+	const OpeningBook *book = nullptr;
+};
+
+struct EngineMove {
+	uint32_t from = 0;
+	uint32_t to = 0;
+	MoveType type = MoveType::None;
+	// for a pawn that reaches the last row
+	Figure promotion = Figure::Queen;
+
+	bool from_book = false;
+	// deepest search that was completed, and the positions it looked at
+	uint32_t depth = 0;
+	uint64_t nodes = 0;
+	int32_t score = 0;
+};
+
+// plays for a seat: takes a move from the book if the position is in it, searches otherwise; the search is
+// paranoid, every other player is assumed to play against the engine's player, and scores material
+class Engine {
+public:
+	static constexpr int32_t INFINITE_SCORE = 1 << 30;
+	static constexpr int32_t OUT_SCORE = 1 << 24;
+
+	explicit Engine(const EngineOptions &options = EngineOptions(), uint64_t seed = std::random_device()());
+
+	// nullopt if the player to move has no moves
+	std::optional<EngineMove> think(const Field &field);
+
+	inline const EngineOptions &getOptions() const {
+		return options;
+	}
+
+	// for a clock that gives every move a different budget
+	inline void setThinkTime(uint64_t think_ms) {
+		options.think_ms = think_ms;
+	}
+
+	// the events a move adds to a session's log, the promotion included
+	static void appendEvents(const Field &field, const EngineMove &move, std::vector<GameEvent> &events);
+
+	// checkmated, out of time or without a king
+	static bool isOut(const Field &field, uint32_t player);
+
+private:
+	struct Candidate {
+		MoveCandidate move;
+		int32_t order;
+	};
+
+	std::optional<EngineMove> probeBook(const Field &field, std::span<const MoveCandidate> legal);
+
+	int32_t search(const Field &field, uint32_t depth, int32_t alpha, int32_t beta, uint32_t player);
+	int32_t evaluate(const Field &field, uint32_t player) const;
+	void collectCandidates(Field &field, std::vector<Candidate> &candidates) const;
+	void play(Field &field, const MoveCandidate &move) const;
+
+	inline bool isOutOfTime() {
+		// the clock is read every few positions that generate moves, each of those takes a while
+		if (!stopped && (++polls & 15) == 0 && std::chrono::steady_clock::now() >= deadline) {
+			stopped = true;
+		}
+		return stopped;
+	}
+
+	EngineOptions options;
+	std::mt19937_64 random;
+
+	std::chrono::steady_clock::time_point deadline;
+	uint64_t nodes = 0;
+	uint32_t polls = 0;
+	bool stopped = false;
+};
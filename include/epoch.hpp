@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+
+// epoch based reclamation: readers pin the current epoch while they hold pointers into a shared
+// structure, writers unlink objects and retire them, they are freed two epochs later when no reader
+// can still see them; pinning costs an atomic load and store, readers never block writers or each other
+class EpochDomain {
+public:
+	class Guard {
+	public:
+		inline Guard() {
+			EpochDomain::enter();
+		}
+
+		inline ~Guard() {
+			EpochDomain::leave();
+		}
+
+		Guard(const Guard&) = delete;
+		Guard &operator=(const Guard&) = delete;
+	};
+
+	// runs the deleter once no pinned reader can reach the object anymore
+	static void retire(std::function<void()> deleter);
+
+	// tries to advance the epoch and frees what can be freed
+	static void collect();
+
+	// frees everything, only valid when no reader is pinned
+	static void drain();
+
+private:
+	static void enter();
+	static void leave();
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "chess.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// one entry of a session's log, packed into 8 bytes without padding so runs of them can be written out as they are
+struct GameEvent {
+	enum Kind : uint8_t {
+		Move,
+		Capture,
+		Castle,
+		EnPassant,
+		Promote,
+		Check,
+		CheckMate,
+		Surrender,
+		Timeout,
+	};
+
+	uint16_t from = 0;
+	uint16_t to = 0;
+	uint8_t player = 0;
+	Kind kind = Move;
+	Figure promotion = Figure::None;
+	uint8_t reserved = 0;
+
+	inline GameEvent() {}
+	inline GameEvent(uint32_t player, uint32_t from, uint32_t to, Figure promotion, Kind kind) : from(from), to(to), player(player), kind(kind), promotion(promotion) {}
+
+	static inline std::string_view getKindName(Kind kind) {
+		switch (kind) {
+			case Move: return "move";
+			case Capture: return "capture";
+			case Castle: return "castle";
+			case EnPassant: return "en_passant";
+			case Promote: return "promote";
+			case Check: return "check";
+			case CheckMate: return "checkmate";
+			case Surrender: return "surrender";
+			case Timeout: return "timeout";
+		}
+		return "unknown";
+	}
+};
+
+static_assert(sizeof(GameEvent) == 8);
+
+// append-only log in chunks that double in size, starting small so a short game costs little; entries never
+// move once they are appended, so growing the log never copies what is already in it, and a ply is found
+// with a few shifts
+class EventLog {
+public:
+	static constexpr size_t FIRST_CHUNK_SHIFT = 6;
+	static constexpr size_t FIRST_CHUNK_SIZE = size_t(1) << FIRST_CHUNK_SHIFT;
+
+	class Iterator {
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = GameEvent;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const GameEvent*;
+		using reference = const GameEvent&;
+
+		inline Iterator() {}
+		inline Iterator(const EventLog *log, size_t ply) : log(log), ply(ply) {}
+
+		inline reference operator*() const { return (*log)[ply]; }
+		inline pointer operator->() const { return &(*log)[ply]; }
+		inline reference operator[](difference_type offset) const { return (*log)[ply + offset]; }
+
+		inline Iterator &operator++() { ply++; return *this; }
+		inline Iterator &operator--() { ply--; return *this; }
+		inline Iterator operator++(int) { Iterator copy = *this; ply++; return copy; }
+		inline Iterator operator--(int) { Iterator copy = *this; ply--; return copy; }
+		inline Iterator &operator+=(difference_type offset) { ply += offset; return *this; }
+		inline Iterator &operator-=(difference_type offset) { ply -= offset; return *this; }
+
+		inline Iterator operator+(difference_type offset) const { return Iterator(log, ply + offset); }
+		inline Iterator operator-(difference_type offset) const { return Iterator(log, ply - offset); }
+		inline difference_type operator-(const Iterator &other) const { return difference_type(ply) - difference_type(other.ply); }
+		friend inline Iterator operator+(difference_type offset, const Iterator &it) { return it + offset; }
+
+		inline bool operator==(const Iterator &other) const { return ply == other.ply; }
+		inline auto operator<=>(const Iterator &other) const { return ply <=> other.ply; }
+
+	private:
+		const EventLog *log = nullptr;
+		size_t ply = 0;
+	};
+
+	EventLog() = default;
+	EventLog(EventLog&&) = default;
+	EventLog &operator=(EventLog&&) = default;
+
+	inline EventLog(const EventLog &other) {
+		append(other, 0);
+	}
+
+	inline EventLog &operator=(const EventLog &other) {
+		if (this != &other) {
+			clear();
+			append(other, 0);
+		}
+		return *this;
+	}
+
+	inline size_t size() const {
+		return count;
+	}
+
+	inline bool empty() const {
+		return count == 0;
+	}
+
+	inline const GameEvent &operator[](size_t ply) const {
+		const size_t chunk = getChunk(ply);
+		return chunks[chunk][ply - getChunkStart(chunk)];
+	}
+
+	inline const GameEvent &back() const {
+		return (*this)[count - 1];
+	}
+
+	inline Iterator begin() const {
+		return Iterator(this, 0);
+	}
+
+	inline Iterator end() const {
+		return Iterator(this, count);
+	}
+
+	inline void push_back(const GameEvent &event) {
+		const size_t chunk = getChunk(count);
+		if (chunk == chunks.size()) {
+			chunks.push_back(std::make_unique_for_overwrite<GameEvent[]>(getChunkSize(chunk)));
+		}
+
+		chunks[chunk][count - getChunkStart(chunk)] = event;
+		count++;
+	}
+
+	// appends the entries of another log from the given ply on, a chunk at a time
+	inline void append(const EventLog &other, size_t since) {
+		other.forEachSpan(since, other.size(), [this](std::span<const GameEvent> events) {
+			append(events);
+		});
+	}
+
+	inline void append(std::span<const GameEvent> events) {
+		while (!events.empty()) {
+			const size_t chunk = getChunk(count);
+			if (chunk == chunks.size()) {
+				chunks.push_back(std::make_unique_for_overwrite<GameEvent[]>(getChunkSize(chunk)));
+			}
+
+			const size_t offset = count - getChunkStart(chunk);
+			const size_t n = std::min(events.size(), getChunkSize(chunk) - offset);
+			memcpy(&chunks[chunk][offset], events.data(), n * sizeof(GameEvent));
+			count += n;
+			events = events.subspan(n);
+		}
+	}
+
+	// the chunks stay allocated for the next game
+	inline void clear() {
+		count = 0;
+	}
+
+	// calls back with the entries in [begin, end) as they lie in memory, one span per chunk they touch
+	template <typename F>
+	inline void forEachSpan(size_t begin, size_t end, F &&callback) const {
+		end = std::min(end, count);
+		while (begin < end) {
+			const size_t chunk = getChunk(begin);
+			const size_t offset = begin - getChunkStart(chunk);
+			const size_t n = std::min(end - begin, getChunkSize(chunk) - offset);
+			callback(std::span<const GameEvent>(&chunks[chunk][offset], n));
+			begin += n;
+		}
+	}
+
+private:
+	// chunk i holds FIRST_CHUNK_SIZE << i entries
+	static inline size_t getChunk(size_t ply) {
+		return std::bit_width((ply >> FIRST_CHUNK_SHIFT) + 1) - 1;
+	}
+
+	static inline size_t getChunkStart(size_t chunk) {
+		return ((size_t(1) << chunk) - 1) << FIRST_CHUNK_SHIFT;
+	}
+
+	static inline size_t getChunkSize(size_t chunk) {
+		return FIRST_CHUNK_SIZE << chunk;
+	}
+
+	std::vector<std::unique_ptr<GameEvent[]>> chunks;
+	size_t count = 0;
+};
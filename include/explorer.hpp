@@ -0,0 +1,149 @@
+#pragma once
+
+#include "chess.hpp"
+#include "eventlog.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// an explorer is the header, the positions sorted by their key and the moves played in them; the moves of
+// a position are next to each other, most played first, and link to the position they lead to
+struct ExplorerHeader {
+	static constexpr char MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'E', 'X', 'P'};
+	static constexpr uint32_t VERSION = 1;
+
+	char magic[8];
+	uint32_t version;
+	// plies of every game that were counted
+	uint32_t max_depth;
+	uint64_t num_games;
+	uint32_t num_nodes;
+	uint32_t num_moves;
+};
+
+struct ExplorerNode {
+	// Field::calculateKey, which includes the player count
+	uint64_t key;
+	uint32_t first_move;
+	uint16_t num_moves;
+	uint8_t num_players;
+	uint8_t reserved;
+};
+
+struct ExplorerMove {
+	uint16_t from;
+	uint16_t to;
+	GameEvent::Kind kind;
+	// what a pawn that reached the last row became
+	Figure promotion;
+	uint16_t reserved;
+
+	// node after the move, NO_NODE if nothing was counted there
+	uint32_t child;
+	uint32_t games;
+	// games without a single winner
+	uint32_t undecided;
+	uint32_t wins[MAX_PLAYERS];
+};
+
+struct ExplorerBuildStats {
+	uint64_t games = 0;
+	uint64_t nodes = 0;
+	uint64_t moves = 0;
+};
+
+// move statistics of the openings of many games, memory mapped; a position is found by its key with a binary
+// search, or by following the moves from the start with one step per ply
+class OpeningExplorer {
+public:
+	static constexpr uint32_t DEFAULT_DEPTH = 24;
+	static constexpr uint32_t NO_NODE = ~0u;
+
+	OpeningExplorer() = default;
+	~OpeningExplorer();
+
+	OpeningExplorer(const OpeningExplorer&) = delete;
+	OpeningExplorer &operator=(const OpeningExplorer&) = delete;
+
+	bool open(const std::string &path);
+
+	inline const ExplorerHeader &getHeader() const {
+		return header;
+	}
+
+	inline std::span<const ExplorerNode> getNodes() const {
+		return nodes;
+	}
+
+	uint32_t findNode(uint64_t key) const;
+	uint32_t findNode(const Field &field) const;
+
+	// the node after playing the moves from the start, NO_NODE once a move wasn't counted
+	uint32_t walk(uint32_t num_players, std::span<const GameEvent> moves) const;
+
+	// the moves of a node, empty for NO_NODE
+	std::span<const ExplorerMove> getMoves(uint32_t node) const;
+
+	// json of the moves in a position, for the http control plane
+	std::string toJson(uint64_t key) const;
+
+	// build <explorer> <databases>... [--depth N] [--threads N]
+	// merge <explorer> <explorers>...
+	// show <explorer> <players> | --key <hex>
+	static int run(const std::vector<std::string> &args);
+
+private:
+	ExplorerHeader header = {};
+	std::span<const ExplorerNode> nodes;
+	std::span<const ExplorerMove> moves;
+
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+
+#if defined(_WIN32)
+	std::vector<uint8_t> contents;
+#endif
+};
+
+// collects the statistics in memory; games and explorers that already exist are merged into it, so new
+// games are added without going through the old ones again
+class ExplorerBuilder {
+public:
+	explicit ExplorerBuilder(uint32_t max_depth = OpeningExplorer::DEFAULT_DEPTH) : max_depth(max_depth) {}
+
+	// winner is a seat or GameDatabase::NO_WINNER
+	void addGame(uint32_t num_players, const EventLog &events, uint8_t winner);
+	void addExplorer(const OpeningExplorer &explorer);
+	void merge(const ExplorerBuilder &other);
+
+	// reads the games of the databases on the given number of threads, every thread into its own builder
+	bool addDatabases(std::span<const std::string> paths, uint32_t num_threads);
+
+	bool save(const std::string &path, ExplorerBuildStats &stats) const;
+
+	inline uint32_t getMaxDepth() const {
+		return max_depth;
+	}
+
+private:
+	struct Entry {
+		ExplorerMove move;
+		// 0 if the position after the move isn't known
+		uint64_t child_key;
+	};
+
+	struct Position {
+		uint32_t num_players = 0;
+		std::vector<Entry> moves;
+	};
+
+	void addMove(uint64_t key, uint32_t num_players, const Entry &entry);
+
+	uint32_t max_depth;
+	uint64_t num_games = 0;
+	std::unordered_map<uint64_t, Position> positions;
+};
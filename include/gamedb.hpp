@@ -0,0 +1,171 @@
+#pragma once
+
+#include "chess.hpp"
+#include "eventlog.hpp"
+#include "record.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// a database is a header followed by its sections, each one 8 byte aligned; per game columns are
+// fixed width and indexed by the game's number, so a query reads only the columns it filters on
+struct GameDbHeader {
+	static constexpr char MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'G', 'D', 'B'};
+	static constexpr uint32_t VERSION = 1;
+
+	enum Section : uint32_t {
+		// uint8_t per game
+		PlayerCounts,
+		// uint8_t per game, the seat of the winner or NO_WINNER
+		Results,
+		// uint32_t plies per game
+		Lengths,
+		// uint64_t per game and one more, the first event of every game in the move blocks
+		MoveStarts,
+		// MAX_PLAYERS uint32_t name ids per game, NO_NAME for the seats a game doesn't have
+		Seats,
+		// GameDbBlock per block of EVENTS_PER_BLOCK events
+		Blocks,
+		BlockData,
+		// uint32_t per name and one more, the names are sorted so they can be looked up by binary search
+		NameOffsets,
+		NameData,
+		// uint64_t offsets into Postings where the list of every slot starts, and one more for the end; a slot
+		// per player count from 0 to MAX_PLAYERS, per winning seat with NO_WINNER last, per name
+		PlayerCountIndex,
+		ResultIndex,
+		NameIndex,
+		// sorted game numbers
+		Postings,
+		SECTIONS,
+	};
+
+	char magic[8];
+	uint32_t version;
+	uint32_t num_games;
+	uint64_t num_events;
+	uint32_t num_names;
+	uint32_t num_blocks;
+
+	// byte offset and size of every section
+	uint64_t offsets[SECTIONS];
+	uint64_t sizes[SECTIONS];
+};
+
+// events are stored byte plane by byte plane, all first bytes of a block, then all second bytes and so on,
+// which puts the bytes that hardly change next to each other before the block is compressed
+struct GameDbBlock {
+	uint64_t offset;
+	uint32_t size;
+	uint32_t raw_size;
+};
+
+struct GameDbQuery {
+	std::optional<uint32_t> num_players;
+	// a seat, or GameDatabase::NO_WINNER for games without a single winner
+	std::optional<uint32_t> winner;
+	std::optional<std::string> player;
+};
+
+struct GameDbImportStats {
+	uint64_t games = 0;
+	uint64_t skipped = 0;
+	uint64_t events = 0;
+	uint64_t raw_bytes = 0;
+	uint64_t compressed_bytes = 0;
+};
+
+// the block a reader decompressed last, bulk readers keep one per thread so the games of a block
+// are sliced out of a single decompression
+struct GameDbBlockCache {
+	uint64_t index = UINT64_MAX;
+	std::vector<uint8_t> planes;
+	std::vector<GameEvent> events;
+};
+
+// finished games for analysis, built in bulk from game records and memory mapped for queries
+class GameDatabase {
+public:
+	static constexpr uint32_t EVENTS_PER_BLOCK = 8192;
+	static constexpr uint8_t NO_WINNER = 0xff;
+	static constexpr uint32_t NO_NAME = ~0u;
+
+	GameDatabase() = default;
+	~GameDatabase();
+
+	GameDatabase(const GameDatabase&) = delete;
+	GameDatabase &operator=(const GameDatabase&) = delete;
+
+	// reads, analyses and compresses the records on the given number of threads; the games keep the order
+	// of the files, records that can't be read are skipped
+	static bool build(const std::string &path, std::span<const std::string> records, uint32_t num_threads, GameDbImportStats &stats);
+
+	bool open(const std::string &path);
+
+	// the only seat that is still in, or NO_WINNER if the game didn't get that far
+	static uint8_t getWinner(const Field &field);
+
+	inline uint32_t getGameCount() const {
+		return header.num_games;
+	}
+
+	inline uint32_t getPlayerCount(uint32_t game) const {
+		return getSection<uint8_t>(GameDbHeader::PlayerCounts)[game];
+	}
+
+	inline uint8_t getResult(uint32_t game) const {
+		return getSection<uint8_t>(GameDbHeader::Results)[game];
+	}
+
+	inline uint32_t getLength(uint32_t game) const {
+		return getSection<uint32_t>(GameDbHeader::Lengths)[game];
+	}
+
+	inline uint32_t getBlockCount() const {
+		return header.num_blocks;
+	}
+
+	// the games whose first event is in the block, the last block also has the games without events at the end
+	std::pair<uint32_t, uint32_t> getGamesInBlock(uint32_t block) const;
+
+	std::vector<std::string_view> getNames(uint32_t game) const;
+
+	// decompresses only the blocks the game's moves are in
+	bool getMoves(uint32_t game, EventLog &events) const;
+	// reuses the cached block if the game starts in it, for reading games in order
+	bool getMoves(uint32_t game, EventLog &events, GameDbBlockCache &cache) const;
+	bool getRecord(uint32_t game, GameRecord &record) const;
+
+	// games that match every given filter, from the indexes alone
+	std::vector<uint32_t> find(const GameDbQuery &query) const;
+
+	std::span<const uint32_t> findByPlayerCount(uint32_t num_players) const;
+	std::span<const uint32_t> findByResult(uint8_t winner) const;
+	std::span<const uint32_t> findByPlayer(std::string_view name) const;
+
+	// import <db> <records or directories>... [--threads N]
+	// query <db> [--players N] [--winner <seat>|none] [--name <player>] [--limit N] [--text]
+	static int run(const std::vector<std::string> &args);
+
+private:
+	template <typename T>
+	inline std::span<const T> getSection(GameDbHeader::Section section) const {
+		return std::span<const T>(reinterpret_cast<const T*>(data + header.offsets[section]), header.sizes[section] / sizeof(T));
+	}
+
+	std::string_view getName(uint32_t id) const;
+	std::span<const uint32_t> getPostings(GameDbHeader::Section index, size_t slot) const;
+
+	GameDbHeader header = {};
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+
+#if defined(_WIN32)
+	std::vector<uint8_t> contents;
+#endif
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <format>
 #include <iostream>
 
@@ -23,8 +24,15 @@ static inline void eprintln(std::format_string<Args...> fmt, Args &&...args) {
 	std::cerr<<std::format(fmt, std::forward<Args>(args)...)<<std::endl;
 }
 
+// runs before panic aborts, the logger sets it so the lines it still has queued, often the cause, aren't lost
+inline std::atomic<void (*)()> panic_hook = nullptr;
+
 template <typename ...Args>
 static inline void panic(std::format_string<Args...> fmt, Args &&...args) {
+	if (void (*hook)() = panic_hook.load()) {
+		hook();
+	}
+
 	std::cerr<<std::format(fmt, std::forward<Args>(args)...)<<std::endl;
 	abort();
 }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <format>
+#include <string>
+#include <string_view>
+
+// for strings that come from clients, like player names
+static inline std::string escapeJson(std::string_view text) {
+	std::string result;
+	result.reserve(text.size());
+	for (const char c : text) {
+		switch (c) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			default: {
+				if (uint8_t(c) < 0x20) {
+					result += std::format("\\u{:04x}", uint8_t(c));
+				} else {
+					result += c;
+				}
+			}
+		}
+	}
+	return result;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "chess.hpp"
+#include "message.hpp"
+
+#include "SDL3_net/SDL_net.h"
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+// one seat of the swarm, plays random moves over the raw protocol like the native client
+struct LoadClient {
+	enum State {
+		Connecting,
+		Joining,
+		Playing,
+		// done bots keep reading until the end of the run so the server doesn't see them drop
+		Done,
+		Closed,
+	} state = Connecting;
+
+	SDLNet_StreamSocket *socket = nullptr;
+	uint64_t session = 0;
+	uint32_t index = 0;
+
+	std::vector<uint8_t> stream;
+	size_t tiles_expected = 0;
+
+	Field field;
+	uint32_t player = ~0u;
+	uint32_t moves = 0;
+
+	// a move or promotion was sent and the server didn't echo it yet
+	bool waiting = false;
+
+	uint64_t connect_us = 0;
+	uint64_t sent_us = 0;
+};
+
+// opens many connections to the lobby port of a headless server and measures how it keeps up,
+// the results are printed as json on stdout
+class LoadGen {
+public:
+	LoadGen(const std::vector<std::string> &args);
+	~LoadGen();
+
+	int run();
+
+	// polls the http port until the server answers, for a server that was just started
+	bool waitForServer(uint32_t timeout_ms);
+
+	// the json printed at the end of run()
+	inline const std::string &getReport() const {
+		return result;
+	}
+
+	// a one line summary of throughput and latencies, valid after run()
+	std::string summarize() const;
+
+private:
+	bool createSessions();
+	void openClient(uint32_t index, uint64_t now);
+	void pollConnecting(LoadClient &client);
+	void readClient(LoadClient &client, uint64_t now);
+
+	// reassembles messages and the tiles following an accept
+	void receive(LoadClient &client, std::span<const uint8_t> data, uint64_t now);
+	void handleMessage(LoadClient &client, const Message &msg, uint64_t now);
+	void makeMove(LoadClient &client, uint64_t now);
+	bool sendMessage(LoadClient &client, const Message &msg);
+	void close(LoadClient &client);
+
+	std::string report(uint64_t elapsed_us);
+
+	std::string hostname = "127.0.0.1";
+	uint16_t port = 1234;
+	uint16_t http_port = 8080;
+	uint32_t num_clients = 100;
+	uint32_t num_players = 2;
+	double join_rate = 100.0;
+	uint32_t duration_s = 30;
+	uint32_t max_moves = 50;
+	bool valid = true;
+
+	SDLNet_Address *address = nullptr;
+	std::vector<uint64_t> sessions;
+	std::vector<std::unique_ptr<LoadClient>> clients;
+	std::mt19937 random{std::random_device()()};
+
+	std::vector<uint64_t> join_latencies_us;
+	std::vector<uint64_t> move_latencies_us;
+	uint32_t failed_connects = 0;
+	uint32_t rejects = 0;
+	uint32_t disconnects = 0;
+	uint32_t stalled = 0;
+	uint64_t messages_received = 0;
+	uint64_t bytes_received = 0;
+	double moves_per_s = 0.0;
+	std::string result;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+enum class LogLevel : uint32_t {
+	Debug,
+	Info,
+	Warn,
+	Error,
+};
+
+// field value that is rendered as a 16 digit hex number, for session ids
+struct LogHex {
+	uint64_t value;
+};
+
+// one line of the log as it sits in a ring, the fields follow it in their binary form
+struct LogRecord {
+	// bytes of the record including the fields, a multiple of 8
+	uint32_t size;
+	LogLevel level;
+	uint64_t time_us;
+
+	// string literal, like the keys of the fields
+	const char *message;
+
+	// turns the fields into key=value pairs, nullptr for the padding in front of a wrap
+	void (*render)(const uint8_t *fields, std::string &out);
+};
+
+// written by one thread, drained by the writer
+struct LogRing {
+	static constexpr size_t CAPACITY = 64 * 1024;
+
+	alignas(64) std::atomic<uint64_t> head = 0;
+	alignas(64) std::atomic<uint64_t> tail = 0;
+	alignas(64) uint8_t data[CAPACITY];
+};
+
+// lines are queued into a ring of the calling thread without taking a lock or formatting anything,
+// a background thread renders them and writes them out in batches; a full ring drops the line
+class Logger {
+public:
+	Logger();
+	~Logger();
+
+	static inline Logger &get() {
+		static Logger logger;
+		return logger;
+	}
+
+	inline bool isEnabled(LogLevel level) const {
+		return level >= min_level.load(std::memory_order_relaxed);
+	}
+
+	inline void setLevel(LogLevel level) {
+		min_level = level;
+	}
+
+	static std::optional<LogLevel> parseLevel(std::string_view name);
+	static std::string_view getLevelName(LogLevel level);
+
+	// writes everything that was queued so far, for shutdown and before aborting
+	void flush();
+
+	template <typename ...Fields>
+	inline void write(LogLevel level, const char *message, const Fields &...fields) {
+		static_assert(sizeof...(Fields) % 2 == 0, "log fields are key value pairs");
+
+		const size_t size = (sizeof(LogRecord) + getFieldsSize<0>(fields...) + 7) & ~size_t(7);
+		uint8_t *out = reserve(size);
+		if (!out) {
+			return;
+		}
+
+		LogRecord record;
+		record.size = size;
+		record.level = level;
+		record.time_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		record.message = message;
+		record.render = &renderFields<Fields...>;
+		memcpy(out, &record, sizeof(record));
+		writeFields<0>(out + sizeof(record), fields...);
+
+		commit(size);
+	}
+
+private:
+	template <typename T>
+	static constexpr bool isString = std::is_convertible_v<const T&, std::string_view>;
+
+	// keys are string literals and only their address is queued, values are copied
+	template <size_t I, typename T>
+	static inline size_t getFieldSize(const T &value) {
+		if constexpr (I % 2 == 0) {
+			static_assert(std::is_array_v<T>, "log field keys have to be string literals");
+			return sizeof(const char*);
+		} else if constexpr (isString<T>) {
+			return sizeof(uint32_t) + std::string_view(value).size();
+		} else {
+			static_assert(std::is_arithmetic_v<T> || std::is_same_v<T, LogHex>, "log field values are numbers or strings");
+			return sizeof(T);
+		}
+	}
+
+	template <size_t I, typename T, typename ...Rest>
+	static inline size_t getFieldsSize(const T &value, const Rest &...rest) {
+		return getFieldSize<I>(value) + getFieldsSize<I + 1>(rest...);
+	}
+
+	template <size_t I>
+	static inline size_t getFieldsSize() {
+		return 0;
+	}
+
+	template <size_t I, typename T, typename ...Rest>
+	static inline void writeFields(uint8_t *out, const T &value, const Rest &...rest) {
+		if constexpr (I % 2 == 0) {
+			const char *key = value;
+			memcpy(out, &key, sizeof(key));
+			out += sizeof(key);
+		} else if constexpr (isString<T>) {
+			const std::string_view text = value;
+			const uint32_t length = text.size();
+			memcpy(out, &length, sizeof(length));
+			memcpy(out + sizeof(length), text.data(), length);
+			out += sizeof(length) + length;
+		} else {
+			memcpy(out, &value, sizeof(value));
+			out += sizeof(value);
+		}
+
+		writeFields<I + 1>(out, rest...);
+	}
+
+	template <size_t I>
+	static inline void writeFields(uint8_t*) {}
+
+	template <typename ...Fields>
+	static void renderFields(const uint8_t *fields, std::string &out) {
+		[&]<size_t ...I>(std::index_sequence<I...>) {
+			(renderField<I, std::remove_cvref_t<Fields>>(fields, out), ...);
+		}(std::index_sequence_for<Fields...>());
+	}
+
+	template <size_t I, typename T>
+	static inline void renderField(const uint8_t *&in, std::string &out) {
+		if constexpr (I % 2 == 0) {
+			const char *key;
+			memcpy(&key, in, sizeof(key));
+			in += sizeof(key);
+			out += ' ';
+			out += key;
+			out += '=';
+		} else if constexpr (isString<T>) {
+			uint32_t length;
+			memcpy(&length, in, sizeof(length));
+			appendString(std::string_view(reinterpret_cast<const char*>(in + sizeof(length)), length), out);
+			in += sizeof(length) + length;
+		} else {
+			T value;
+			memcpy(&value, in, sizeof(value));
+			in += sizeof(value);
+
+			if constexpr (std::is_same_v<T, LogHex>) {
+				std::format_to(std::back_inserter(out), "{:016x}", value.value);
+			} else {
+				std::format_to(std::back_inserter(out), "{}", value);
+			}
+		}
+	}
+
+	// quoted if it contains spaces, quotes or is empty
+	static void appendString(std::string_view text, std::string &out);
+
+	// space for a record in the ring of this thread, nullptr if it is full
+	uint8_t *reserve(size_t size);
+	void commit(size_t size);
+
+	void run();
+	bool drain(std::string &out, std::string &err);
+
+	std::atomic<LogLevel> min_level = LogLevel::Info;
+	std::atomic<uint64_t> dropped = 0;
+
+	std::mutex rings_mutex;
+	std::vector<std::shared_ptr<LogRing>> rings;
+
+	// serializes drains between the writer and flush()
+	std::mutex drain_mutex;
+
+	std::mutex wakeup_mutex;
+	std::condition_variable wakeup;
+	bool stopping = false;
+	std::thread writer;
+};
+
+template <size_t N, typename ...Fields>
+static inline void logDebug(const char (&message)[N], const Fields &...fields) {
+	if (Logger::get().isEnabled(LogLevel::Debug)) {
+		Logger::get().write(LogLevel::Debug, message, fields...);
+	}
+}
+
+template <size_t N, typename ...Fields>
+static inline void logInfo(const char (&message)[N], const Fields &...fields) {
+	if (Logger::get().isEnabled(LogLevel::Info)) {
+		Logger::get().write(LogLevel::Info, message, fields...);
+	}
+}
+
+template <size_t N, typename ...Fields>
+static inline void logWarn(const char (&message)[N], const Fields &...fields) {
+	if (Logger::get().isEnabled(LogLevel::Warn)) {
+		Logger::get().write(LogLevel::Warn, message, fields...);
+	}
+}
+
+template <size_t N, typename ...Fields>
+static inline void logError(const char (&message)[N], const Fields &...fields) {
+	if (Logger::get().isEnabled(LogLevel::Error)) {
+		Logger::get().write(LogLevel::Error, message, fields...);
+	}
+}
@@ -5,6 +5,7 @@
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <string>
 
 struct Message {
 	enum : uint32_t {
@@ -14,18 +15,36 @@ struct Message {
 		Reject,
 		Move,
 		Promotion,
+		Spectate,
+		Resume,
+		Clock,
+		Ping,
+		Pong,
 	} type = None;
 
 	uint32_t player;
 
+	// position in the session log after this message, stamped by the host on everything it sends;
+	// a resuming client sends the last one it has seen
+	uint64_t seq = 0;
+
 	union {
 		struct {
-			uint32_t session;
+			uint64_t session;
 			uint8_t name[20];
 		} join;
 
+		struct {
+			uint64_t session;
+		} spectate;
+
+		struct {
+			uint64_t session;
+		} resume;
+
 		struct {
 			uint32_t num_players;
+			uint32_t current_player;
 		} accept;
 
 		struct {
@@ -39,9 +58,36 @@ struct Message {
 			Figure figure;
 			uint32_t next_player;
 		} promotion;
+
+		// remaining time of a player, 0 means the player ran out of time and is out
+		struct {
+			uint32_t remaining_ms;
+			uint32_t next_player;
+		} clock;
+
+		// either side can ping, the pong echoes the timestamp of the sender
+		struct {
+			uint64_t timestamp_us;
+		} ping;
 	};
 
-	static inline Message makeJoin(uint32_t session, uint32_t player, const std::string &name) {
+	// session a join, spectate or resume request refers to
+	inline uint64_t getSession() const {
+		switch (type) {
+			case Join: return join.session;
+			case Spectate: return spectate.session;
+			case Resume: return resume.session;
+			default: return ~0ull;
+		}
+	}
+
+	inline std::string getJoinName() const {
+		std::string tmp(sizeof(join.name) + 1, '\0');
+		memcpy(tmp.data(), join.name, sizeof(join.name));
+		return tmp.c_str();
+	}
+
+	static inline Message makeJoin(uint64_t session, uint32_t player, const std::string &name) {
 		Message msg;
 		msg.player = player;
 		msg.type = Join;
@@ -53,11 +99,32 @@ struct Message {
 		return msg;
 	}
 
-	static inline Message makeAccept(uint32_t player, uint32_t num_players) {
+	static inline Message makeAccept(uint32_t player, uint32_t num_players, uint32_t current_player) {
 		Message msg;
 		msg.type = Accept;
 		msg.player = player;
 		msg.accept.num_players = num_players;
+		msg.accept.current_player = current_player;
+		return msg;
+	}
+
+	// sent by a client to take back its seat (or ~0u to spectate) after a dropped connection, the
+	// host answers with a Resume followed by the missed moves or with an Accept and a full snapshot
+	static inline Message makeResume(uint64_t session, uint32_t player, uint64_t seq) {
+		Message msg;
+		msg.type = Resume;
+		msg.player = player;
+		msg.seq = seq;
+		msg.resume.session = session;
+		return msg;
+	}
+
+	// spectators are accepted with player ~0u and only receive, they never take a seat
+	static inline Message makeSpectate(uint64_t session) {
+		Message msg;
+		msg.type = Spectate;
+		msg.player = ~0u;
+		msg.spectate.session = session;
 		return msg;
 	}
 
@@ -85,4 +152,27 @@ struct Message {
 		msg.promotion.figure = figure;
 		return msg;
 	}
+
+	static inline Message makePing(uint64_t timestamp_us) {
+		Message msg;
+		msg.type = Ping;
+		msg.ping.timestamp_us = timestamp_us;
+		return msg;
+	}
+
+	static inline Message makePong(uint64_t timestamp_us) {
+		Message msg;
+		msg.type = Pong;
+		msg.ping.timestamp_us = timestamp_us;
+		return msg;
+	}
+
+	static inline Message makeClock(uint32_t player, uint32_t remaining_ms, uint32_t next_player) {
+		Message msg;
+		msg.type = Clock;
+		msg.player = player;
+		msg.clock.remaining_ms = remaining_ms;
+		msg.clock.next_player = next_player;
+		return msg;
+	}
 };
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Metric;
+
+// every metric registers itself here when it is constructed, which happens during static
+// initialization; the list doesn't change afterwards, so rendering it needs no lock
+class MetricsRegistry {
+public:
+	static inline MetricsRegistry &get() {
+		static MetricsRegistry registry;
+		return registry;
+	}
+
+	inline void add(Metric *metric) {
+		metrics.push_back(metric);
+	}
+
+	// prometheus text exposition format
+	std::string render() const;
+
+private:
+	std::vector<Metric*> metrics;
+};
+
+class Metric {
+public:
+	Metric(const char *name, const char *help);
+	virtual ~Metric() = default;
+
+	virtual void render(std::string &out) const = 0;
+
+protected:
+	// threads spread their updates over a few cache lines instead of all hitting the same one
+	static constexpr uint32_t SHARDS = 16;
+
+	static inline uint32_t getShard() {
+		static std::atomic<uint32_t> next_shard = 0;
+		thread_local const uint32_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+		return shard;
+	}
+
+	const char *name;
+	const char *help;
+};
+
+// only goes up
+class Counter : public Metric {
+public:
+	using Metric::Metric;
+
+	inline void add(uint64_t value = 1) {
+		shards[getShard()].value.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	uint64_t getValue() const;
+	void render(std::string &out) const override;
+
+private:
+	struct alignas(64) Shard {
+		std::atomic<uint64_t> value = 0;
+	};
+
+	Shard shards[SHARDS];
+};
+
+// current value of something, changed from anywhere
+class Gauge : public Metric {
+public:
+	using Metric::Metric;
+
+	inline void add(int64_t value = 1) {
+		this->value.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	inline void sub(int64_t value = 1) {
+		this->value.fetch_sub(value, std::memory_order_relaxed);
+	}
+
+	inline void set(int64_t value) {
+		this->value.store(value, std::memory_order_relaxed);
+	}
+
+	void render(std::string &out) const override;
+
+private:
+	std::atomic<int64_t> value = 0;
+};
+
+// durations in nanoseconds, in log-linear buckets like HdrHistogram: every power of two is split into
+// 8 buckets, so a value is known to within 12.5%; exported in seconds with power of two boundaries
+class Histogram : public Metric {
+public:
+	using Metric::Metric;
+
+	inline void record(uint64_t ns) {
+		Shard &shard = shards[getShard()];
+		shard.buckets[getBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+		shard.sum.fetch_add(ns, std::memory_order_relaxed);
+	}
+
+	void render(std::string &out) const override;
+
+private:
+	static constexpr uint32_t SUB_BUCKET_BITS = 3;
+	static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static constexpr uint32_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	static inline uint32_t getBucket(uint64_t ns) {
+		if (ns < SUB_BUCKETS) {
+			return ns;
+		}
+
+		const uint32_t exponent = std::bit_width(ns) - 1;
+		const uint32_t sub_bucket = (ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+		return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+	}
+
+	// largest value that falls into the bucket
+	static uint64_t getBucketLimit(uint32_t bucket);
+
+	struct alignas(64) Shard {
+		std::atomic<uint64_t> buckets[BUCKETS] = {};
+		std::atomic<uint64_t> sum = 0;
+	};
+
+	Shard shards[SHARDS];
+};
+
+// records the time until it goes out of scope
+class HistogramTimer {
+public:
+	inline explicit HistogramTimer(Histogram &histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+
+	inline ~HistogramTimer() {
+		histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	HistogramTimer(const HistogramTimer&) = delete;
+	HistogramTimer &operator=(const HistogramTimer&) = delete;
+
+private:
+	Histogram &histogram;
+	const std::chrono::steady_clock::time_point start;
+};
+
+// what the headless server exports at /metrics
+class Metrics {
+public:
+	static Gauge active_sessions;
+	static Gauge hibernated_sessions;
+	static Gauge connected_clients;
+	// the mean jitter is client_jitter / measured_clients
+	static Gauge measured_clients;
+	static Gauge client_jitter;
+
+	static Counter frames_in;
+	static Counter frames_out;
+	static Counter bytes_in;
+	static Counter bytes_out;
+
+	static Histogram move_handling;
+	static Histogram broadcast_fanout;
+	static Histogram switch_player;
+	static Histogram client_rtt;
+
+	static Counter wal_commits;
+	static Counter wal_bytes;
+	static Histogram wal_commit;
+	static Histogram session_restore;
+};
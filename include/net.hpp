@@ -0,0 +1,534 @@
+#pragma once
+
+#include "message.hpp"
+#include "metrics.hpp"
+#include "sse.hpp"
+#include "websocket.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// immutable payload that is serialized once and queued to any number of connections,
+// the storage is released when the last connection has written it
+class SharedBuffer {
+public:
+	inline SharedBuffer() {}
+	inline SharedBuffer(std::shared_ptr<const uint8_t> storage, size_t size) : storage(std::move(storage)), length(size) {}
+
+	static inline SharedBuffer copy(std::span<const uint8_t> data) {
+		std::shared_ptr<uint8_t> storage(new uint8_t[data.size()], std::default_delete<uint8_t[]>());
+		memcpy(storage.get(), data.data(), data.size());
+		return SharedBuffer(storage, data.size());
+	}
+
+	inline const uint8_t *data() const {
+		return storage.get();
+	}
+
+	inline size_t size() const {
+		return length;
+	}
+
+	inline std::span<const uint8_t> span() const {
+		return std::span<const uint8_t>(storage.get(), length);
+	}
+
+	inline explicit operator bool() const {
+		return storage != nullptr;
+	}
+
+private:
+	std::shared_ptr<const uint8_t> storage;
+	size_t length = 0;
+};
+
+template <typename T>
+static inline std::span<const uint8_t> asBytes(const T &value) {
+	return std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(&value), sizeof(T));
+}
+
+// monotonic timestamp used for pings
+static inline uint64_t getMonotonicMicros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// smoothed round trip time and its variation as in RFC 6298, jitter as in RFC 3550, all in microseconds;
+// written by a single thread, readable from anywhere
+struct RttStats {
+	std::atomic<uint32_t> last = 0;
+	std::atomic<uint32_t> srtt = 0;
+	std::atomic<uint32_t> rttvar = 0;
+	std::atomic<uint32_t> jitter = 0;
+	std::atomic<uint32_t> samples = 0;
+
+	inline void update(uint32_t sample) {
+		if (samples == 0) {
+			srtt = sample;
+			rttvar = sample / 2;
+		} else {
+			const uint32_t deviation = sample > srtt ? sample - srtt : srtt - sample;
+			rttvar = (3 * uint64_t(rttvar) + deviation) / 4;
+			srtt = (7 * uint64_t(srtt) + sample) / 8;
+
+			const uint32_t difference = sample > last ? sample - last : last - sample;
+			jitter = jitter + (int64_t(difference) - int64_t(jitter)) / 16;
+		}
+
+		last = sample;
+		samples++;
+	}
+
+	inline void reset() {
+		last = srtt = rttvar = jitter = samples = 0;
+	}
+};
+
+// caps for the outbound queue of a connection, the policy decides what happens when a peer
+// doesn't read fast enough and its queue reaches the high-water mark
+struct OutboundLimits {
+	enum Policy {
+		// merge the queued buffers into one, evict when the byte cap is reached
+		Coalesce,
+		// drop new frames until the queue drained, the owner has to resync the peer afterwards
+		DropFrames,
+		// evict right away
+		Disconnect,
+	};
+
+	size_t high_water_bytes = 256 * 1024;
+	size_t max_bytes = 1024 * 1024;
+	size_t max_messages = 4096;
+	Policy policy = Disconnect;
+};
+
+struct OutboundStats {
+	std::atomic<uint64_t> coalesced = 0;
+	std::atomic<uint64_t> dropped_frames = 0;
+	std::atomic<uint64_t> evicted = 0;
+};
+
+class NetBackend;
+
+// a peer connected to a NetBackend, shared between the backend and the seat it was assigned to
+class Connection {
+public:
+	// how often the overflow policies fired, over all connections
+	static inline OutboundStats outbound_stats;
+
+	// raw connections carry the fixed size messages as they are, websocket connections wrap them in binary frames,
+	// event streams turn them into server-sent events for watchers
+	enum Protocol {
+		Raw,
+		WebSocket,
+		EventStream,
+	};
+
+	virtual ~Connection() {
+		if (rtt.samples > 0) {
+			Metrics::measured_clients.sub();
+			Metrics::client_jitter.sub(rtt.jitter);
+		}
+	}
+
+	// set by the backend before the first receive
+	inline void setProtocol(Protocol protocol) {
+		if (protocol == WebSocket) {
+			websocket = std::make_unique<WebSocketCodec>(WebSocketCodec::Server);
+		} else if (protocol == EventStream) {
+			event_stream = std::make_unique<EventStreamCodec>();
+		}
+	}
+
+	// watchers of an event stream never send anything after their request, not even pongs
+	inline bool isEventStream() const {
+		return event_stream != nullptr;
+	}
+
+	virtual std::string getAddress() const = 0;
+
+	// backend whose reactor submits the writes of this connection, nullptr for connections that write from flush()
+	virtual NetBackend *getBackend() const {
+		return nullptr;
+	}
+
+	// writes as much of the outbound queue as possible
+	virtual void flush() = 0;
+
+	// close the connection once all queued data is written, on_disconnect fires on the backend thread
+	virtual void close() = 0;
+
+	// close the connection right away and discard what is still queued, must be called without holding backend locks
+	virtual void abort() = 0;
+
+	inline bool isClosed() const {
+		return closed;
+	}
+
+	inline void setOutboundLimits(const OutboundLimits &limits) {
+		std::scoped_lock<std::mutex> lock{outbound_mutex};
+		outbound_limits = limits;
+	}
+
+	// true once if frames were dropped since the last call
+	inline bool takeDroppedFrames() {
+		return dropped_frames.exchange(false);
+	}
+
+	// appends to the outbound queue without flushing, returns false if the connection is closed or got evicted;
+	// a frame dropped by the DropFrames policy counts as queued
+	inline bool queue(const SharedBuffer &buffer) {
+		if (closed) {
+			return false;
+		}
+
+		{
+			std::scoped_lock<std::mutex> lock{outbound_mutex};
+			const OutboundLimits &limits = outbound_limits;
+
+			bool over_messages = outbound.size() >= limits.max_messages;
+			const bool over_bytes = outbound_bytes + buffer.size() > limits.high_water_bytes;
+
+			// once a frame is lost the following ones are useless until the owner resynced the peer
+			const bool dropping = limits.policy == OutboundLimits::DropFrames && dropped_frames;
+
+			if (!over_messages && !over_bytes && !dropping) {
+				pushOutbound(buffer);
+				return true;
+			}
+
+			switch (limits.policy) {
+				case OutboundLimits::Coalesce: {
+					if (over_messages) {
+						coalesceOutbound();
+						outbound_stats.coalesced++;
+						over_messages = outbound.size() >= limits.max_messages;
+					}
+
+					if (!over_messages && outbound_bytes + buffer.size() <= limits.max_bytes) {
+						pushOutbound(buffer);
+						return true;
+					}
+				} break;
+				case OutboundLimits::DropFrames: {
+					dropped_frames = true;
+					outbound_stats.dropped_frames++;
+					return true;
+				}
+				case OutboundLimits::Disconnect: break;
+			}
+		}
+
+		outbound_stats.evicted++;
+		abort();
+		return false;
+	}
+
+	inline bool send(const SharedBuffer &buffer) {
+		if (!queue(buffer)) {
+			return false;
+		}
+
+		flush();
+		return !closed;
+	}
+
+	inline bool send(std::span<const uint8_t> data) {
+		return send(SharedBuffer::copy(data));
+	}
+
+	template <typename T>
+	inline bool sendObject(const T &value) {
+		return send(asBytes(value));
+	}
+
+	// bytes queued but not yet written, bounded by the outbound limits
+	inline size_t getOutboundBytes() {
+		std::scoped_lock<std::mutex> lock{outbound_mutex};
+		return outbound_bytes;
+	}
+
+	// routing information, set by whoever handles the join request of this connection
+	std::atomic<uint64_t> session = ~0ull;
+	std::atomic<uint32_t> player = ~0u;
+
+	// round trip times measured with pings, last_receive_us tells how long the peer was silent
+	RttStats rtt;
+	std::atomic<uint64_t> last_receive_us = getMonotonicMicros();
+
+	// answers pings and measures the round trip of pongs, returns false for every other message
+	inline bool handleHeartbeat(const Message &msg) {
+		if (msg.type == Message::Ping) {
+			sendObject(Message::makePong(msg.ping.timestamp_us));
+			return true;
+		} else if (msg.type == Message::Pong) {
+			const uint64_t now = getMonotonicMicros();
+			if (msg.ping.timestamp_us <= now) {
+				const uint32_t sample = std::min<uint64_t>(now - msg.ping.timestamp_us, UINT32_MAX);
+				const uint32_t jitter = rtt.jitter;
+				if (rtt.samples == 0) {
+					Metrics::measured_clients.add();
+				}
+				rtt.update(sample);
+
+				Metrics::client_rtt.record(uint64_t(sample) * 1000);
+				Metrics::client_jitter.add(int64_t(rtt.jitter) - jitter);
+			}
+			return true;
+		}
+
+		return false;
+	}
+
+	// reassembles fixed size messages from a byte stream, used by the backends
+	template <typename F>
+	inline void receive(std::span<const uint8_t> data, F callback) {
+		last_receive_us = getMonotonicMicros();
+		Metrics::bytes_in.add(data.size());
+
+		std::vector<uint8_t> payload;
+		if (event_stream) {
+			std::optional<Message> request;
+			const EventStreamCodec::State state = event_stream->receive(data, request, payload);
+			if (!payload.empty()) {
+				sendUnframed(payload);
+			}
+
+			if (state == EventStreamCodec::Failed) {
+				close();
+			} else if (request) {
+				callback(request.value());
+			}
+			return;
+		} else if (websocket) {
+			std::vector<uint8_t> reply;
+			const WebSocketCodec::State state = websocket->receive(data, payload, reply);
+			if (!reply.empty()) {
+				sendUnframed(reply);
+			}
+
+			if (state == WebSocketCodec::Failed) {
+				abort();
+				return;
+			} else if (state == WebSocketCodec::Closing) {
+				close();
+			}
+
+			data = payload;
+		}
+
+		while (!data.empty()) {
+			const size_t chunk = std::min(data.size(), sizeof(Message) - inbound_size);
+			memcpy(reinterpret_cast<uint8_t*>(&inbound) + inbound_size, data.data(), chunk);
+			inbound_size += chunk;
+			data = data.subspan(chunk);
+
+			if (inbound_size == sizeof(Message)) {
+				inbound_size = 0;
+				callback(inbound);
+			}
+		}
+	}
+
+protected:
+	std::atomic<bool> closed = false;
+	std::atomic<bool> dropped_frames = false;
+
+	// outbound queue, the backends write it out with vectored writes
+	std::mutex outbound_mutex;
+	std::deque<SharedBuffer> outbound;
+	size_t outbound_offset = 0;
+	size_t outbound_bytes = 0;
+	OutboundLimits outbound_limits;
+
+	// number of buffers at the front of the queue a write is in flight for, they must not be touched
+	size_t outbound_in_flight = 0;
+
+	// caller holds outbound_mutex
+	inline void pushOutbound(const SharedBuffer &source) {
+		const SharedBuffer buffer = event_stream ? getEventStreamFrame(source) : source;
+		if (!buffer) {
+			return;
+		}
+
+		size_t size = buffer.size();
+		if (websocket) {
+			const SharedBuffer header = getWebSocketHeader(buffer.size());
+			outbound.push_back(header);
+			size += header.size();
+		}
+
+		outbound.push_back(buffer);
+		outbound_bytes += size;
+
+		Metrics::frames_out.add();
+		Metrics::bytes_out.add(size);
+	}
+
+	// a broadcast queues the same payload to many connections, they share the frame header as well
+	static inline SharedBuffer getWebSocketHeader(size_t length) {
+		thread_local size_t cached_length = SIZE_MAX;
+		thread_local SharedBuffer cached;
+		if (length != cached_length) {
+			uint8_t header[WebSocketCodec::MAX_HEADER_SIZE];
+			cached = SharedBuffer::copy(std::span<const uint8_t>(header, WebSocketCodec::encodeHeader(header, length)));
+			cached_length = length;
+		}
+		return cached;
+	}
+
+	// the events of a broadcast buffer, rendered by the first watcher it is queued to and shared with the others;
+	// the source is kept so its address isn't reused while it is cached
+	static inline SharedBuffer getEventStreamFrame(const SharedBuffer &source) {
+		thread_local SharedBuffer cached_source;
+		thread_local SharedBuffer cached;
+		if (source.data() != cached_source.data() || source.size() != cached_source.size()) {
+			std::string events;
+			EventStreamCodec::render(source.span(), events);
+			cached = events.empty() ? SharedBuffer() : SharedBuffer::copy(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(events.data()), events.size()));
+			cached_source = source;
+		}
+		return cached;
+	}
+
+	// handshake responses and control frames, they bypass the framing and the high-water mark but not the caps;
+	// a peer that keeps sending pings without reading the pongs is evicted like any other one that doesn't read
+	inline void sendUnframed(std::span<const uint8_t> data) {
+		bool queued = false;
+		{
+			std::scoped_lock<std::mutex> lock{outbound_mutex};
+			const OutboundLimits &limits = outbound_limits;
+			if (outbound.size() < limits.max_messages && outbound_bytes + data.size() <= limits.max_bytes) {
+				outbound.push_back(SharedBuffer::copy(data));
+				outbound_bytes += data.size();
+				queued = true;
+			}
+		}
+
+		if (!queued) {
+			outbound_stats.evicted++;
+			abort();
+			return;
+		}
+
+		flush();
+	}
+
+	// merges the queued buffers into one, except for the partially written front and the ones
+	// a write is in flight for; caller holds outbound_mutex
+	inline void coalesceOutbound() {
+		const size_t first = std::max<size_t>(outbound_in_flight, 1);
+		if (outbound.size() <= first + 1) {
+			return;
+		}
+
+		size_t size = 0;
+		for (size_t i = first; i < outbound.size(); i++) {
+			size += outbound[i].size();
+		}
+
+		std::shared_ptr<uint8_t> storage(new uint8_t[size], std::default_delete<uint8_t[]>());
+		size_t offset = 0;
+		for (size_t i = first; i < outbound.size(); i++) {
+			memcpy(storage.get() + offset, outbound[i].data(), outbound[i].size());
+			offset += outbound[i].size();
+		}
+
+		outbound.erase(outbound.begin() + first, outbound.end());
+		outbound.push_back(SharedBuffer(storage, size));
+	}
+
+	// collects the unwritten parts of the queued buffers, caller holds outbound_mutex
+	inline size_t gatherOutbound(std::span<std::span<const uint8_t>> chunks) const {
+		size_t count = 0;
+		for (size_t i = 0; i < outbound.size() && count < chunks.size(); i++) {
+			chunks[count++] = outbound[i].span().subspan(i == 0 ? outbound_offset : 0);
+		}
+		return count;
+	}
+
+	// drops written bytes from the front of the queue, caller holds outbound_mutex
+	inline void consumeOutbound(size_t bytes) {
+		outbound_bytes -= bytes;
+		while (bytes > 0 && !outbound.empty()) {
+			const size_t remaining = outbound.front().size() - outbound_offset;
+			if (bytes < remaining) {
+				outbound_offset += bytes;
+				return;
+			}
+
+			bytes -= remaining;
+			outbound_offset = 0;
+			outbound.pop_front();
+		}
+	}
+
+	// caller holds outbound_mutex
+	inline void clearOutbound() {
+		outbound.clear();
+		outbound_offset = 0;
+		outbound_bytes = 0;
+		outbound_in_flight = 0;
+	}
+
+private:
+	Message inbound;
+	size_t inbound_size = 0;
+
+	std::unique_ptr<WebSocketCodec> websocket;
+	std::unique_ptr<EventStreamCodec> event_stream;
+};
+
+class NetBackend {
+public:
+	enum Kind {
+		SDLNet,
+		IoUring,
+	};
+
+	struct Callbacks {
+		std::function<void(const std::shared_ptr<Connection>&)> on_connect;
+		std::function<void(const std::shared_ptr<Connection>&, const Message&)> on_message;
+		std::function<void(const std::shared_ptr<Connection>&)> on_disconnect;
+	} callbacks;
+
+	static std::unique_ptr<NetBackend> create(Kind kind);
+	static std::optional<Kind> parseKind(std::string_view name);
+	static std::string_view getKindName(Kind kind);
+
+	virtual ~NetBackend() = default;
+
+	virtual Kind getKind() const = 0;
+
+	// can be called once per protocol, all listeners share the reactor
+	virtual bool listen(uint16_t port, Connection::Protocol protocol = Connection::Raw) = 0;
+
+	// dispatch pending events to the callbacks, waits at most timeout ms for something to happen
+	virtual void poll(int timeout) = 0;
+
+	// wakes up a blocking poll
+	virtual void wakeup() {}
+
+	// allocates a buffer for data that is going to be sent, backends can place it in memory they registered with the kernel
+	virtual SharedBuffer encode(std::span<const uint8_t> data);
+
+	// queues the same buffer to all targets and flushes them, backends can submit all writes at once
+	virtual void broadcast(std::span<const std::shared_ptr<Connection>> targets, const SharedBuffer &buffer);
+
+	void run();
+	void stop();
+
+protected:
+	std::atomic<bool> stopped = false;
+};
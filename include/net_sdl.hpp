@@ -0,0 +1,50 @@
+#pragma once
+
+#include "net.hpp"
+
+#include "SDL3_net/SDL_net.h"
+
+#include <mutex>
+
+class SDLNetConnection : public Connection {
+public:
+	explicit SDLNetConnection(SDLNet_StreamSocket *socket);
+	~SDLNetConnection();
+
+	std::string getAddress() const override;
+	void flush() override;
+	void close() override;
+	void abort() override;
+
+private:
+	friend class SDLNetBackend;
+
+	// data SDL_net may hold on to before the outbound queue stops draining into it
+	static constexpr int MAX_PENDING_WRITES = 64 * 1024;
+
+	mutable std::mutex mutex;
+	SDLNet_StreamSocket *socket;
+	bool aborted = false;
+
+	// SDL_net has no vectored writes, queued buffers are coalesced into a single write
+	std::vector<uint8_t> scratch;
+};
+
+// polls all sockets with SDLNet_WaitUntilInputAvailable, works everywhere SDL_net does
+class SDLNetBackend : public NetBackend {
+public:
+	~SDLNetBackend();
+
+	inline Kind getKind() const override {
+		return SDLNet;
+	}
+
+	bool listen(uint16_t port, Connection::Protocol protocol = Connection::Raw) override;
+	void poll(int timeout) override;
+
+private:
+	std::vector<std::pair<SDLNet_Server*, Connection::Protocol>> servers;
+
+	// only accessed by the thread calling poll
+	std::vector<std::shared_ptr<SDLNetConnection>> connections;
+};
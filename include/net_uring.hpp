@@ -0,0 +1,153 @@
+#pragma once
+
+#include "net.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <mutex>
+#include <unordered_map>
+
+class IoUringBackend;
+
+class IoUringConnection : public Connection {
+public:
+	IoUringConnection(IoUringBackend *backend, uint32_t id, int fd, const std::string &address);
+
+	std::string getAddress() const override;
+	NetBackend *getBackend() const override;
+	void flush() override;
+	void close() override;
+	void abort() override;
+
+private:
+	friend class IoUringBackend;
+
+	static constexpr size_t MAX_IOVECS = 64;
+
+	IoUringBackend *backend;
+	const uint32_t id;
+	const int fd;
+	const std::string address;
+
+	// everything below is guarded by IoUringBackend::mutex
+	bool write_in_flight = false;
+	bool receiving = false;
+	bool shutdown_requested = false;
+
+	// must stay valid until the write completes
+	iovec iovecs[MAX_IOVECS];
+	msghdr header;
+};
+
+// linux io_uring reactor: multishot accept & recv into provided buffers, outbound queues are
+// flushed with vectored sends, small buffers live in a registered arena and go out as fixed writes
+
+class IoUringBackend : public NetBackend {
+public:
+	IoUringBackend();
+	~IoUringBackend();
+
+	inline Kind getKind() const override {
+		return IoUring;
+	}
+
+	bool listen(uint16_t port, Connection::Protocol protocol = Connection::Raw) override;
+	void poll(int timeout) override;
+	void wakeup() override;
+
+	SharedBuffer encode(std::span<const uint8_t> data) override;
+	void broadcast(std::span<const std::shared_ptr<Connection>> targets, const SharedBuffer &buffer) override;
+
+private:
+	friend class IoUringConnection;
+
+	static constexpr uint32_t QUEUE_DEPTH = 4096;
+	static constexpr uint32_t RECV_BUFFER_SIZE = 2048;
+	static constexpr uint32_t RECV_BUFFER_COUNT = 1024;
+	static constexpr uint32_t SEND_SLOT_SIZE = 2048;
+	static constexpr uint32_t SEND_SLOT_COUNT = 4096;
+
+	// fixed size slots registered with the ring, shared with the buffers
+	// allocated from it so it outlives the backend if they do
+	struct SendArena {
+		uint8_t *memory = nullptr;
+		std::mutex mutex;
+		std::vector<uint32_t> free_slots;
+
+		~SendArena();
+	};
+
+	enum Op : uint8_t {
+		Accept = 1,
+		Receive,
+		Write,
+		Provide,
+		Wakeup,
+	};
+
+	// an accept, receive, write or buffer that found the submission queue full, for the listener,
+	// connection or buffer id; retried at the end of the next poll
+	struct Deferred {
+		Op op;
+		uint32_t id;
+		uint32_t count;
+	};
+
+	bool setupRing();
+	void destroyRing();
+
+	io_uring_sqe *getSqe();
+	void submit();
+
+	void provideBuffers(uint16_t bid, uint32_t count);
+	void armAccept(uint32_t listener);
+	void armReceive(IoUringConnection *connection);
+	void submitWrite(IoUringConnection *connection);
+	void defer(Op op, uint32_t id, uint32_t count = 0);
+	void retryDeferred();
+
+	void requestShutdown(IoUringConnection *connection);
+	bool finalize(IoUringConnection *connection);
+
+	void handleAccept(const io_uring_cqe &cqe);
+	void handleReceive(const io_uring_cqe &cqe);
+	void handleWrite(const io_uring_cqe &cqe);
+
+	int ring_fd = -1;
+
+	// accepts complete with the index of their listener
+	struct Listener {
+		int fd;
+		Connection::Protocol protocol;
+	};
+
+	std::vector<Listener> listeners;
+
+	// submission queue, guarded by mutex
+	uint8_t *sq_ptr = nullptr;
+	size_t sq_ring_size = 0;
+	uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+	io_uring_sqe *sqes = nullptr;
+	size_t sqes_size = 0;
+	uint32_t sq_pending = 0;
+
+	// completion queue, only touched by the thread calling poll
+	uint8_t *cq_ptr = nullptr;
+	size_t cq_ring_size = 0;
+	uint32_t *cq_head, *cq_tail, *cq_mask;
+	io_uring_cqe *cqes;
+
+	// provided buffers for multishot receive
+	uint8_t *recv_buffers = nullptr;
+
+	// registered send arena
+	std::shared_ptr<SendArena> send_arena;
+	bool fixed_buffers = false;
+
+	std::mutex mutex;
+	uint32_t next_connection_id = 0;
+	std::unordered_map<uint32_t, std::shared_ptr<IoUringConnection>> connections;
+	std::vector<Deferred> deferred;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "chess.hpp"
+#include "eventlog.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// a record starts with the header and the names of the players, followed by the packed events and the
+// snapshots of the position after every snapshot_interval plies
+struct RecordHeader {
+	static constexpr char MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'R', 'E', 'C'};
+	static constexpr uint32_t VERSION = 1;
+
+	char magic[8];
+	uint32_t version;
+	uint32_t num_players;
+	uint32_t snapshot_interval;
+	uint32_t num_snapshots;
+	uint64_t num_events;
+};
+
+struct RecordName {
+	char name[24];
+};
+
+// followed by the 32 tiles of every player, without the marks of the ui
+struct RecordSnapshot {
+	uint64_t ply;
+	uint32_t current_player;
+
+	// bit per player that is out
+	uint32_t checkmates;
+	uint16_t king_positions[MAX_PLAYERS];
+};
+
+// applies an event of a session's log to the field the same way the host did, events with tiles or
+// players the field doesn't have are ignored; a player that surrendered or ran out of time is out
+void applyEvent(Field &field, const GameEvent &event);
+
+// a finished or running game, as saved by the window and the server
+class GameRecord {
+public:
+	static constexpr uint32_t DEFAULT_SNAPSHOT_INTERVAL = 32;
+
+	// replays the events once to take the snapshots
+	void create(uint32_t num_players, const std::vector<std::string> &names, const EventLog &events, uint32_t snapshot_interval = DEFAULT_SNAPSHOT_INTERVAL);
+
+	std::vector<uint8_t> encode() const;
+	bool decode(std::span<const uint8_t> data);
+
+	bool load(const std::string &path);
+	bool save(const std::string &path) const;
+
+	// one line per event, for people
+	std::string toText() const;
+
+	// prints the text of the record given after --export-record
+	static int exportText(const std::vector<std::string> &args);
+
+	// puts the field into the position after the given number of plies, starting from the closest snapshot before it
+	void seek(Field &field, uint64_t ply) const;
+
+	// ply of the snapshot seek() would start from
+	uint64_t getSnapshotPly(uint64_t ply) const;
+
+	inline uint32_t getPlayerCount() const {
+		return num_players;
+	}
+
+	inline const std::vector<std::string> &getNames() const {
+		return names;
+	}
+
+	inline const EventLog &getEvents() const {
+		return events;
+	}
+
+private:
+	void takeSnapshot(const Field &field, uint64_t ply);
+	void restoreSnapshot(Field &field, size_t index) const;
+
+	uint32_t num_players = 0;
+	uint32_t snapshot_interval = DEFAULT_SNAPSHOT_INTERVAL;
+	std::vector<std::string> names;
+	EventLog events;
+
+	std::vector<RecordSnapshot> snapshots;
+	// 32 * num_players per snapshot
+	std::vector<Tile> snapshot_tiles;
+};
+
+// a position in a recorded game that can be moved to any ply; moving forward a little replays from where it
+// is, everything else starts from the closest snapshot, so no seek replays more than a snapshot interval
+class GameReplay {
+public:
+	explicit GameReplay(std::shared_ptr<const GameRecord> record);
+
+	void seek(uint64_t ply);
+
+	inline uint64_t getPly() const {
+		return ply;
+	}
+
+	inline uint64_t getLength() const {
+		return record->getEvents().size();
+	}
+
+	inline const Field &getField() const {
+		return field;
+	}
+
+	inline const GameRecord &getRecord() const {
+		return *record;
+	}
+
+private:
+	std::shared_ptr<const GameRecord> record;
+	Field field;
+	uint64_t ply = 0;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "epoch.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+
+class Session;
+
+// sessions by their random 64 bit id; lookups and listings only pin an epoch and never take a lock,
+// writers copy the table of one of the shards and retire the old one
+class SessionRegistry {
+public:
+	SessionRegistry() = default;
+	~SessionRegistry();
+
+	SessionRegistry(const SessionRegistry&) = delete;
+	SessionRegistry &operator=(const SessionRegistry&) = delete;
+
+	// assigns the session its id and returns it, never 0 or ~0ull; a requested id (used when replaying
+	// a capture) is kept as it is, 0 is returned if it is taken
+	uint64_t insert(const std::shared_ptr<Session> &session, uint64_t requested = 0);
+	bool erase(uint64_t id);
+	void clear();
+
+	std::shared_ptr<Session> find(uint64_t id) const;
+
+	size_t size() const;
+
+	// visits every session, entries inserted or erased during the walk may or may not be seen
+	template <typename F>
+	inline void forEach(F callback) const {
+		for (const Shard &shard : shards) {
+			EpochDomain::Guard guard;
+			const Table *table = shard.table.load(std::memory_order_acquire);
+			if (!table) {
+				continue;
+			}
+
+			for (uint32_t i = 0; i <= table->mask; i++) {
+				if (table->entries[i].id != 0) {
+					callback(table->entries[i].id, table->entries[i].session);
+				}
+			}
+		}
+	}
+
+private:
+	static constexpr uint32_t SHARD_BITS = 6;
+	static constexpr uint32_t SHARDS = 1 << SHARD_BITS;
+
+	struct Entry {
+		uint64_t id = 0;
+		std::shared_ptr<Session> session;
+	};
+
+	// open addressing with linear probing, at most half full; immutable once published
+	struct Table {
+		uint32_t mask = 0;
+		uint32_t count = 0;
+		std::unique_ptr<Entry[]> entries;
+	};
+
+	struct alignas(64) Shard {
+		std::mutex mutex;
+		std::atomic<Table*> table = nullptr;
+	};
+
+	// ids are random, the low bits pick the shard and the high bits the slot
+	static inline uint32_t getShard(uint64_t id) {
+		return id & (SHARDS - 1);
+	}
+
+	static inline uint32_t getSlot(uint64_t id, uint32_t mask) {
+		return (id >> SHARD_BITS) & mask;
+	}
+
+	static Table *makeTable(uint32_t capacity);
+	static void insertEntry(Table &table, Entry entry);
+
+	// caller holds the shard's mutex
+	void publish(Shard &shard, Table *table);
+
+	Shard shards[SHARDS];
+
+	std::mutex random_mutex;
+	std::mt19937_64 random{std::random_device()()};
+};
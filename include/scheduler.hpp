@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// runs tasks on a fixed set of worker threads, each worker has its own deque
+// and steals from the others when it runs out of work
+class Scheduler {
+public:
+	using Task = std::function<void()>;
+
+	// num_workers = 0 -> one worker per hardware thread
+	explicit Scheduler(uint32_t num_workers = 0, bool pin_threads = false);
+	~Scheduler();
+
+	// tasks posted from a worker go to its own deque, everything else is distributed round robin
+	void post(Task task);
+	void shutdown();
+
+	inline uint32_t getWorkerCount() const {
+		return workers.size();
+	}
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+
+	void runWorker(uint32_t index, bool pin_thread);
+	bool popTask(uint32_t index, Task &task);
+	bool stealTask(uint32_t thief, Task &task);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<uint32_t> next_worker = 0;
+
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_condition;
+	std::atomic<uint64_t> pending = 0;
+	std::atomic<bool> stopped = false;
+};
@@ -1,15 +1,28 @@
 #pragma once
 
+#include "capture.hpp"
+#include "explorer.hpp"
+#include "net.hpp"
+#include "record.hpp"
+#include "registry.hpp"
+#include "scheduler.hpp"
 #include "session.hpp"
-
-#include "SDL3_net/SDL_net.h"
+#include "timer.hpp"
+#include "wal.hpp"
 
 #include "httplib.h"
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 class Server {
 public:
 	Server(const std::vector<std::string> &args);
+	~Server();
 
 	static inline int run(const std::vector<std::string> &args) {
 		return Server(args).run();
@@ -17,20 +30,156 @@ public:
 
 	int run();
 	void runLobby();
-	void handleNewClient(SDLNet_StreamSocket *socket);
+	void handleNewClient(const std::shared_ptr<Connection> &connection, const Message &msg);
+	void scheduleHeartbeat(const std::weak_ptr<Connection> &connection);
+	void scheduleTraceDump();
+
+	// returns the id clients join the session with; a replay or recovery asks for the recorded id, 0 is returned if it is taken
+	uint64_t createSession(uint32_t num_players, uint64_t id = 0, const RecoveredSession *recovered = nullptr);
+	bool destroySession(uint64_t id);
+
+	// recreates the unfinished sessions of the write-ahead log and starts a fresh log with them
+	bool recoverSessions(const std::string &path);
+
+	// idle sessions are written to a snapshot in the hibernation directory and dropped from memory,
+	// the next message, join or request for one of them restores it
+	void loadHibernated();
+	void scheduleHibernation();
+	void hibernateIdleSessions();
+	bool hibernateSession(uint64_t id);
+	std::shared_ptr<Session> restoreSession(uint64_t id);
+
+	// looks up a session and restores it if it is hibernated
+	std::shared_ptr<Session> findSession(uint64_t id);
 
-	void createSession(uint32_t num_players);
+	// feeds a capture into the sessions instead of listening, returns non-zero if a session ended up different
+	int replay();
+
+	// http control plane: create, list, inspect and close sessions
+	void registerRoutes();
+	std::string getSessionListing();
 
 	// main thread -> httplib -> api point to create a new session
-	// secondary thread to accept clients -> after authentification move client to session
-	// 1 thread per session
+	// secondary thread runs the network backend -> after authentification move client to session
+	// sessions are processed as tasks on the scheduler's worker threads
+	// one thread drives the timer wheel for clocks, handshake timeouts and heartbeats of all sessions
 
 private:
-	bool quit;
+	static constexpr uint64_t HANDSHAKE_TIMEOUT_MS = 5000;
+
+	// how often a dump requested with SIGUSR1 is checked for
+	static constexpr uint64_t TRACE_DUMP_POLL_MS = 250;
+
+	// a replayed session that makes no progress for this long is compared as it is
+	static constexpr uint64_t REPLAY_SETTLE_TIMEOUT_MS = 5000;
+
+	// how often sessions are checked for being idle
+	static constexpr uint64_t HIBERNATE_CHECK_MS = 1000;
+
+	// how often the capture is flushed and checked for sessions whose game ended
+	static constexpr uint64_t CAPTURE_FLUSH_MS = 1000;
+
+	// set by SIGINT and SIGTERM, the timer thread stops the http server so the destructor runs
+	static inline std::atomic<bool> stop_requested = false;
+
+	// calls back with the session while it can't be hibernated, false if there is no such session
+	template <typename F>
+	inline bool withSession(uint64_t id, F callback) {
+		if (hibernate_dir.empty()) {
+			if (std::shared_ptr<Session> session = sessions.find(id)) {
+				callback(session);
+				return true;
+			}
+			return false;
+		}
+
+		{
+			std::shared_lock<std::shared_mutex> lock{hibernation_mutex};
+			if (std::shared_ptr<Session> session = sessions.find(id)) {
+				callback(session);
+				return true;
+			} else if (!hibernated.contains(id)) {
+				return false;
+			}
+		}
+
+		restoreSession(id);
+
+		std::shared_lock<std::shared_mutex> lock{hibernation_mutex};
+		if (std::shared_ptr<Session> session = sessions.find(id)) {
+			callback(session);
+			return true;
+		}
+		return false;
+	}
+
+	inline std::string getSnapshotPath(uint64_t id) const {
+		return std::format("{}/{:016x}.session", hibernate_dir, id);
+	}
+
+	inline std::string getRecordPath(uint64_t id) const {
+		return std::format("{}/{:016x}.rec", records_dir, id);
+	}
+
+	// writes the game of a destroyed session to the records directory, games without a move are skipped
+	void saveRecord(uint64_t id, const GameRecord &record);
+
+	void scheduleCaptureFlush();
+	void writeDigest(uint64_t id, Session &session);
+	bool checkDigest(uint64_t id, const CaptureDigest &digest);
+
+	bool quit = false;
 	httplib::Server http_server;
+
+	// sessions whose game ended and got their digest, only touched by the timer thread
+	std::unordered_set<uint64_t> finished_digests;
 	std::thread lobby_thread;
 
-	std::vector<std::shared_ptr<Session>> sessions;
+	std::unique_ptr<NetBackend> network;
+	std::unique_ptr<Scheduler> scheduler;
+
+	std::unique_ptr<TimerWheel> timers;
+	std::thread timer_thread;
+	uint64_t clock_base_ms = 0;
+	uint64_t clock_increment_ms = 0;
+	uint64_t heartbeat_interval_ms = 5000;
+	uint64_t dead_timeout_ms = 15000;
+	// 0 when server-sent events are disabled or the port couldn't be opened
+	uint16_t event_stream_port = 8082;
+
+	// sessions append to it while they run, so it is destroyed after them
+	std::unique_ptr<WriteAheadLog> wal;
+
+	SessionRegistry sessions;
+
+	struct HibernatedSession {
+		// seated connections stay open, they are given back to the restored session
+		std::vector<std::weak_ptr<Connection>> connections;
+
+		// kept until the snapshot is on disk
+		std::shared_ptr<const RecoveredSession> state;
+	};
+
+	// messages and joins are routed to a session under a shared lock, moving a session between
+	// the registry and the hibernated ones takes it exclusively
+	std::string hibernate_dir;
+	uint64_t idle_timeout_ms = 10 * 60 * 1000;
+	std::shared_mutex hibernation_mutex;
+	std::unordered_map<uint64_t, HibernatedSession> hibernated;
+
+	// games of destroyed sessions are kept here when --records is given
+	std::string records_dir;
+
+	// move statistics served under /explorer when --explorer is given
+	std::unique_ptr<OpeningExplorer> explorer;
+
+	// every inbound message is recorded when --capture is given
+	std::unique_ptr<CaptureWriter> capture;
+	std::string replay_path;
+	bool replay_fast = false;
 
-	SDLNet_Server *server;
+	// the listing is rebuilt only when the status of a session changed since it was serialized
+	std::mutex listing_mutex;
+	std::string listing;
+	uint64_t listing_changes = ~0ull;
 };
@@ -1,33 +1,92 @@
 #pragma once
 
 #include "chess.hpp"
+#include "eventlog.hpp"
 #include "message.hpp"
+#include "net.hpp"
+#include "record.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
 
 #include "SDL3_net/SDL_net.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <thread>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
+class WriteAheadLog;
+struct RecoveredSession;
+
 struct Player {
 	std::string name;
-	SDLNet_StreamSocket *socket = nullptr;
+	std::shared_ptr<Connection> connection;
 	bool is_host = false;
 
 	inline Player() {}
 	inline explicit Player(const std::string &name) : name(name) {}
 	inline Player(const std::string &name, bool is_host) : name(name), is_host(is_host) {}
+	inline Player(const std::string &name, const std::shared_ptr<Connection> &connection) : name(name), connection(connection) {}
 
 	inline std::string getAddress() const {
-		if (socket) {
-			return SDLNet_GetAddressString(SDLNet_GetStreamSocketAddress(socket));
+		if (connection) {
+			return connection->getAddress();
 		} else {
 			return "<null>";
 		}
 	}
 };
 
-class Session {
+// what the server reports about a session over http
+struct SessionStatus {
+	struct Seat {
+		std::string name;
+		bool connected = false;
+		bool out = false;
+		uint64_t clock_ms = 0;
+		// for its round trip time, which changes without the status being published again
+		std::shared_ptr<Connection> connection;
+
+		bool operator==(const Seat&) const = default;
+	};
+
+	uint32_t num_players = 0;
+	uint32_t current_player = 0;
+	uint64_t seq = 0;
+	size_t spectators = 0;
+	bool clocks_running = false;
+	// timer wheel time the clock of the current player was started at
+	uint64_t clock_started = 0;
+	std::vector<Seat> seats;
+
+	bool operator==(const SessionStatus&) const = default;
+
+	inline uint32_t getSeatedCount() const {
+		return std::count_if(seats.begin(), seats.end(), [](const Seat &seat) { return seat.connected; });
+	}
+
+	// at most one seat is still in
+	inline bool isGameOver() const {
+		return !seats.empty() && std::count_if(seats.begin(), seats.end(), [](const Seat &seat) { return !seat.out; }) <= 1;
+	}
+
+	inline uint64_t getRemainingTime(uint32_t seat, uint64_t now) const {
+		if (!clocks_running || seat != current_player) {
+			return seats[seat].clock_ms;
+		}
+
+		const uint64_t elapsed = now - clock_started;
+		return seats[seat].clock_ms > elapsed ? seats[seat].clock_ms - elapsed : 0;
+	}
+};
+
+class Session : public std::enable_shared_from_this<Session> {
 public:
 	enum Mode {
 		None = 0,
@@ -41,13 +100,45 @@ public:
 	virtual ~Session();
 
 	void initLocal(uint32_t num_players);
-	void initClient(const std::string &hostname, uint16_t port, const std::string &player_name);
-	void initHost(uint32_t num_players, std::optional<uint16_t> port);
-	void initHostHybrid(uint32_t num_players, std::optional<uint16_t> port, const std::string &player_name);
-	void launchThread();
+	void initClient(const std::string &hostname, uint16_t port, uint64_t session, const std::string &player_name);
+	void initSpectator(const std::string &hostname, uint16_t port, uint64_t session);
+	void resumeClient();
+	bool canResume() const;
+	// false if the port couldn't be opened, the session is back in Mode::None then
+	bool initHost(uint32_t num_players, std::optional<uint16_t> port, NetBackend *network = nullptr);
+	bool initHostHybrid(uint32_t num_players, std::optional<uint16_t> port, const std::string &player_name);
+	void attach(Scheduler *scheduler);
+	void setClocks(TimerWheel *timers, uint64_t base_ms, uint64_t increment_ms);
+
+	// every event, seat and clock of the session is appended to the log from then on
+	inline void setWriteAheadLog(WriteAheadLog *wal) {
+		this->wal = wal;
+	}
+
+	// puts a host session back into the state its write-ahead log describes, before it is attached
+	void recover(const RecoveredSession &state);
+
+	// hands the state of a host session over for hibernation if nothing happened in it for the given time and
+	// nothing is queued or running; the seated connections move into the state and stay open, everyone
+	// else who still finds the session is turned away as if it was closed
+	bool hibernate(uint64_t min_idle_us, RecoveredSession &state);
+
+	// last time a message, player or spectator was queued
+	inline uint64_t getLastActivity() const {
+		return last_activity_us.load(std::memory_order_relaxed);
+	}
 
 	void initializeField(uint32_t num_players);
 
+	// id of the session on a server hosting many of them, LAN hosts ignore it
+	inline void setSessionId(uint64_t session) {
+		id = session;
+	}
+
+	inline uint64_t getSessionId() const {
+		return id;
+	}
+
 	void deinit();
 
 	void update();
@@ -57,15 +148,34 @@ public:
 	void promoteFigure(uint32_t id, Figure to);
 	void switchToNextPlayer();
 
+	// chess clocks, host mode
+	void startClocks();
+	void switchClocks(uint32_t previous);
+	void armClock();
+	void handleClockExpired(const Message &msg);
+	uint64_t getRemainingTime(uint32_t player) const;
+
 	// network host mode
+	bool listen(uint16_t port);
+	void wakeup();
 	void disconnectClient(uint64_t player);
-	void waitForMessagesFromClients(int timeout = -1);
+	void queueMessageFromClient(const std::shared_ptr<Connection> &connection, const Message &msg);
 	void receiveMessagesFromClients();
 	void handleMessageFromClient(uint64_t index, Message msg);
-	void sendMessageToAllClients(const Message &msg);
-	void sendMessageToClient(uint64_t index, const Message &msg);
+	void sendMessageToAllClients(Message msg);
+	void sendMessageToClient(uint64_t index, Message msg);
 	void acceptQueuedPlayers();
-	void addClientToQueue(Player player, uint64_t index);
+	void addClientToQueue(Player player, uint64_t index, std::optional<uint64_t> resume = {});
+	bool addClient(const std::shared_ptr<Connection> &connection, const Message &msg);
+	std::vector<uint8_t> encodeSync(uint32_t player, std::optional<uint64_t> resume);
+	void encodeDeltas(std::vector<uint8_t> &data, uint64_t since);
+
+	// network host mode, spectators
+	void addSpectator(const std::shared_ptr<Connection> &connection, std::optional<uint64_t> resume = {});
+	void acceptQueuedSpectators();
+	void publishToSpectators(const SharedBuffer &buffer, const std::shared_ptr<Connection> &joining = nullptr);
+	void scheduleSpectatorFlush();
+	void flushSpectators();
 
 	// network client mode
 	void connectToServer(const std::string &hostname, uint16_t port);
@@ -74,6 +184,16 @@ public:
 	void receiveMessageFromServer();
 	void handleMessageFromServer(const Message &msg);
 
+	enum class ConnectionQuality {
+		Unknown,
+		Good,
+		Fair,
+		Poor,
+		NotResponding,
+	};
+
+	ConnectionQuality getConnectionQuality() const;
+
 	template <typename T>
 	static int receiveBlocking(SDLNet_StreamSocket *socket, T *result, size_t count) {
 		uint8_t *dst = reinterpret_cast<uint8_t*>(result);
@@ -103,6 +223,25 @@ public:
 		return 0;
 	}
 
+	using Event = GameEvent;
+
+	// snapshot of the host state for the server's http api, published by the session's task;
+	// status_changes is bumped whenever the status of any session changes so listings can be cached
+	static inline std::atomic<uint64_t> status_changes = 0;
+
+	SessionStatus getStatus();
+	std::vector<Event> getEvents(uint64_t since, size_t max_count);
+
+	// the published log with the names of the seats, for saving the game while it runs or once it is over
+	GameRecord getRecord();
+
+	// fnv-1a over the player count and the first count events of the log, a replayed session has to end up with the same
+	uint64_t getLogDigest(uint64_t count);
+
+	// closes all connections from the session's task, the server uses it when it destroys the session
+	void close();
+	void closeClients();
+
 	// events
 	virtual void onFieldInitialized();
 	virtual void onGameBegin();
@@ -116,38 +255,99 @@ public:
 
 protected:
 	Field field;
+	uint64_t id = 0;
 
-	std::thread thread;
-	std::atomic<bool> stop = false;
+	// sessions attached to a scheduler process their inbox in a task instead of being polled with update()
+	Scheduler *scheduler = nullptr;
+	std::atomic<uint32_t> scheduled = 0;
 
 	std::vector<Player> players;
 
-	struct Event {
-		uint32_t player;
-		uint32_t from;
-		uint32_t to;
-		Figure promotion;
-
-		enum Kind: uint8_t {
-			Move,
-			Capture,
-			Castle,
-			EnPassant,
-			Promote,
-			Check,
-			CheckMate,
-			Surrender,
-		} kind;
-	};
+	EventLog log;
+	WriteAheadLog *wal = nullptr;
+
+	void appendToLog(const Event &event);
+
+	// chess clocks, the host keeps them on the server's timer wheel; clients only
+	// mirror the remaining times it sends and count down the running one locally
+	TimerWheel *timers = nullptr;
+	uint64_t clock_base_ms = 0;
+	uint64_t clock_increment_ms = 0;
+	std::vector<uint64_t> clocks;
+	bool clocks_running = false;
+	uint64_t clock_started = 0;
+	TimerHandle clock_timer;
 
-	std::vector<Event> log;
+	// identifies the armed clock, expirations of clocks that were stopped in the meantime are ignored
+	uint64_t clock_turn = 0;
+
+	std::chrono::steady_clock::time_point clock_updated;
 
 	// network host mode
+	// clients that are further behind than this get a snapshot instead of the missed moves
+	static constexpr uint64_t MAX_RESUME_DELTAS = 256;
+
+	struct QueuedPlayer {
+		Player player;
+		uint32_t index;
+		std::optional<uint64_t> resume;
+	};
+
 	std::mutex queue_mutex;
-	std::vector<std::pair<Player, uint32_t>> queue;
-	std::vector<SDLNet_StreamSocket*> clients;
-	SDLNet_Server *server = nullptr;
+	std::vector<QueuedPlayer> queue;
+
+	std::mutex inbox_mutex;
+	std::vector<std::pair<std::shared_ptr<Connection>, Message>> inbox;
+
+	// spectators only receive, they are fed from their own task so a slow one never delays a move;
+	// one whose unwritten backlog exceeds the limit loses frames and is resynced
+	static constexpr size_t MAX_SPECTATOR_BACKLOG = 64 * 1024;
+
+	std::vector<std::pair<std::shared_ptr<Connection>, std::optional<uint64_t>>> spectator_queue;
+
+	// backlog entries with a connection are snapshots for a joining spectator, the others go to everyone
+	std::mutex spectator_mutex;
+	std::vector<std::shared_ptr<Connection>> spectators;
+	std::vector<std::pair<std::shared_ptr<Connection>, SharedBuffer>> spectator_backlog;
+	size_t num_spectators = 0;
+	std::atomic<uint32_t> spectator_flush_scheduled = 0;
+
+	// delay before the backlog is fanned out, derived from the spectators' round trip times
+	static constexpr uint64_t MAX_SPECTATOR_BATCH_MS = 50;
+	std::atomic<uint32_t> spectator_batch_ms = 0;
+
+	// spectators waiting for their queue to drain before they get a new snapshot, only touched by flushSpectators
+	std::vector<std::shared_ptr<Connection>> resyncing;
+
+	// backend used for broadcasts, either owned by this session or by the server
+	NetBackend *network = nullptr;
+	std::unique_ptr<NetBackend> backend;
+
+	// published by publishStatus() after every pass of the session's task, the spectator count is read live
+	void publishStatus();
+
+	std::mutex status_mutex;
+	SessionStatus status;
+	EventLog events;
+
+	// set by close(), clients that still try to join are turned away
+	std::atomic<bool> closing = false;
+
+	std::atomic<uint64_t> last_activity_us = getMonotonicMicros();
 
 	// network client mode
 	SDLNet_StreamSocket *socket = nullptr;
+	bool spectating = false;
+
+	// kept after disconnecting so the client can resume where it left off
+	std::string server_hostname;
+	uint16_t server_port = 0;
+	uint32_t resume_player = ~0u;
+	uint64_t last_seq = 0;
+
+	// the client pings the server to measure the round trip time, the server pings back to detect dead peers
+	static constexpr uint64_t PING_INTERVAL_US = 1000000;
+	RttStats server_rtt;
+	uint64_t last_ping_us = 0;
+	uint64_t last_receive_us = 0;
 };
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "message.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// server-sent events on a connection of a network backend: the watcher sends one GET /sessions/<id>/events
+// request and is a spectator from then on, written by the reactor like the tcp spectators; what is queued to
+// it is rendered into events once per broadcast buffer and shared by all watchers
+class EventStreamCodec {
+public:
+	enum State {
+		Request,
+		Open,
+		// bad request, the connection should be closed once the reply went out
+		Failed,
+	};
+
+	static constexpr size_t MAX_REQUEST_SIZE = 8 * 1024;
+
+	// collects the request; once it is complete the response header goes to reply and the spectate or resume
+	// message the watcher stands for to request, everything received after that is ignored
+	State receive(std::span<const uint8_t> data, std::optional<Message> &request, std::vector<uint8_t> &reply);
+
+	inline State getState() const {
+		return state;
+	}
+
+	// appends the events for whole protocol messages, an accept followed by its tiles becomes a snapshot
+	// and pings become comments that keep proxies from closing an idle stream
+	static void render(std::span<const uint8_t> data, std::string &events);
+
+private:
+	bool parseRequest(std::optional<Message> &request, std::vector<uint8_t> &reply);
+
+	State state = Request;
+	std::vector<uint8_t> pending;
+};
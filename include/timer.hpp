@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+struct TimerHandle {
+	uint32_t index = ~0u;
+	uint32_t generation = 0;
+
+	inline explicit operator bool() const {
+		return index != ~0u;
+	}
+};
+
+// hierarchical timer wheel, 4 levels of 256 slots each, timers live in intrusive lists
+// so scheduling and cancelling is O(1); a single thread drives it with run() or advance(),
+// callbacks are invoked on that thread and should only hand the expiration to someone else
+class TimerWheel {
+public:
+	using Callback = std::function<void()>;
+
+	explicit TimerWheel(uint32_t tick_ms = 10);
+
+	TimerHandle schedule(uint64_t delay_ms, Callback callback);
+
+	// returns false if the timer already fired or was cancelled
+	bool cancel(TimerHandle &handle);
+
+	// milliseconds since the wheel was created
+	uint64_t now() const;
+
+	// fires everything that expired until now
+	void advance();
+
+	void run();
+	void stop();
+
+	inline size_t getTimerCount() {
+		std::scoped_lock<std::mutex> lock{mutex};
+		return nodes.size() - free_nodes.size();
+	}
+
+private:
+	static constexpr uint32_t LEVELS = 4;
+	static constexpr uint32_t SLOT_BITS = 8;
+	static constexpr uint32_t SLOTS = 1 << SLOT_BITS;
+	static constexpr uint32_t NIL = ~0u;
+
+	struct Node {
+		uint64_t expires = 0;
+		uint32_t prev = NIL;
+		uint32_t next = NIL;
+		uint32_t slot = NIL;
+		uint32_t generation = 0;
+		Callback callback;
+	};
+
+	// caller holds mutex
+	void insert(uint32_t index);
+	void unlink(uint32_t index);
+	void release(uint32_t index);
+	void cascade(uint32_t level);
+
+	const uint32_t tick_ms;
+	const std::chrono::steady_clock::time_point start;
+
+	std::mutex mutex;
+	uint64_t current = 0;
+	std::vector<Node> nodes;
+	std::vector<uint32_t> free_nodes;
+	uint32_t slots[LEVELS * SLOTS];
+
+	std::atomic<bool> stopped = false;
+};
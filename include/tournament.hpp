@@ -0,0 +1,115 @@
+#pragma once
+
+#include "book.hpp"
+#include "engine.hpp"
+#include "scheduler.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// one side of a tournament, --engine name=<name>,depth=N,ms=N,book=<file>
+struct TournamentEngine {
+	std::string name;
+	EngineOptions options;
+	std::string book_path;
+	std::unique_ptr<OpeningBook> book;
+};
+
+// generalized sequential probability ratio test on the candidate's score per game, which for a table of more
+// than two is the average of how it did against each other seat; the log likelihood ratio of elo1 against elo0
+// is approximated from the mean and variance of the scores, so draws and the seats of one table need no model
+struct Sprt {
+	enum Result {
+		Continue,
+		// the candidate isn't elo1 better than the baseline
+		AcceptH0,
+		// it isn't just elo0 better
+		AcceptH1,
+	};
+
+	double elo0 = 0.0;
+	double elo1 = 5.0;
+	double alpha = 0.05;
+	double beta = 0.05;
+
+	uint64_t games = 0;
+	double sum = 0.0;
+	double sum_squares = 0.0;
+
+	inline void add(double score) {
+		games++;
+		sum += score;
+		sum_squares += score * score;
+	}
+
+	double getLlr() const;
+	double getElo() const;
+	Result getResult() const;
+
+	inline double getLowerBound() const {
+		return std::log(beta / (1.0 - alpha));
+	}
+
+	inline double getUpperBound() const {
+		return std::log((1.0 - beta) / alpha);
+	}
+};
+
+// plays a candidate engine against a baseline engine in process, one game per task of a scheduler; the candidate
+// takes one seat of every table and moves to the next seat with every game, the baseline plays the others
+class Tournament {
+public:
+	Tournament(const std::vector<std::string> &args);
+	~Tournament();
+
+	int run();
+
+private:
+	// the seat's place in the order the players went out in, the ones still playing share the last
+	struct GameResult {
+		uint64_t index;
+		uint32_t candidate;
+		uint32_t out_order[MAX_PLAYERS];
+		uint64_t plies;
+		// by how often the candidate went out later than each of the others
+		double score;
+	};
+
+	void startGame();
+	void playGame(uint64_t index);
+	void finishGame(const GameResult &result);
+	void report(uint64_t elapsed_ms);
+
+	uint32_t num_players = 2;
+	uint64_t max_games = 10000;
+	uint32_t max_plies = 400;
+	uint32_t num_threads = 0;
+	uint64_t seed;
+	// clock of every seat in milliseconds, without a base every move gets the engine's own think time
+	uint64_t base_ms = 0;
+	uint64_t increment_ms = 0;
+	std::string records_dir;
+	bool valid = true;
+
+	// the candidate first
+	TournamentEngine engines[2];
+	Sprt sprt;
+
+	std::unique_ptr<Scheduler> scheduler;
+	std::atomic<uint64_t> next_game = 0;
+	std::atomic<bool> stopped = false;
+
+	std::mutex mutex;
+	std::condition_variable finished;
+	uint64_t num_finished = 0;
+	uint64_t wins = 0, draws = 0, losses = 0;
+	uint64_t total_plies = 0;
+	uint64_t timeouts = 0;
+	uint64_t failed_records = 0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// one complete span, fields are atomics so a dump can read a buffer while its thread keeps writing
+struct TraceEvent {
+	std::atomic<const char*> name = nullptr;
+	std::atomic<uint64_t> start_ns = 0;
+	std::atomic<uint64_t> duration_ns = 0;
+};
+
+// the last spans of one thread, older ones are overwritten
+struct TraceBuffer {
+	static constexpr size_t CAPACITY = 16 * 1024;
+
+	uint32_t thread;
+	std::atomic<uint64_t> count = 0;
+	TraceEvent events[CAPACITY];
+};
+
+// collects spans into a buffer per thread while enabled, dumps them as chrome trace event json
+// that chrome://tracing and perfetto load
+class Tracer {
+public:
+	static inline bool isEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	static inline void setEnabled(bool value) {
+		enabled = value;
+	}
+
+	static inline uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// name has to be a string literal
+	static void record(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+	static std::string dump();
+	static bool dumpToFile(const std::string &path);
+
+	// SIGUSR1 asks for a dump, whoever polls takeDumpRequest() writes it
+	static void installSignalHandler();
+	static bool takeDumpRequest();
+
+private:
+	static inline std::atomic<bool> enabled = false;
+};
+
+// records the time until it goes out of scope, a single relaxed load when tracing is disabled
+class TraceSpan {
+public:
+	inline explicit TraceSpan(const char *name) : name(Tracer::isEnabled() ? name : nullptr), start(this->name ? Tracer::now() : 0) {}
+
+	inline ~TraceSpan() {
+		if (name) {
+			Tracer::record(name, start, Tracer::now());
+		}
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan &operator=(const TraceSpan&) = delete;
+
+private:
+	const char *const name;
+	const uint64_t start;
+};
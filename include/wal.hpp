@@ -0,0 +1,136 @@
+#pragma once
+
+#include "session.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct WalHeader {
+	static constexpr char MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'W', 'A', 'L'};
+	static constexpr uint32_t VERSION = 2;
+
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+// every record starts 8 byte aligned, a record whose checksum doesn't match was torn by a crash and ends the log
+struct WalRecord {
+	uint64_t session;
+
+	enum Kind : uint8_t {
+		Create,
+		Join,
+		Event,
+		Clock,
+		Destroy,
+		// a run of events as they lie in the session's log, written when a log is compacted or a session hibernated
+		Events,
+	} kind;
+
+	uint8_t player;
+
+	// bytes of payload following the record
+	uint16_t size;
+
+	// fnv-1a over the record with this field set to 0 and the payload
+	uint32_t checksum;
+};
+
+struct WalCreate {
+	uint32_t num_players;
+	uint32_t reserved;
+	uint64_t clock_base_ms;
+	uint64_t clock_increment_ms;
+};
+
+struct WalJoin {
+	char name[24];
+};
+
+struct WalEvent {
+	uint16_t from;
+	uint16_t to;
+	Session::Event::Kind kind;
+	Figure promotion;
+	uint16_t reserved;
+};
+
+// a session as the log left it, the server recreates it with the same id
+struct RecoveredSession {
+	uint64_t id = 0;
+	uint32_t num_players = 0;
+	uint64_t clock_base_ms = 0;
+	uint64_t clock_increment_ms = 0;
+
+	std::vector<std::string> names;
+	EventLog events;
+	std::vector<uint64_t> clocks;
+
+	// seats whose connection stayed open while the session was hibernated, empty when it comes from a log
+	std::vector<std::shared_ptr<Connection>> connections;
+
+	bool destroyed = false;
+
+	// at most one player is still in, the events are replayed since a checkmate isn't logged and
+	// a game without clocks has no timeouts
+	bool isFinished() const;
+};
+
+struct WalRecoveryStats {
+	uint64_t bytes = 0;
+	uint64_t records = 0;
+
+	// a crash in the middle of a write leaves a torn record at the end
+	bool torn = false;
+};
+
+// sessions append their moves, seats and clocks from any thread without waiting for the disk; a background
+// thread writes everything that was appended since its last fsync and syncs it in one go, so concurrent
+// sessions share the cost of a sync. a crash loses at most what was appended during the last sync
+class WriteAheadLog {
+public:
+	WriteAheadLog() = default;
+	~WriteAheadLog();
+
+	WriteAheadLog(const WriteAheadLog&) = delete;
+	WriteAheadLog &operator=(const WriteAheadLog&) = delete;
+
+	// reads the sessions from a log that weren't destroyed, a missing file is an empty log
+	static bool read(const std::string &path, std::vector<RecoveredSession> &sessions, WalRecoveryStats &stats);
+
+	// writes a complete log with the given sessions, it replaces the file only once it is synced
+	static bool write(const std::string &path, std::span<const RecoveredSession> sessions);
+
+	// replaces the log with the given sessions, so it only grows with the games that are still running,
+	// and starts appending to it
+	bool open(const std::string &path, std::span<const RecoveredSession> sessions);
+
+	void writeCreate(uint64_t session, uint32_t num_players, uint64_t clock_base_ms, uint64_t clock_increment_ms);
+	void writeJoin(uint64_t session, uint32_t player, const std::string &name);
+	void writeEvent(uint64_t session, const Session::Event &event);
+	void writeClock(uint64_t session, uint32_t player, uint64_t remaining_ms);
+	void writeDestroy(uint64_t session);
+
+private:
+	static void appendRecord(std::vector<uint8_t> &out, uint64_t session, WalRecord::Kind kind, uint32_t player, std::span<const uint8_t> payload);
+	static void appendSession(std::vector<uint8_t> &out, const RecoveredSession &session);
+
+	void append(uint64_t session, WalRecord::Kind kind, uint32_t player, std::span<const uint8_t> payload = {});
+	void run();
+
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::vector<uint8_t> pending;
+	bool stopping = false;
+
+	FILE *file = nullptr;
+	std::thread writer;
+};
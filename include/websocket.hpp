@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// RFC 6455 framing for connections that carry the game protocol in binary messages; the payloads
+// form the same byte stream as a plain tcp connection, so messages may span frames and vice versa
+class WebSocketCodec {
+public:
+	enum Role {
+		// answers the handshake, expects masked frames
+		Server,
+		// sends the handshake, expects unmasked frames
+		Client,
+	};
+
+	enum State {
+		Handshake,
+		Open,
+		// a close frame was exchanged, the connection should be closed once the reply went out
+		Closing,
+		// protocol error, the connection should be dropped
+		Failed,
+	};
+
+	static constexpr size_t MAX_HEADER_SIZE = 14;
+	static constexpr size_t MAX_PAYLOAD_SIZE = 64 * 1024;
+	static constexpr size_t MAX_HANDSHAKE_SIZE = 8 * 1024;
+
+	explicit WebSocketCodec(Role role);
+
+	// unwraps received bytes: payloads of data frames are appended to payload, the handshake response,
+	// pongs and close replies to reply; returns the state afterwards
+	State receive(std::span<const uint8_t> data, std::vector<uint8_t> &payload, std::vector<uint8_t> &reply);
+
+	inline State getState() const {
+		return state;
+	}
+
+	// header of an unmasked binary frame, returns its size
+	static size_t encodeHeader(uint8_t *header, uint64_t length);
+
+	// a complete masked binary frame as a client sends it
+	static std::vector<uint8_t> encodeClientFrame(std::span<const uint8_t> payload);
+
+	// request the client starts with, host is sent in the Host header
+	std::string makeHandshake(const std::string &host);
+
+	static std::string computeAccept(const std::string &key);
+
+private:
+	enum Opcode : uint8_t {
+		Continuation = 0x0,
+		Text = 0x1,
+		Binary = 0x2,
+		Close = 0x8,
+		Ping = 0x9,
+		Pong = 0xa,
+	};
+
+	bool receiveHandshake(std::vector<uint8_t> &reply);
+	bool receiveFrames(std::vector<uint8_t> &payload, std::vector<uint8_t> &reply);
+	void encodeControl(Opcode opcode, std::span<const uint8_t> payload, std::vector<uint8_t> &reply);
+
+	const Role role;
+	State state = Handshake;
+
+	// received bytes that don't form a complete handshake or frame yet
+	std::vector<uint8_t> pending;
+
+	// sent by the client, checked against the server's answer
+	std::string key;
+};
@@ -1,9 +1,19 @@
 #pragma once
 
 #include "session.hpp"
+#include "book.hpp"
+#include "engine.hpp"
+#include "explorer.hpp"
 #include "gl.hpp"
+#include "record.hpp"
 
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 struct Vertex {
@@ -31,6 +41,15 @@ public:
 
 	void updateVertexBuffer();
 
+	// plays the seats that are marked as engine seats in a local game
+	void updateEngine();
+
+	// replay mode shows a saved game at any ply instead of playing one
+	void openReplay(const std::string &path);
+	void closeReplay();
+	void seekReplay(uint64_t ply);
+	void saveRecord();
+
 	uint32_t getTileUnderCursor(float x, float y);
 
 	void onFramebufferResized(const SDL_WindowEvent &event);
@@ -66,8 +85,34 @@ private:
 		std::string player_name = "player#" + std::to_string(time(nullptr) % 100);
 		std::string server_address = "127.0.0.1";
 		int server_port = 1234;
+		uint64_t session = 0;
+		std::string record_path = "game.rec";
+		// why hosting a game failed, shown in the main menu
+		std::string error;
+		// a bit per seat that the engine plays in local games
+		unsigned int engine_seats = 0;
 	} ui_state;
 
+	std::optional<GameReplay> replay;
+
+	// moves of the explorer in the shown position, when --explorer is given
+	static constexpr size_t MAX_EXPLORER_MOVES = 16;
+	std::unique_ptr<OpeningExplorer> explorer;
+
+	// searches on a copy of the field while frames keep being drawn, the move is only made if the field is still the same
+	std::unique_ptr<OpeningBook> book;
+	std::unique_ptr<Engine> engine;
+	std::future<std::optional<EngineMove>> engine_move;
+	uint64_t engine_key = 0;
+
+	// one thread searches for the whole run instead of a new one per move, it runs one task at a time
+	void runEngine();
+	std::thread engine_thread;
+	std::mutex engine_mutex;
+	std::condition_variable engine_wakeup;
+	std::optional<std::packaged_task<std::optional<EngineMove>()>> engine_task;
+	bool engine_stopped = false;
+
 	GLuint field_shader;
 
 	Buffer<Vertex> field_mesh;
@@ -0,0 +1,401 @@
+#include "book.hpp"
+
+#include "engine.hpp"
+#include "explorer.hpp"
+#include "gamedb.hpp"
+#include "io.hpp"
+#include "record.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+OpeningBook::~OpeningBook() {
+#if !defined(_WIN32)
+	if (data) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+#endif
+}
+
+bool OpeningBook::open(const std::string &path) {
+#if defined(_WIN32)
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	data = contents.data();
+	size = contents.size();
+#else
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	// a probe touches the few pages its binary search lands on
+	void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(mapped);
+	size = info.st_size;
+#endif
+
+	if (size < sizeof(header)) {
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, BookHeader::MAGIC, sizeof(header.magic)) != 0 || header.version != BookHeader::VERSION) {
+		return false;
+	} else if (header.num_entries != (size - sizeof(header)) / sizeof(BookEntry) || (size - sizeof(header)) % sizeof(BookEntry) != 0) {
+		return false;
+	}
+
+	entries = std::span<const BookEntry>(reinterpret_cast<const BookEntry*>(data + sizeof(header)), header.num_entries);
+	return true;
+}
+
+std::span<const BookEntry> OpeningBook::getEntries(uint64_t key) const {
+	const auto begin = std::lower_bound(entries.begin(), entries.end(), key, [](const BookEntry &entry, uint64_t key) { return entry.key < key; });
+	auto end = begin;
+	while (end != entries.end() && end->key == key) {
+		end++;
+	}
+	return std::span<const BookEntry>(begin, end);
+}
+
+std::optional<BookEntry> OpeningBook::probe(uint64_t key, std::mt19937_64 &random) const {
+	const std::span<const BookEntry> candidates = getEntries(key);
+
+	uint64_t total = 0;
+	for (const BookEntry &entry : candidates) {
+		total += entry.weight;
+	}
+
+	if (total == 0) {
+		return std::nullopt;
+	}
+
+	uint64_t pick = std::uniform_int_distribution<uint64_t>(0, total - 1)(random);
+	for (const BookEntry &entry : candidates) {
+		if (pick < entry.weight) {
+			return entry;
+		}
+		pick -= entry.weight;
+	}
+
+	return std::nullopt;
+}
+
+bool OpeningBook::build(const OpeningExplorer &explorer, const std::string &path, uint32_t min_games, std::span<const uint32_t> player_counts, BookBuildStats &stats) {
+	std::vector<BookEntry> entries;
+	std::unordered_set<uint32_t> visited;
+
+	// the explorer doesn't know whose turn it is in a node, so the positions are played through from the start
+	for (uint32_t num_players : player_counts) {
+		if (num_players < 2 || num_players > MAX_PLAYERS) {
+			continue;
+		}
+
+		Field start;
+		start.init(num_players);
+
+		std::vector<std::pair<Field, uint32_t>> stack;
+		stack.emplace_back(start, explorer.findNode(start));
+		while (!stack.empty()) {
+			const auto [field, node] = std::move(stack.back());
+			stack.pop_back();
+
+			if (node == OpeningExplorer::NO_NODE || !visited.insert(node).second) {
+				continue;
+			}
+
+			const uint32_t mover = field.current_player;
+			const uint64_t key = field.calculateKey();
+			bool added = false;
+
+			for (const ExplorerMove &move : explorer.getMoves(node)) {
+				if (move.games < min_games) {
+					continue;
+				}
+
+				// a win counts like num_players undecided games, a move that only ever lost to another seat is left out
+				const uint64_t weight = uint64_t(move.wins[mover]) * num_players + move.undecided;
+				if (weight > 0) {
+					BookEntry entry = {};
+					entry.key = key;
+					entry.from = move.from;
+					entry.to = move.to;
+					entry.kind = move.kind;
+					entry.promotion = move.promotion;
+					entry.weight = std::min<uint64_t>(weight, UINT16_MAX);
+					entries.push_back(entry);
+					added = true;
+				}
+
+				Field child = field;
+				applyEvent(child, GameEvent(mover, move.from, move.to, Figure::None, move.kind));
+				if (move.promotion != Figure::None) {
+					applyEvent(child, GameEvent(mover, move.to, 0, move.promotion, GameEvent::Promote));
+				}
+				stack.emplace_back(child, move.child);
+			}
+
+			stats.positions += added;
+		}
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const BookEntry &a, const BookEntry &b) {
+		if (a.key != b.key) {
+			return a.key < b.key;
+		}
+		return a.from != b.from ? a.from < b.from : a.to < b.to;
+	});
+
+	BookHeader header = {};
+	memcpy(header.magic, BookHeader::MAGIC, sizeof(header.magic));
+	header.version = BookHeader::VERSION;
+	header.num_entries = entries.size();
+
+	const std::string temporary = path + ".tmp";
+	FILE *out = fopen(temporary.c_str(), "wb");
+	if (!out) {
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+	written = written && fwrite(entries.data(), sizeof(BookEntry), entries.size(), out) == entries.size();
+	written = fclose(out) == 0 && written;
+
+#if defined(_WIN32)
+	remove(path.c_str());
+#endif
+
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+	stats.entries = entries.size();
+	return true;
+}
+
+static std::optional<uint64_t> parseArgument(const std::string &text, int base = 10) {
+	uint64_t value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+	if (error != std::errc() || end != text.data() + text.size()) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+// plays engine games and adds them to the explorer, a book built from it lets the next round start with more variety
+static int selfPlay(const std::string &path, uint64_t num_games, std::span<const uint32_t> player_counts, uint32_t max_plies,
+	const EngineOptions &options, uint32_t num_threads) {
+	std::unique_ptr<OpeningExplorer> existing = std::make_unique<OpeningExplorer>();
+	if (!existing->open(path)) {
+		existing.reset();
+	}
+
+	ExplorerBuilder builder(existing ? existing->getHeader().max_depth : OpeningExplorer::DEFAULT_DEPTH);
+	if (existing) {
+		builder.addExplorer(*existing);
+		existing.reset();
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const uint64_t seed = std::random_device()();
+
+	std::vector<ExplorerBuilder> builders(num_threads, ExplorerBuilder(builder.getMaxDepth()));
+	std::atomic<uint64_t> next = 0;
+	std::atomic<uint64_t> plies = 0;
+	const auto work = [&](uint32_t thread) {
+		Engine engine(options, seed + thread);
+		std::vector<GameEvent> events;
+		for (uint64_t game; (game = next.fetch_add(1, std::memory_order_relaxed)) < num_games;) {
+			const uint32_t num_players = player_counts[game % player_counts.size()];
+
+			Field field;
+			field.init(num_players);
+			EventLog log;
+			for (uint32_t ply = 0; ply < max_plies && GameDatabase::getWinner(field) == GameDatabase::NO_WINNER; ply++) {
+				const std::optional<EngineMove> move = engine.think(field);
+				if (!move) {
+					break;
+				}
+
+				events.clear();
+				Engine::appendEvents(field, move.value(), events);
+				for (const GameEvent &event : events) {
+					applyEvent(field, event);
+					log.push_back(event);
+				}
+			}
+
+			plies += log.size();
+			builders[thread].addGame(num_players, log, GameDatabase::getWinner(field));
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < num_threads; i++) {
+		threads.emplace_back(work, i);
+	}
+
+	work(0);
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	for (const ExplorerBuilder &played : builders) {
+		builder.merge(played);
+	}
+
+	ExplorerBuildStats stats;
+	if (!builder.save(path, stats)) {
+		eprintln("couldn't write explorer {}", path);
+		return 1;
+	}
+
+	const uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	println("played {} games with {} events in {} ms on {} threads, the explorer has {} games in {} positions", num_games, plies.load(), ms, num_threads, stats.games, stats.nodes);
+	return 0;
+}
+
+int OpeningBook::run(const std::vector<std::string> &args) {
+	if (args.size() < 4 || (args[2] != "build" && args[2] != "self-play" && args[2] != "show")) {
+		eprintln("usage: {} --book build <book> <explorer> [--min-games N] [--players N]...", args[0]);
+		eprintln("       {} --book self-play <explorer> [--games N] [--players N]... [--plies N] [--depth N] [--think-ms N] [--threads N] [--book <book>]", args[0]);
+		eprintln("       {} --book show <book> <players> | --key <hex>", args[0]);
+		return 1;
+	}
+
+	const std::string &path = args[3];
+	if (args[2] == "show") {
+		OpeningBook book;
+		if (!book.open(path)) {
+			eprintln("couldn't open book {}", path);
+			return 1;
+		}
+
+		std::optional<uint64_t> key;
+		if (args.size() >= 6 && args[4] == "--key") {
+			key = parseArgument(args[5], 16);
+		} else if (args.size() >= 5) {
+			const uint64_t num_players = parseArgument(args[4]).value_or(0);
+			if (num_players >= 2 && num_players <= MAX_PLAYERS) {
+				Field field;
+				field.init(num_players);
+				key = field.calculateKey();
+			}
+		}
+
+		if (!key) {
+			eprintln("a player count between 2 and {} or a key is needed", MAX_PLAYERS);
+			return 1;
+		}
+
+		println("{} entries, position {:016x}", book.getEntryCount(), key.value());
+		for (const BookEntry &entry : book.getEntries(key.value())) {
+			println("{} ({}, {}, {}) -> ({}, {}, {}): weight {}", GameEvent::getKindName(entry.kind),
+				getX(entry.from), getY(entry.from), getZ(entry.from), getX(entry.to), getY(entry.to), getZ(entry.to), entry.weight);
+		}
+		return 0;
+	}
+
+	std::vector<uint32_t> player_counts;
+	uint32_t min_games = 2;
+	uint64_t num_games = 100;
+	uint32_t max_plies = 2 * OpeningExplorer::DEFAULT_DEPTH;
+	uint32_t num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::string explorer_path;
+	std::string book_path;
+	EngineOptions options;
+	options.max_depth = 2;
+	options.think_ms = 50;
+
+	for (size_t i = 4; i < args.size(); i++) {
+		if (args[i] == "--players" && i + 1 < args.size()) {
+			player_counts.push_back(parseArgument(args[++i]).value_or(0));
+		} else if (args[i] == "--min-games" && i + 1 < args.size()) {
+			min_games = parseArgument(args[++i]).value_or(min_games);
+		} else if (args[i] == "--games" && i + 1 < args.size()) {
+			num_games = parseArgument(args[++i]).value_or(num_games);
+		} else if (args[i] == "--plies" && i + 1 < args.size()) {
+			max_plies = parseArgument(args[++i]).value_or(max_plies);
+		} else if (args[i] == "--depth" && i + 1 < args.size()) {
+			options.max_depth = parseArgument(args[++i]).value_or(options.max_depth);
+		} else if (args[i] == "--think-ms" && i + 1 < args.size()) {
+			options.think_ms = parseArgument(args[++i]).value_or(options.think_ms);
+		} else if (args[i] == "--threads" && i + 1 < args.size()) {
+			num_threads = std::max<uint64_t>(parseArgument(args[++i]).value_or(1), 1);
+		} else if (args[i] == "--book" && i + 1 < args.size()) {
+			book_path = args[++i];
+		} else {
+			explorer_path = args[i];
+		}
+	}
+
+	std::erase_if(player_counts, [](uint32_t num_players) { return num_players < 2 || num_players > MAX_PLAYERS; });
+	if (player_counts.empty()) {
+		for (uint32_t i = 2; i <= MAX_PLAYERS; i++) {
+			player_counts.push_back(i);
+		}
+	}
+
+	if (args[2] == "self-play") {
+		// engines that play from a book start their games differently
+		OpeningBook book;
+		if (!book_path.empty()) {
+			if (!book.open(book_path)) {
+				eprintln("couldn't open book {}", book_path);
+				return 1;
+			}
+			options.book = &book;
+		}
+
+		return selfPlay(path, num_games, player_counts, max_plies, options, num_threads);
+	}
+
+	OpeningExplorer explorer;
+	if (!explorer.open(explorer_path)) {
+		eprintln("couldn't open explorer {}", explorer_path);
+		return 1;
+	}
+
+	BookBuildStats stats;
+	if (!build(explorer, path, min_games, player_counts, stats)) {
+		eprintln("couldn't write book {}", path);
+		return 1;
+	}
+
+	println("{} moves in {} positions from {} games, at least {} games each", stats.entries, stats.positions, explorer.getHeader().num_games, min_games);
+	return 0;
+}
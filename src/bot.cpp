@@ -0,0 +1,263 @@
+#include "bot.hpp"
+
+#include "io.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+// false if the text isn't a number or doesn't fit the target, which keeps its value then
+template <typename T>
+static bool parseArgument(const std::string &text, T &target, int base = 10) {
+	uint64_t value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+	if (error != std::errc() || end != text.data() + text.size() || value > std::numeric_limits<T>::max()) {
+		return false;
+	}
+	target = value;
+	return true;
+}
+
+// --ws-bot <host> <port> <session> [--name <name>] [--spectate] [--moves N]
+Bot::Bot(const std::vector<std::string> &args) {
+	size_t positional = 0;
+	for (size_t i = 2; i < args.size(); i++) {
+		if (args[i] == "--name" && i + 1 < args.size()) {
+			name = args[++i].substr(0, 16);
+		} else if (args[i] == "--spectate") {
+			spectate = true;
+		} else if (args[i] == "--moves" && i + 1 < args.size()) {
+			if (!parseArgument(args[++i], max_moves)) {
+				eprintln("invalid value {} for --moves", args[i]);
+				valid = false;
+			}
+		} else if (positional == 0) {
+			hostname = args[i];
+			positional++;
+		} else if (positional == 1) {
+			if (!parseArgument(args[i], port)) {
+				eprintln("invalid port {}", args[i]);
+				valid = false;
+			}
+			positional++;
+		} else if (positional == 2) {
+			if (!parseArgument(args[i], session, 16)) {
+				eprintln("invalid session id {}", args[i]);
+				valid = false;
+			}
+			positional++;
+		}
+	}
+}
+
+Bot::~Bot() {
+	if (socket) {
+		SDLNet_DestroyStreamSocket(socket);
+	}
+}
+
+int Bot::run() {
+	if (!valid || !connect()) {
+		return 1;
+	}
+
+	const std::string handshake = websocket.makeHandshake(hostname);
+	if (!send(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(handshake.data()), handshake.size()))) {
+		return 1;
+	}
+
+	// the join request can go out before the handshake is answered, the server reads it afterwards
+	if (!sendMessage(spectate ? Message::makeSpectate(session) : Message::makeJoin(session, -1, name))) {
+		return 1;
+	}
+
+	uint8_t buffer[4096];
+	while (!done) {
+		if (SDLNet_WaitUntilInputAvailable((void**)&socket, 1, 1000) < 0) {
+			break;
+		}
+
+		const int received = SDLNet_ReadFromStreamSocket(socket, buffer, sizeof(buffer));
+		if (received < 0) {
+			println("connection to {}:{} closed", hostname, port);
+			break;
+		} else if (received == 0) {
+			continue;
+		}
+
+		std::vector<uint8_t> payload, reply;
+		const WebSocketCodec::State state = websocket.receive(std::span<const uint8_t>(buffer, received), payload, reply);
+		if (!reply.empty()) {
+			send(reply);
+		}
+
+		if (state == WebSocketCodec::Failed) {
+			eprintln("websocket handshake or framing failed");
+			return 1;
+		}
+
+		receive(payload);
+
+		if (state == WebSocketCodec::Closing) {
+			println("server closed the connection");
+			break;
+		}
+
+		if (joined && !spectate && !waiting && field.current_player == player && !field.players[player].is_checkmate) {
+			makeMove();
+		}
+	}
+
+	println("bot {} made {} moves", name, moves);
+	return 0;
+}
+
+bool Bot::connect() {
+	SDLNet_Address *addr = SDLNet_ResolveHostname(hostname.c_str());
+	if (!addr || SDLNet_WaitUntilResolved(addr, -1) != 1) {
+		eprintln("couldn't resolve hostname ({}): {}", hostname, SDL_GetError());
+		if (addr) {
+			SDLNet_UnrefAddress(addr);
+		}
+		return false;
+	}
+
+	socket = SDLNet_CreateClient(addr, port);
+	if (!socket || SDLNet_WaitUntilConnected(socket, -1) != 1) {
+		eprintln("couldn't connect to {}:{}: {}", hostname, port, SDL_GetError());
+		SDLNet_UnrefAddress(addr);
+		return false;
+	}
+
+	SDLNet_UnrefAddress(addr);
+	return true;
+}
+
+bool Bot::send(std::span<const uint8_t> data) {
+	return SDLNet_WriteToStreamSocket(socket, data.data(), data.size()) == 0;
+}
+
+bool Bot::sendMessage(const Message &msg) {
+	return send(WebSocketCodec::encodeClientFrame(asBytes(msg)));
+}
+
+void Bot::receive(std::span<const uint8_t> payload) {
+	stream.insert(stream.end(), payload.begin(), payload.end());
+
+	size_t offset = 0;
+	while (!done) {
+		if (tiles_expected > 0) {
+			if (stream.size() - offset < tiles_expected) {
+				break;
+			}
+
+			memcpy(field.tiles, stream.data() + offset, tiles_expected);
+			offset += tiles_expected;
+			tiles_expected = 0;
+			joined = true;
+			println("received field, playing as {}", spectate ? "spectator" : std::format("player {}", player));
+			continue;
+		}
+
+		if (stream.size() - offset < sizeof(Message)) {
+			break;
+		}
+
+		Message msg;
+		memcpy(&msg, stream.data() + offset, sizeof(Message));
+		offset += sizeof(Message);
+		handleMessage(msg);
+	}
+
+	stream.erase(stream.begin(), stream.begin() + offset);
+}
+
+void Bot::handleMessage(const Message &msg) {
+	switch (msg.type) {
+		case Message::Accept: {
+			// the snapshot is copied into the tiles, a broken server mustn't make that overflow
+			if (msg.accept.num_players < 2 || msg.accept.num_players > MAX_PLAYERS) {
+				eprintln("server accepted with {} players", msg.accept.num_players);
+				done = true;
+				break;
+			}
+
+			field.init(msg.accept.num_players);
+			field.current_player = msg.accept.current_player;
+			player = msg.player;
+			tiles_expected = sizeof(Tile) * 32 * msg.accept.num_players;
+		} break;
+		case Message::Reject: {
+			println("session {:016x} rejected the join request", session);
+			done = true;
+		} break;
+		case Message::Ping: {
+			sendMessage(Message::makePong(msg.ping.timestamp_us));
+		} break;
+		case Message::Move: {
+			if (!joined || msg.move.from >= field.num_players * 32 || msg.move.to >= field.num_players * 32) {
+				break;
+			}
+
+			field.current_player = msg.move.next_player;
+			field.moveFigure(msg.move.from, msg.move.to, msg.move.type);
+
+			if (msg.player == player) {
+				waiting = false;
+
+				// a pawn that reached the last row has to be promoted before the turn is over
+				if (field.tiles[msg.move.to].figure == Figure::Pawn && getY(msg.move.to) == 0) {
+					sendMessage(Message::makePromotion(player, msg.move.to, Figure::Queen));
+					waiting = true;
+				}
+			}
+		} break;
+		case Message::Promotion: {
+			if (!joined || msg.promotion.id >= field.num_players * 32) {
+				break;
+			}
+
+			field.current_player = msg.promotion.next_player;
+			field.tiles[msg.promotion.id].figure = msg.promotion.figure;
+			if (msg.player == player) {
+				waiting = false;
+			}
+		} break;
+		case Message::Clock: {
+			if (!joined || msg.player >= field.num_players) {
+				break;
+			}
+
+			field.current_player = msg.clock.next_player;
+			if (msg.clock.remaining_ms == 0) {
+				field.players[msg.player].is_checkmate = true;
+				if (msg.player == player) {
+					println("ran out of time");
+					waiting = false;
+				}
+			}
+		} break;
+		default: break;
+	}
+}
+
+void Bot::makeMove() {
+	if (moves >= max_moves) {
+		done = true;
+		return;
+	}
+
+	std::vector<MoveCandidate> candidates;
+	field.collectMoves(player, candidates);
+
+	if (candidates.empty()) {
+		println("no moves left");
+		done = true;
+		return;
+	}
+
+	const MoveCandidate &move = candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(random)];
+	sendMessage(Message::makeMove(player, move.from, move.to, move.type));
+	waiting = true;
+	moves++;
+}
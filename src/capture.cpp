@@ -0,0 +1,210 @@
+#include "capture.hpp"
+
+#include "log.hpp"
+
+#include <cstring>
+#include <filesystem>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr size_t CAPTURE_ALIGNMENT = 8;
+
+static inline size_t alignRecord(size_t size) {
+	return (size + CAPTURE_ALIGNMENT - 1) & ~(CAPTURE_ALIGNMENT - 1);
+}
+
+CaptureWriter::~CaptureWriter() {
+	if (file) {
+		fclose(file);
+	}
+}
+
+bool CaptureWriter::open(const std::string &path) {
+	std::error_code error;
+	const uintmax_t size = std::filesystem::file_size(path, error);
+	if (!error && size > 0) {
+		size_t end;
+		{
+			CaptureReader reader;
+			if (!reader.open(path)) {
+				logError("not appending to the capture file", "path", path);
+				return false;
+			}
+
+			CaptureRecord record;
+			std::span<const uint8_t> payload;
+			while (reader.next(record, payload)) {}
+			end = reader.getOffset();
+		}
+
+		if (end < size) {
+			logWarn("capture file ends in a cut off record, truncating it", "path", path, "bytes", size - end);
+			std::filesystem::resize_file(path, end, error);
+			if (error) {
+				logError("couldn't truncate capture file", "path", path, "error", error.message());
+				return false;
+			}
+		}
+	}
+
+	file = fopen(path.c_str(), "ab");
+	if (!file) {
+		logError("couldn't open capture file", "path", path);
+		return false;
+	}
+
+	// records are small, they are written out in large blocks
+	setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+
+	fseek(file, 0, SEEK_END);
+	if (ftell(file) == 0) {
+		CaptureHeader header;
+		memcpy(header.magic, CaptureHeader::MAGIC, sizeof(header.magic));
+		header.version = CaptureHeader::VERSION;
+		header.message_size = sizeof(Message);
+		fwrite(&header, sizeof(header), 1, file);
+	}
+
+	start_us = getMonotonicMicros();
+	write(CaptureRecord::Start, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+	return true;
+}
+
+void CaptureWriter::write(CaptureRecord::Kind kind, uint64_t id, std::span<const uint8_t> payload) {
+	static constexpr uint8_t PADDING[CAPTURE_ALIGNMENT] = {};
+
+	std::scoped_lock<std::mutex> lock{mutex};
+	if (!file) {
+		return;
+	}
+
+	CaptureRecord record;
+	record.kind = kind;
+	record.size = payload.size();
+	record.time_us = getMonotonicMicros() - start_us;
+	record.id = id;
+
+	fwrite(&record, sizeof(record), 1, file);
+	if (!payload.empty()) {
+		fwrite(payload.data(), 1, payload.size(), file);
+		fwrite(PADDING, 1, alignRecord(payload.size()) - payload.size(), file);
+	}
+}
+
+void CaptureWriter::flush() {
+	std::scoped_lock<std::mutex> lock{mutex};
+	if (file) {
+		fflush(file);
+	}
+}
+
+CaptureReader::~CaptureReader() {
+#if !defined(_WIN32)
+	if (data) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+#endif
+}
+
+bool CaptureReader::open(const std::string &path) {
+#if defined(_WIN32)
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		logError("couldn't open capture file", "path", path);
+		return false;
+	}
+
+	contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	data = contents.data();
+	size = contents.size();
+#else
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		logError("couldn't open capture file", "path", path);
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		logError("capture file is empty", "path", path);
+		::close(fd);
+		return false;
+	}
+
+	// traces can be larger than memory, the pages are read in as the replay walks over them
+	void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		logError("couldn't map capture file", "path", path);
+		return false;
+	}
+
+	madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+	data = static_cast<const uint8_t*>(mapped);
+	size = info.st_size;
+#endif
+
+	CaptureHeader header;
+	if (size < sizeof(header)) {
+		logError("not a capture file", "path", path);
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, CaptureHeader::MAGIC, sizeof(header.magic)) != 0 || header.version != CaptureHeader::VERSION) {
+		logError("not a capture file", "path", path);
+		return false;
+	} else if (header.message_size != sizeof(Message)) {
+		logError("capture file was recorded with a different message size", "path", path, "recorded", header.message_size, "expected", sizeof(Message));
+		return false;
+	}
+
+	offset = sizeof(header);
+	return true;
+}
+
+bool CaptureReader::next(CaptureRecord &record, std::span<const uint8_t> &payload) {
+	if (size - offset < sizeof(record)) {
+		return false;
+	}
+
+	// the writer always pads, a record without its padding was cut off
+	memcpy(&record, data + offset, sizeof(record));
+	if (size - offset - sizeof(record) < alignRecord(record.size)) {
+		return false;
+	}
+
+	payload = std::span<const uint8_t>(data + offset + sizeof(record), record.size);
+	offset += sizeof(record) + alignRecord(record.size);
+	return true;
+}
+
+ReplayConnection::ReplayConnection(uint64_t id) : id(id) {}
+
+std::string ReplayConnection::getAddress() const {
+	return std::format("replay:{:x}", id);
+}
+
+void ReplayConnection::flush() {
+	std::scoped_lock<std::mutex> lock{outbound_mutex};
+	bytes_sent += outbound_bytes;
+	clearOutbound();
+}
+
+void ReplayConnection::close() {
+	flush();
+	closed = true;
+}
+
+void ReplayConnection::abort() {
+	std::scoped_lock<std::mutex> lock{outbound_mutex};
+	closed = true;
+	clearOutbound();
+}
@@ -1,7 +1,18 @@
 #include "chess.hpp"
 
+#include "trace.hpp"
+
 #include <cassert>
 
+// keys end up in explorer and book files, so the numbers of a feature must never change; they are
+// mixed from the feature's index instead of being kept in a table
+static inline uint64_t getZobristNumber(uint64_t index) {
+	uint64_t z = (index + 1) * 0x9e3779b97f4a7c15;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
 void Field::init(uint32_t num_players) {
 	assert(num_players <= MAX_PLAYERS);
 
@@ -82,6 +93,8 @@ void Field::createEdge(uint32_t a, uint32_t b) {
 }
 
 uint32_t Field::calculateMoves(uint32_t start, bool mark_tiles) {
+	TraceSpan span{"calculateMoves"};
+
 	uint32_t num_reachable_tiles = 0;
 	traverseReachableTiles(start, tiles[start].figure, [&](uint32_t id, Figure) {
 		if (tiles[start].figure == Figure::King && isTileAttacked(id, tiles[start].player, false)) {
@@ -213,15 +226,102 @@ bool Field::isPlayerCheckMate(uint32_t player) {
 	return isPlayerCheck(player) && calculateMoves(players[player].king_position, false) == 0;
 }
 
+void Field::collectMoves(uint32_t player, std::vector<MoveCandidate> &moves) {
+	const uint32_t num_tiles = num_players * 32;
+	for (uint32_t from = 0; from < num_tiles; from++) {
+		if (tiles[from].figure == Figure::None || tiles[from].player != player) {
+			continue;
+		}
+
+		for (uint32_t i = 0; i < num_tiles; i++) {
+			tiles[i].move = MoveType::None;
+		}
+
+		calculateMoves(from, true);
+		for (uint32_t to = 0; to < num_tiles; to++) {
+			if (tiles[to].move != MoveType::None) {
+				moves.push_back({from, to, tiles[to].move});
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < num_tiles; i++) {
+		tiles[i].move = MoveType::None;
+	}
+}
+
+bool Field::isMoveLegal(uint32_t player, uint32_t from, uint32_t to, MoveType move) {
+	const uint32_t num_tiles = num_players * 32;
+	if (from >= num_tiles || to >= num_tiles || move == MoveType::None || tiles[from].figure == Figure::None || tiles[from].player != player) {
+		return false;
+	}
+
+	// the host's own selection may be marked on the tiles
+	MoveType marks[32 * MAX_PLAYERS];
+	for (uint32_t i = 0; i < num_tiles; i++) {
+		marks[i] = tiles[i].move;
+		tiles[i].move = MoveType::None;
+	}
+
+	calculateMoves(from, true);
+	const bool legal = tiles[to].move == move;
+
+	for (uint32_t i = 0; i < num_tiles; i++) {
+		tiles[i].move = marks[i];
+	}
+
+	return legal;
+}
+
+uint32_t Field::findPendingPromotion(uint32_t player) const {
+	for (uint32_t id = 0; id < num_players * 32; id++) {
+		if (tiles[id].figure == Figure::Pawn && tiles[id].player == player && getY(id) == 0) {
+			return id;
+		}
+	}
+	return UINT32_MAX;
+}
+
 void Field::switchToNextPlayer() {
 	for (uint32_t i = 0; i < num_players; i++) {
 		current_player = (current_player + 1) % num_players;
 		cursor_id = (cursor_id + 32) % (num_players * 32);
 
-		if (!isPlayerCheckMate(current_player)) {
+		// players that are out (checkmate or out of time) stay out
+		if (!players[current_player].is_checkmate && !isPlayerCheckMate(current_player)) {
 			break;
 		}
 
 		players[current_player].is_checkmate = true;
 	}
 }
+
+uint64_t Field::calculateKey() const {
+	enum : uint64_t {
+		// per tile, figure, owner and whether it moved
+		TILE_FEATURES = 0,
+		TURN_FEATURES = TILE_FEATURES + 32 * MAX_PLAYERS * 8 * MAX_PLAYERS * 2,
+		OUT_FEATURES = TURN_FEATURES + MAX_PLAYERS,
+		PLAYER_COUNT_FEATURES = OUT_FEATURES + MAX_PLAYERS,
+	};
+
+	uint64_t key = getZobristNumber(PLAYER_COUNT_FEATURES + num_players) ^ getZobristNumber(TURN_FEATURES + current_player);
+	for (uint32_t i = 0; i < num_players; i++) {
+		if (players[i].is_checkmate) {
+			key ^= getZobristNumber(OUT_FEATURES + i);
+		}
+	}
+
+	for (uint32_t id = 0; id < num_players * 32; id++) {
+		const Tile &tile = tiles[id];
+		if (tile.figure == Figure::None) {
+			continue;
+		}
+
+		// castling and the double step depend on it, for the other figures it makes no difference
+		const bool moved = tile.move_count > 0 && (tile.figure == Figure::King || tile.figure == Figure::Rook || tile.figure == Figure::Pawn);
+		key ^= getZobristNumber(TILE_FEATURES + ((id * 8 + uint32_t(tile.figure)) * MAX_PLAYERS + tile.player) * 2 + moved);
+	}
+
+	return key;
+}
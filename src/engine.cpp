@@ -0,0 +1,252 @@
+#include "engine.hpp"
+
+#include "record.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+static constexpr int32_t FIGURE_VALUES[] = {
+	0,   // None
+	100, // Pawn
+	330, // Bishop
+	320, // Knight
+	500, // Rook
+	900, // Queen
+	0,   // King, losing it is scored as being out
+	0,   // Any
+};
+
+static inline GameEvent::Kind getEventKind(MoveType type) {
+	switch (type) {
+		case MoveType::Capture: return GameEvent::Capture;
+		case MoveType::Castle: return GameEvent::Castle;
+		case MoveType::EnPassant: return GameEvent::EnPassant;
+		case MoveType::None:
+		case MoveType::Move: break;
+	}
+	return GameEvent::Move;
+}
+
+bool Engine::isOut(const Field &field, uint32_t player) {
+	// kings can be taken, a player without one is out even before the next turn marks them
+	const Tile &king = field.tiles[field.players[player].king_position];
+	return field.players[player].is_checkmate || king.figure != Figure::King || king.player != player;
+}
+
+Engine::Engine(const EngineOptions &options, uint64_t seed) : options(options), random(seed) {}
+
+void Engine::appendEvents(const Field &field, const EngineMove &move, std::vector<GameEvent> &events) {
+	const uint32_t player = field.current_player;
+	events.push_back(GameEvent(player, move.from, move.to, Figure::None, getEventKind(move.type)));
+
+	if (field.tiles[move.from].figure == Figure::Pawn && getY(move.to) == 0 && (move.type == MoveType::Move || move.type == MoveType::Capture)) {
+		events.push_back(GameEvent(player, move.to, 0, move.promotion, GameEvent::Promote));
+	}
+}
+
+void Engine::play(Field &field, const MoveCandidate &move) const {
+	const uint32_t player = field.current_player;
+	applyEvent(field, GameEvent(player, move.from, move.to, Figure::None, getEventKind(move.type)));
+
+	// the engine always promotes to a queen
+	if (field.tiles[move.to].figure == Figure::Pawn && getY(move.to) == 0) {
+		applyEvent(field, GameEvent(player, move.to, 0, Figure::Queen, GameEvent::Promote));
+	}
+}
+
+void Engine::collectCandidates(Field &field, std::vector<Candidate> &candidates) const {
+	std::vector<MoveCandidate> moves;
+	field.collectMoves(field.current_player, moves);
+
+	// most valuable victim by the least valuable attacker first, taking a king before anything else
+	candidates.clear();
+	for (const MoveCandidate &move : moves) {
+		const Tile &target = field.tiles[move.to];
+		int32_t order = 0;
+		if (move.type == MoveType::Capture) {
+			order = target.figure == Figure::King ? INFINITE_SCORE / 2 : FIGURE_VALUES[uint32_t(target.figure)] * 16 - FIGURE_VALUES[uint32_t(field.tiles[move.from].figure)] / 16;
+		}
+		if (field.tiles[move.from].figure == Figure::Pawn && getY(move.to) == 0) {
+			order += FIGURE_VALUES[uint32_t(Figure::Queen)];
+		}
+		candidates.push_back({move, order});
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.order > b.order; });
+}
+
+int32_t Engine::evaluate(const Field &field, uint32_t player) const {
+	if (isOut(field, player)) {
+		return -OUT_SCORE;
+	}
+
+	int32_t material[MAX_PLAYERS] = {};
+	for (uint32_t id = 0; id < field.num_players * 32; id++) {
+		const Tile &tile = field.tiles[id];
+		if (tile.figure != Figure::None && tile.player < MAX_PLAYERS) {
+			material[tile.player] += FIGURE_VALUES[std::min<uint32_t>(uint32_t(tile.figure), 7)];
+		}
+	}
+
+	// against the average of the players that are left
+	int32_t opponents = 0;
+	int32_t remaining = 0;
+	for (uint32_t i = 0; i < field.num_players; i++) {
+		if (i != player && !isOut(field, i)) {
+			opponents += material[i];
+			remaining++;
+		}
+	}
+
+	if (remaining == 0) {
+		return OUT_SCORE;
+	}
+	return material[player] - opponents / remaining;
+}
+
+int32_t Engine::search(const Field &field, uint32_t depth, int32_t alpha, int32_t beta, uint32_t player) {
+	nodes++;
+
+	// being out ends the line, sooner is worse
+	if (isOut(field, player)) {
+		return -OUT_SCORE - int32_t(depth);
+	} else if (depth == 0) {
+		return evaluate(field, player);
+	} else if (isOutOfTime()) {
+		return 0;
+	}
+
+	// collecting the moves marks tiles, so it works on a copy that the children start from
+	Field current = field;
+	std::vector<Candidate> candidates;
+	collectCandidates(current, candidates);
+	if (candidates.empty()) {
+		return evaluate(field, player);
+	}
+
+	// everyone else plays against the engine's player
+	const bool maximizing = field.current_player == player;
+	int32_t best = maximizing ? -INFINITE_SCORE : INFINITE_SCORE;
+	for (const Candidate &candidate : candidates) {
+		Field child = current;
+		play(child, candidate.move);
+
+		const int32_t score = search(child, depth - 1, alpha, beta, player);
+		if (maximizing) {
+			best = std::max(best, score);
+			alpha = std::max(alpha, score);
+		} else {
+			best = std::min(best, score);
+			beta = std::min(beta, score);
+		}
+
+		if (alpha >= beta || stopped) {
+			break;
+		}
+	}
+
+	return best;
+}
+
+std::optional<EngineMove> Engine::probeBook(const Field &field, std::span<const MoveCandidate> legal) {
+	const std::optional<BookEntry> entry = options.book->probe(field.calculateKey(), random);
+	if (!entry) {
+		return std::nullopt;
+	}
+
+	// a different position with the same key would suggest a move that isn't there
+	const auto it = std::find_if(legal.begin(), legal.end(), [&](const MoveCandidate &move) {
+		return move.from == entry->from && move.to == entry->to;
+	});
+	if (it == legal.end()) {
+		return std::nullopt;
+	}
+
+	EngineMove move;
+	move.from = it->from;
+	move.to = it->to;
+	move.type = it->type;
+	move.promotion = entry->promotion != Figure::None ? entry->promotion : Figure::Queen;
+	move.from_book = true;
+	return move;
+}
+
+std::optional<EngineMove> Engine::think(const Field &field) {
+	TraceSpan span{"think"};
+
+	Field root = field;
+	const uint32_t player = root.current_player;
+
+	std::vector<Candidate> candidates;
+	collectCandidates(root, candidates);
+	if (candidates.empty()) {
+		return std::nullopt;
+	}
+
+	if (options.book) {
+		std::vector<MoveCandidate> legal;
+		for (const Candidate &candidate : candidates) {
+			legal.push_back(candidate.move);
+		}
+
+		if (std::optional<EngineMove> move = probeBook(field, legal)) {
+			return move;
+		}
+	}
+
+	deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.think_ms);
+	nodes = 0;
+	polls = 0;
+	stopped = false;
+
+	EngineMove best;
+	best.from = candidates[0].move.from;
+	best.to = candidates[0].move.to;
+	best.type = candidates[0].move.type;
+
+	std::vector<size_t> best_moves;
+	for (uint32_t depth = 1; depth <= std::max<uint32_t>(options.max_depth, 1); depth++) {
+		// scores equal to the best are searched exactly, so the engine can pick any of them
+		int32_t best_score = -INFINITE_SCORE;
+		best_moves.clear();
+		for (size_t i = 0; i < candidates.size(); i++) {
+			Field child = root;
+			play(child, candidates[i].move);
+
+			const int32_t score = search(child, depth - 1, best_score == -INFINITE_SCORE ? -INFINITE_SCORE : best_score - 1, INFINITE_SCORE, player);
+			if (stopped) {
+				break;
+			}
+
+			if (score > best_score) {
+				best_score = score;
+				best_moves.assign(1, i);
+			} else if (score == best_score) {
+				best_moves.push_back(i);
+			}
+		}
+
+		// an interrupted depth only saw some of the moves
+		if (stopped) {
+			break;
+		}
+
+		const size_t pick = best_moves[std::uniform_int_distribution<size_t>(0, best_moves.size() - 1)(random)];
+		best.from = candidates[pick].move.from;
+		best.to = candidates[pick].move.to;
+		best.type = candidates[pick].move.type;
+		best.depth = depth;
+		best.score = best_score;
+
+		// the best move of this depth is searched first in the next one, which makes its cutoffs sooner
+		std::rotate(candidates.begin(), candidates.begin() + pick, candidates.begin() + pick + 1);
+
+		if (std::abs(best_score) >= OUT_SCORE) {
+			break;
+		}
+	}
+
+	best.nodes = nodes;
+	return best;
+}
@@ -0,0 +1,135 @@
+#include "epoch.hpp"
+
+#include "io.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+static constexpr size_t MAX_THREADS = 1024;
+static constexpr uint64_t INACTIVE = ~0ull;
+
+struct alignas(64) Slot {
+	std::atomic<uint64_t> epoch = INACTIVE;
+	std::atomic<bool> used = false;
+};
+
+struct Retired {
+	uint64_t epoch;
+	std::function<void()> deleter;
+};
+
+static std::atomic<uint64_t> global_epoch = 1;
+static Slot slots[MAX_THREADS];
+
+static std::mutex retired_mutex;
+static std::vector<Retired> retired;
+
+// every thread that ever pins gets a slot, it is given back when the thread exits
+struct ThreadSlot {
+	Slot *slot = nullptr;
+	uint32_t depth = 0;
+
+	inline ThreadSlot() {
+		for (Slot &candidate : slots) {
+			bool expected = false;
+			if (!candidate.used.load(std::memory_order_relaxed) && candidate.used.compare_exchange_strong(expected, true)) {
+				slot = &candidate;
+				return;
+			}
+		}
+
+		panic("epoch: more than {} threads", MAX_THREADS);
+	}
+
+	inline ~ThreadSlot() {
+		slot->epoch = INACTIVE;
+		slot->used = false;
+	}
+};
+
+static thread_local ThreadSlot thread_slot;
+
+// the epoch can move on once every pinned reader has seen the current one
+static bool tryAdvance() {
+	uint64_t epoch = global_epoch.load();
+	for (const Slot &slot : slots) {
+		const uint64_t local = slot.epoch.load();
+		if (local != INACTIVE && local != epoch) {
+			return false;
+		}
+	}
+
+	return global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+static void freeRetired(uint64_t before) {
+	std::vector<Retired> expired;
+	{
+		std::scoped_lock<std::mutex> lock{retired_mutex};
+		for (size_t i = 0; i < retired.size();) {
+			if (retired[i].epoch < before) {
+				expired.push_back(std::move(retired[i]));
+				retired[i] = std::move(retired.back());
+				retired.pop_back();
+			} else {
+				i++;
+			}
+		}
+	}
+
+	// deleters run without the lock, they may retire more objects
+	for (Retired &item : expired) {
+		item.deleter();
+	}
+}
+
+void EpochDomain::enter() {
+	ThreadSlot &local = thread_slot;
+	if (local.depth++ > 0) {
+		return;
+	}
+
+	// publish the epoch, then make sure it didn't move in between; a stale value only holds back reclamation
+	uint64_t epoch = global_epoch.load();
+	while (true) {
+		local.slot->epoch.store(epoch);
+		const uint64_t current = global_epoch.load();
+		if (current == epoch) {
+			break;
+		}
+		epoch = current;
+	}
+}
+
+void EpochDomain::leave() {
+	ThreadSlot &local = thread_slot;
+	if (--local.depth == 0) {
+		local.slot->epoch.store(INACTIVE, std::memory_order_release);
+	}
+}
+
+void EpochDomain::retire(std::function<void()> deleter) {
+	{
+		std::scoped_lock<std::mutex> lock{retired_mutex};
+		retired.push_back({global_epoch.load(), std::move(deleter)});
+	}
+
+	collect();
+}
+
+void EpochDomain::collect() {
+	tryAdvance();
+
+	// anything retired two epochs ago can't be reached by a pinned reader anymore
+	const uint64_t epoch = global_epoch.load();
+	if (epoch >= 2) {
+		freeRetired(epoch - 1);
+	}
+}
+
+void EpochDomain::drain() {
+	freeRetired(INACTIVE);
+}
@@ -0,0 +1,467 @@
+#include "explorer.hpp"
+
+#include "gamedb.hpp"
+#include "io.hpp"
+#include "record.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <thread>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static inline bool isSameMove(const ExplorerMove &a, const ExplorerMove &b) {
+	return a.from == b.from && a.to == b.to && a.kind == b.kind && a.promotion == b.promotion;
+}
+
+static uint64_t getStartKey(uint32_t num_players) {
+	Field field;
+	field.init(num_players);
+	return field.calculateKey();
+}
+
+OpeningExplorer::~OpeningExplorer() {
+#if !defined(_WIN32)
+	if (data) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+#endif
+}
+
+bool OpeningExplorer::open(const std::string &path) {
+#if defined(_WIN32)
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	data = contents.data();
+	size = contents.size();
+#else
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	// a lookup touches the pages of a few nodes and their moves
+	void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(mapped);
+	size = info.st_size;
+#endif
+
+	if (size < sizeof(header)) {
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, ExplorerHeader::MAGIC, sizeof(header.magic)) != 0 || header.version != ExplorerHeader::VERSION) {
+		return false;
+	} else if (size != sizeof(header) + uint64_t(header.num_nodes) * sizeof(ExplorerNode) + uint64_t(header.num_moves) * sizeof(ExplorerMove)) {
+		return false;
+	}
+
+	// the links between nodes and moves are checked when they are followed
+	nodes = std::span<const ExplorerNode>(reinterpret_cast<const ExplorerNode*>(data + sizeof(header)), header.num_nodes);
+	moves = std::span<const ExplorerMove>(reinterpret_cast<const ExplorerMove*>(nodes.data() + nodes.size()), header.num_moves);
+	return true;
+}
+
+uint32_t OpeningExplorer::findNode(uint64_t key) const {
+	const auto it = std::lower_bound(nodes.begin(), nodes.end(), key, [](const ExplorerNode &node, uint64_t key) { return node.key < key; });
+	return it != nodes.end() && it->key == key ? it - nodes.begin() : NO_NODE;
+}
+
+uint32_t OpeningExplorer::findNode(const Field &field) const {
+	return findNode(field.calculateKey());
+}
+
+uint32_t OpeningExplorer::walk(uint32_t num_players, std::span<const GameEvent> played) const {
+	if (num_players < 2 || num_players > MAX_PLAYERS) {
+		return NO_NODE;
+	}
+
+	uint32_t node = findNode(getStartKey(num_players));
+	for (const GameEvent &event : played) {
+		const std::span<const ExplorerMove> candidates = getMoves(node);
+		const auto it = std::find_if(candidates.begin(), candidates.end(), [&](const ExplorerMove &move) {
+			return move.from == event.from && move.to == event.to && (event.promotion == Figure::None || move.promotion == event.promotion);
+		});
+
+		if (it == candidates.end()) {
+			return NO_NODE;
+		}
+		node = it->child;
+	}
+
+	return node;
+}
+
+std::span<const ExplorerMove> OpeningExplorer::getMoves(uint32_t node) const {
+	if (node >= nodes.size() || nodes[node].first_move > moves.size() || nodes[node].num_moves > moves.size() - nodes[node].first_move) {
+		return {};
+	}
+	return moves.subspan(nodes[node].first_move, nodes[node].num_moves);
+}
+
+std::string OpeningExplorer::toJson(uint64_t key) const {
+	const uint32_t node = findNode(key);
+	const uint32_t num_players = node != NO_NODE ? std::min<uint32_t>(nodes[node].num_players, MAX_PLAYERS) : 0;
+
+	uint64_t games = 0;
+	std::string list;
+	for (const ExplorerMove &move : getMoves(node)) {
+		games += move.games;
+
+		list += std::format(R"({}{{"from":{},"to":{},"kind":"{}","promotion":"{}","games":{},"undecided":{},"wins":[)", list.empty() ? "" : ",",
+			move.from, move.to, GameEvent::getKindName(move.kind), move.promotion, move.games, move.undecided);
+		for (uint32_t i = 0; i < num_players; i++) {
+			list += std::format("{}{}", i > 0 ? "," : "", move.wins[i]);
+		}
+		list += "]}";
+	}
+
+	return std::format(R"({{"key":"{:016x}","players":{},"games":{},"moves":[{}]}})", key, num_players, games, list);
+}
+
+void ExplorerBuilder::addMove(uint64_t key, uint32_t num_players, const Entry &entry) {
+	Position &position = positions[key];
+	position.num_players = num_players;
+
+	for (Entry &existing : position.moves) {
+		if (isSameMove(existing.move, entry.move)) {
+			existing.move.games += entry.move.games;
+			existing.move.undecided += entry.move.undecided;
+			for (uint32_t i = 0; i < MAX_PLAYERS; i++) {
+				existing.move.wins[i] += entry.move.wins[i];
+			}
+
+			if (existing.child_key == 0) {
+				existing.child_key = entry.child_key;
+			}
+			return;
+		}
+	}
+
+	position.moves.push_back(entry);
+}
+
+void ExplorerBuilder::addGame(uint32_t num_players, const EventLog &events, uint8_t winner) {
+	if (num_players < 2 || num_players > MAX_PLAYERS) {
+		return;
+	}
+
+	num_games++;
+
+	Field field;
+	field.init(num_players);
+	uint64_t key = field.calculateKey();
+
+	uint32_t depth = 0;
+	for (size_t i = 0; i < events.size() && depth < max_depth; i++) {
+		const GameEvent &event = events[i];
+		if (event.kind == GameEvent::Check || event.kind == GameEvent::CheckMate) {
+			continue;
+		} else if (event.kind > GameEvent::EnPassant) {
+			// after a surrender or a timeout the game isn't in its opening anymore
+			break;
+		}
+
+		Entry entry = {};
+		entry.move.from = event.from;
+		entry.move.to = event.to;
+		entry.move.kind = event.kind;
+		entry.move.promotion = Figure::None;
+		entry.move.games = 1;
+		if (winner < num_players) {
+			entry.move.wins[winner] = 1;
+		} else {
+			entry.move.undecided = 1;
+		}
+
+		// a promotion belongs to the move that reached the last row
+		applyEvent(field, event);
+		if (i + 1 < events.size() && events[i + 1].kind == GameEvent::Promote && events[i + 1].from == event.to) {
+			entry.move.promotion = events[i + 1].promotion;
+			applyEvent(field, events[++i]);
+		}
+
+		entry.child_key = field.calculateKey();
+		addMove(key, num_players, entry);
+
+		key = entry.child_key;
+		depth++;
+	}
+}
+
+void ExplorerBuilder::addExplorer(const OpeningExplorer &explorer) {
+	num_games += explorer.getHeader().num_games;
+
+	const std::span<const ExplorerNode> nodes = explorer.getNodes();
+	for (uint32_t node = 0; node < nodes.size(); node++) {
+		for (const ExplorerMove &move : explorer.getMoves(node)) {
+			Entry entry;
+			entry.move = move;
+			entry.child_key = move.child < nodes.size() ? nodes[move.child].key : 0;
+			addMove(nodes[node].key, nodes[node].num_players, entry);
+		}
+	}
+}
+
+void ExplorerBuilder::merge(const ExplorerBuilder &other) {
+	num_games += other.num_games;
+	for (const auto &[key, position] : other.positions) {
+		for (const Entry &entry : position.moves) {
+			addMove(key, position.num_players, entry);
+		}
+	}
+}
+
+bool ExplorerBuilder::addDatabases(std::span<const std::string> paths, uint32_t num_threads) {
+	num_threads = std::max<uint32_t>(num_threads, 1);
+
+	for (const std::string &path : paths) {
+		GameDatabase db;
+		if (!db.open(path)) {
+			return false;
+		}
+
+		// every thread counts into its own builder, they are merged at the end; threads take whole blocks
+		// so each one is decompressed once, only a game running into the next block decompresses that one too
+		std::vector<ExplorerBuilder> builders(num_threads, ExplorerBuilder(max_depth));
+		const uint32_t num_blocks = std::max<uint32_t>(db.getBlockCount(), 1);
+		std::atomic<uint32_t> next = 0;
+		const auto work = [&](ExplorerBuilder &builder) {
+			EventLog events;
+			GameDbBlockCache cache;
+			for (uint32_t block; (block = next.fetch_add(1, std::memory_order_relaxed)) < num_blocks;) {
+				const auto [first, last] = db.getGamesInBlock(block);
+				for (uint32_t game = first; game < last; game++) {
+					if (db.getMoves(game, events, cache)) {
+						builder.addGame(db.getPlayerCount(game), events, db.getResult(game));
+					}
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (uint32_t i = 1; i < num_threads; i++) {
+			threads.emplace_back(work, std::ref(builders[i]));
+		}
+
+		work(builders[0]);
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+
+		for (const ExplorerBuilder &builder : builders) {
+			merge(builder);
+		}
+	}
+
+	return true;
+}
+
+bool ExplorerBuilder::save(const std::string &path, ExplorerBuildStats &stats) const {
+	std::vector<uint64_t> keys;
+	keys.reserve(positions.size());
+	for (const auto &[key, position] : positions) {
+		keys.push_back(key);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<ExplorerNode> nodes;
+	std::vector<ExplorerMove> moves;
+	for (uint64_t key : keys) {
+		const Position &position = positions.at(key);
+
+		std::vector<Entry> sorted = position.moves;
+		std::sort(sorted.begin(), sorted.end(), [](const Entry &a, const Entry &b) {
+			if (a.move.games != b.move.games) {
+				return a.move.games > b.move.games;
+			}
+			return a.move.from != b.move.from ? a.move.from < b.move.from : a.move.to < b.move.to;
+		});
+
+		ExplorerNode node = {};
+		node.key = key;
+		node.first_move = moves.size();
+		node.num_moves = std::min<size_t>(sorted.size(), UINT16_MAX);
+		node.num_players = position.num_players;
+		nodes.push_back(node);
+
+		for (size_t i = 0; i < node.num_moves; i++) {
+			ExplorerMove move = sorted[i].move;
+			const auto child = std::lower_bound(keys.begin(), keys.end(), sorted[i].child_key);
+			move.child = sorted[i].child_key != 0 && child != keys.end() && *child == sorted[i].child_key ? child - keys.begin() : OpeningExplorer::NO_NODE;
+			moves.push_back(move);
+		}
+	}
+
+	ExplorerHeader header = {};
+	memcpy(header.magic, ExplorerHeader::MAGIC, sizeof(header.magic));
+	header.version = ExplorerHeader::VERSION;
+	header.max_depth = max_depth;
+	header.num_games = num_games;
+	header.num_nodes = nodes.size();
+	header.num_moves = moves.size();
+
+	// a mapped explorer keeps its pages until it is closed, the new one replaces the file when it is complete
+	const std::string temporary = path + ".tmp";
+	FILE *out = fopen(temporary.c_str(), "wb");
+	if (!out) {
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+	written = written && fwrite(nodes.data(), sizeof(ExplorerNode), nodes.size(), out) == nodes.size();
+	written = written && fwrite(moves.data(), sizeof(ExplorerMove), moves.size(), out) == moves.size();
+	written = fclose(out) == 0 && written;
+
+#if defined(_WIN32)
+	remove(path.c_str());
+#endif
+
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+	stats.games = num_games;
+	stats.nodes = nodes.size();
+	stats.moves = moves.size();
+	return true;
+}
+
+static std::optional<uint64_t> parseArgument(const std::string &text, int base = 10) {
+	uint64_t value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+	if (error != std::errc() || end != text.data() + text.size()) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+int OpeningExplorer::run(const std::vector<std::string> &args) {
+	if (args.size() < 4 || (args[2] != "build" && args[2] != "merge" && args[2] != "show")) {
+		eprintln("usage: {} --explorer build <explorer> <databases>... [--depth N] [--threads N]", args[0]);
+		eprintln("       {} --explorer merge <explorer> <explorers>...", args[0]);
+		eprintln("       {} --explorer show <explorer> <players> | --key <hex>", args[0]);
+		return 1;
+	}
+
+	const std::string &path = args[3];
+	if (args[2] == "show") {
+		OpeningExplorer explorer;
+		if (!explorer.open(path)) {
+			eprintln("couldn't open explorer {}", path);
+			return 1;
+		}
+
+		std::optional<uint64_t> key;
+		if (args.size() >= 6 && args[4] == "--key") {
+			key = parseArgument(args[5], 16);
+		} else if (args.size() >= 5) {
+			const uint64_t num_players = parseArgument(args[4]).value_or(0);
+			if (num_players >= 2 && num_players <= MAX_PLAYERS) {
+				key = getStartKey(num_players);
+			}
+		}
+
+		if (!key) {
+			eprintln("a player count between 2 and {} or a key is needed", MAX_PLAYERS);
+			return 1;
+		}
+
+		const uint32_t node = explorer.findNode(key.value());
+		println("{} games up to ply {}, position {:016x}", explorer.getHeader().num_games, explorer.getHeader().max_depth, key.value());
+		for (const ExplorerMove &move : explorer.getMoves(node)) {
+			std::string wins;
+			for (uint32_t i = 0; i < explorer.getNodes()[node].num_players && i < MAX_PLAYERS; i++) {
+				wins += std::format("{}{}", i > 0 ? " " : "", move.wins[i]);
+			}
+
+			const uint64_t child = move.child != NO_NODE && move.child < explorer.getNodes().size() ? explorer.getNodes()[move.child].key : 0;
+			println("{} ({}, {}, {}) -> ({}, {}, {}): {} games, wins {}, undecided {}, next {:016x}", GameEvent::getKindName(move.kind),
+				getX(move.from), getY(move.from), getZ(move.from), getX(move.to), getY(move.to), getZ(move.to),
+				move.games, wins, move.undecided, child);
+		}
+		return 0;
+	}
+
+	uint32_t num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::optional<uint32_t> depth;
+	std::vector<std::string> inputs;
+	for (size_t i = 4; i < args.size(); i++) {
+		if (args[i] == "--depth" && i + 1 < args.size()) {
+			depth = parseArgument(args[++i]).value_or(DEFAULT_DEPTH);
+		} else if (args[i] == "--threads" && i + 1 < args.size()) {
+			num_threads = std::max<uint64_t>(parseArgument(args[++i]).value_or(1), 1);
+		} else {
+			inputs.push_back(args[i]);
+		}
+	}
+
+	// whatever is already in the explorer stays, the inputs are added to it
+	std::unique_ptr<OpeningExplorer> existing = std::make_unique<OpeningExplorer>();
+	if (!existing->open(path)) {
+		existing.reset();
+	}
+
+	ExplorerBuilder builder(depth.value_or(existing ? existing->getHeader().max_depth : DEFAULT_DEPTH));
+	if (existing) {
+		builder.addExplorer(*existing);
+		existing.reset();
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	if (args[2] == "build") {
+		if (!builder.addDatabases(inputs, num_threads)) {
+			eprintln("couldn't read the game databases");
+			return 1;
+		}
+	} else {
+		for (const std::string &input : inputs) {
+			OpeningExplorer explorer;
+			if (!explorer.open(input)) {
+				eprintln("couldn't open explorer {}", input);
+				return 1;
+			}
+			builder.addExplorer(explorer);
+		}
+	}
+
+	ExplorerBuildStats stats;
+	if (!builder.save(path, stats)) {
+		eprintln("couldn't write explorer {}", path);
+		return 1;
+	}
+
+	const uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	println("{} games up to ply {} in {} positions with {} moves, {} ms on {} threads", stats.games, builder.getMaxDepth(), stats.nodes, stats.moves, ms, num_threads);
+	return 0;
+}
@@ -0,0 +1,741 @@
+#include "gamedb.hpp"
+
+#include "io.hpp"
+#include "net.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr size_t DB_ALIGNMENT = 8;
+
+// lz77 with the sequences of lz4: a token with the number of literals in the high and the match length in the
+// low nibble, 255 bytes continuing either of them, the literals and a 16 bit distance back into the output
+static constexpr size_t MIN_MATCH = 4;
+static constexpr uint32_t MATCH_HASH_BITS = 12;
+
+static void writeLength(std::vector<uint8_t> &out, size_t length) {
+	for (; length >= 255; length -= 255) {
+		out.push_back(255);
+	}
+	out.push_back(length);
+}
+
+static void compressBlock(std::span<const uint8_t> in, std::vector<uint8_t> &out) {
+	// last position + 1 of every hashed 4 byte sequence, 0 for none
+	std::vector<uint32_t> table(1 << MATCH_HASH_BITS, 0);
+
+	const auto emit = [&](size_t anchor, size_t end, size_t distance, size_t length) {
+		const size_t literals = end - anchor;
+		const size_t extra = length > 0 ? length - MIN_MATCH : 0;
+		out.push_back(std::min<size_t>(literals, 15) << 4 | std::min<size_t>(extra, 15));
+		if (literals >= 15) {
+			writeLength(out, literals - 15);
+		}
+		out.insert(out.end(), in.begin() + anchor, in.begin() + end);
+
+		if (length > 0) {
+			out.push_back(distance & 0xff);
+			out.push_back(distance >> 8);
+			if (extra >= 15) {
+				writeLength(out, extra - 15);
+			}
+		}
+	};
+
+	size_t anchor = 0;
+	size_t pos = 0;
+	while (pos + MIN_MATCH <= in.size()) {
+		uint32_t value;
+		memcpy(&value, &in[pos], sizeof(value));
+		const uint32_t hash = (value * 2654435761u) >> (32 - MATCH_HASH_BITS);
+		const size_t candidate = table[hash];
+		table[hash] = pos + 1;
+
+		if (candidate == 0 || pos - (candidate - 1) > UINT16_MAX || memcmp(&in[candidate - 1], &in[pos], MIN_MATCH) != 0) {
+			pos++;
+			continue;
+		}
+
+		const size_t match = candidate - 1;
+		size_t length = MIN_MATCH;
+		while (pos + length < in.size() && in[match + length] == in[pos + length]) {
+			length++;
+		}
+
+		emit(anchor, pos, pos - match, length);
+		pos += length;
+		anchor = pos;
+	}
+
+	// the last sequence has no match
+	emit(anchor, in.size(), 0, 0);
+}
+
+static bool decompressBlock(std::span<const uint8_t> in, std::span<uint8_t> out) {
+	size_t ip = 0;
+	size_t op = 0;
+	const auto readLength = [&](size_t &length) {
+		uint8_t byte;
+		do {
+			if (ip >= in.size()) {
+				return false;
+			}
+			byte = in[ip++];
+			length += byte;
+		} while (byte == 255);
+		return true;
+	};
+
+	while (ip < in.size()) {
+		const uint8_t token = in[ip++];
+
+		size_t literals = token >> 4;
+		if ((literals == 15 && !readLength(literals)) || literals > in.size() - ip || literals > out.size() - op) {
+			return false;
+		}
+
+		memcpy(out.data() + op, in.data() + ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == in.size()) {
+			break;
+		} else if (in.size() - ip < 2) {
+			return false;
+		}
+
+		const size_t distance = in[ip] | (in[ip + 1] << 8);
+		ip += 2;
+
+		size_t length = token & 15;
+		if (length == 15 && !readLength(length)) {
+			return false;
+		}
+
+		length += MIN_MATCH;
+		if (distance == 0 || distance > op || length > out.size() - op) {
+			return false;
+		}
+
+		// matches can overlap what they produce
+		for (size_t i = 0; i < length; i++, op++) {
+			out[op] = out[op - distance];
+		}
+	}
+
+	return op == out.size();
+}
+
+// the first bytes of all events, then the second bytes and so on
+static void splitPlanes(std::span<const GameEvent> events, std::vector<uint8_t> &out) {
+	out.resize(events.size_bytes());
+	const uint8_t *in = reinterpret_cast<const uint8_t*>(events.data());
+	for (size_t i = 0; i < events.size(); i++) {
+		for (size_t b = 0; b < sizeof(GameEvent); b++) {
+			out[b * events.size() + i] = in[i * sizeof(GameEvent) + b];
+		}
+	}
+}
+
+static void joinPlanes(std::span<const uint8_t> planes, std::vector<GameEvent> &events) {
+	events.resize(planes.size() / sizeof(GameEvent));
+	uint8_t *out = reinterpret_cast<uint8_t*>(events.data());
+	for (size_t i = 0; i < events.size(); i++) {
+		for (size_t b = 0; b < sizeof(GameEvent); b++) {
+			out[i * sizeof(GameEvent) + b] = planes[b * events.size() + i];
+		}
+	}
+}
+
+// calls back with every index from the given number of threads, including the calling one
+template <typename F>
+static void parallelFor(size_t count, uint32_t num_threads, F callback) {
+	std::atomic<size_t> next = 0;
+	const auto work = [&]() {
+		for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+			callback(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < std::min<size_t>(num_threads, count); i++) {
+		threads.emplace_back(work);
+	}
+
+	work();
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+}
+
+// lists of game numbers that are written as one posting section, every slot's list is sorted
+static void appendPostings(const std::vector<std::vector<uint32_t>> &lists, std::vector<uint64_t> &index, std::vector<uint32_t> &postings) {
+	for (const std::vector<uint32_t> &list : lists) {
+		index.push_back(postings.size());
+		postings.insert(postings.end(), list.begin(), list.end());
+	}
+	index.push_back(postings.size());
+}
+
+template <typename T>
+static inline std::span<const uint8_t> asSectionBytes(const std::vector<T> &values) {
+	return std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(values.data()), values.size() * sizeof(T));
+}
+
+uint8_t GameDatabase::getWinner(const Field &field) {
+	uint8_t winner = NO_WINNER;
+	for (uint32_t i = 0; i < field.num_players; i++) {
+		if (!field.players[i].is_checkmate) {
+			if (winner != NO_WINNER) {
+				return NO_WINNER;
+			}
+			winner = i;
+		}
+	}
+	return winner;
+}
+
+GameDatabase::~GameDatabase() {
+#if !defined(_WIN32)
+	if (data) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+#endif
+}
+
+bool GameDatabase::build(const std::string &path, std::span<const std::string> records, uint32_t num_threads, GameDbImportStats &stats) {
+	struct ImportedGame {
+		GameRecord record;
+		uint8_t winner = NO_WINNER;
+		bool loaded = false;
+	};
+
+	// reading the files and playing them to the end to find the winner is what takes time
+	std::vector<ImportedGame> imported(records.size());
+	parallelFor(records.size(), num_threads, [&](size_t i) {
+		ImportedGame &game = imported[i];
+		if (!game.record.load(records[i])) {
+			return;
+		}
+
+		Field field;
+		game.record.seek(field, game.record.getEvents().size());
+		game.winner = getWinner(field);
+		game.loaded = true;
+	});
+
+	std::vector<std::string> names;
+	for (const ImportedGame &game : imported) {
+		if (game.loaded) {
+			for (const std::string &name : game.record.getNames()) {
+				if (!name.empty()) {
+					names.push_back(name);
+				}
+			}
+		}
+	}
+	std::sort(names.begin(), names.end());
+	names.erase(std::unique(names.begin(), names.end()), names.end());
+
+	std::vector<uint8_t> player_counts;
+	std::vector<uint8_t> results;
+	std::vector<uint32_t> lengths;
+	std::vector<uint64_t> move_starts;
+	std::vector<uint32_t> seats;
+	std::vector<std::vector<uint32_t>> by_player_count(MAX_PLAYERS + 1);
+	std::vector<std::vector<uint32_t>> by_result(MAX_PLAYERS + 1);
+	std::vector<std::vector<uint32_t>> by_name(names.size());
+	EventLog events;
+
+	for (ImportedGame &game : imported) {
+		if (!game.loaded) {
+			stats.skipped++;
+			continue;
+		}
+
+		const uint32_t number = player_counts.size();
+		const GameRecord &record = game.record;
+		player_counts.push_back(record.getPlayerCount());
+		results.push_back(game.winner);
+		lengths.push_back(record.getEvents().size());
+		move_starts.push_back(events.size());
+		events.append(record.getEvents(), 0);
+
+		by_player_count[record.getPlayerCount()].push_back(number);
+		by_result[game.winner == NO_WINNER ? MAX_PLAYERS : game.winner].push_back(number);
+
+		for (uint32_t i = 0; i < MAX_PLAYERS; i++) {
+			const std::string *name = i < record.getNames().size() && !record.getNames()[i].empty() ? &record.getNames()[i] : nullptr;
+			const uint32_t id = name ? std::lower_bound(names.begin(), names.end(), *name) - names.begin() : NO_NAME;
+			seats.push_back(id);
+
+			// a name in two seats of the same game is listed once
+			if (id != NO_NAME && (by_name[id].empty() || by_name[id].back() != number)) {
+				by_name[id].push_back(number);
+			}
+		}
+
+		// the moves are in the log now
+		game.record = GameRecord();
+	}
+	move_starts.push_back(events.size());
+
+	std::vector<uint32_t> name_offsets;
+	std::string name_data;
+	for (const std::string &name : names) {
+		name_offsets.push_back(name_data.size());
+		name_data += name;
+	}
+	name_offsets.push_back(name_data.size());
+
+	std::vector<uint64_t> player_count_index;
+	std::vector<uint64_t> result_index;
+	std::vector<uint64_t> name_index;
+	std::vector<uint32_t> postings;
+	appendPostings(by_player_count, player_count_index, postings);
+	appendPostings(by_result, result_index, postings);
+	appendPostings(by_name, name_index, postings);
+
+	// blocks are compressed independently of each other
+	const size_t num_blocks = (events.size() + EVENTS_PER_BLOCK - 1) / EVENTS_PER_BLOCK;
+	std::vector<std::vector<uint8_t>> compressed(num_blocks);
+	parallelFor(num_blocks, num_threads, [&](size_t block) {
+		std::vector<GameEvent> raw;
+		events.forEachSpan(block * EVENTS_PER_BLOCK, (block + 1) * EVENTS_PER_BLOCK, [&](std::span<const GameEvent> run) {
+			raw.insert(raw.end(), run.begin(), run.end());
+		});
+
+		std::vector<uint8_t> planes;
+		splitPlanes(raw, planes);
+		compressBlock(planes, compressed[block]);
+	});
+
+	std::vector<GameDbBlock> blocks;
+	std::vector<uint8_t> block_data;
+	for (size_t i = 0; i < num_blocks; i++) {
+		GameDbBlock block;
+		block.offset = block_data.size();
+		block.size = compressed[i].size();
+		block.raw_size = std::min<size_t>(EVENTS_PER_BLOCK, events.size() - i * EVENTS_PER_BLOCK) * sizeof(GameEvent);
+		blocks.push_back(block);
+		block_data.insert(block_data.end(), compressed[i].begin(), compressed[i].end());
+	}
+
+	GameDbHeader header = {};
+	memcpy(header.magic, GameDbHeader::MAGIC, sizeof(header.magic));
+	header.version = GameDbHeader::VERSION;
+	header.num_games = player_counts.size();
+	header.num_events = events.size();
+	header.num_names = names.size();
+	header.num_blocks = num_blocks;
+
+	std::span<const uint8_t> sections[GameDbHeader::SECTIONS];
+	sections[GameDbHeader::PlayerCounts] = asSectionBytes(player_counts);
+	sections[GameDbHeader::Results] = asSectionBytes(results);
+	sections[GameDbHeader::Lengths] = asSectionBytes(lengths);
+	sections[GameDbHeader::MoveStarts] = asSectionBytes(move_starts);
+	sections[GameDbHeader::Seats] = asSectionBytes(seats);
+	sections[GameDbHeader::Blocks] = asSectionBytes(blocks);
+	sections[GameDbHeader::BlockData] = asSectionBytes(block_data);
+	sections[GameDbHeader::NameOffsets] = asSectionBytes(name_offsets);
+	sections[GameDbHeader::NameData] = std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(name_data.data()), name_data.size());
+	sections[GameDbHeader::PlayerCountIndex] = asSectionBytes(player_count_index);
+	sections[GameDbHeader::ResultIndex] = asSectionBytes(result_index);
+	sections[GameDbHeader::NameIndex] = asSectionBytes(name_index);
+	sections[GameDbHeader::Postings] = asSectionBytes(postings);
+
+	uint64_t offset = sizeof(header);
+	for (uint32_t i = 0; i < GameDbHeader::SECTIONS; i++) {
+		header.offsets[i] = offset;
+		header.sizes[i] = sections[i].size();
+		offset = (offset + sections[i].size() + DB_ALIGNMENT - 1) & ~(DB_ALIGNMENT - 1);
+	}
+
+	// the old database stays in place until the new one is complete
+	const std::string temporary = path + ".tmp";
+	FILE *out = fopen(temporary.c_str(), "wb");
+	if (!out) {
+		return false;
+	}
+
+	static constexpr uint8_t PADDING[DB_ALIGNMENT] = {};
+	bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+	for (uint32_t i = 0; i < GameDbHeader::SECTIONS && written; i++) {
+		const size_t padding = (DB_ALIGNMENT - sections[i].size() % DB_ALIGNMENT) % DB_ALIGNMENT;
+		written = fwrite(sections[i].data(), 1, sections[i].size(), out) == sections[i].size() && fwrite(PADDING, 1, padding, out) == padding;
+	}
+	written = fclose(out) == 0 && written;
+
+#if defined(_WIN32)
+	// rename doesn't replace an existing file on windows
+	remove(path.c_str());
+#endif
+
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+	stats.games = header.num_games;
+	stats.events = header.num_events;
+	stats.raw_bytes = header.num_events * sizeof(GameEvent);
+	stats.compressed_bytes = block_data.size();
+	return true;
+}
+
+bool GameDatabase::open(const std::string &path) {
+#if defined(_WIN32)
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	data = contents.data();
+	size = contents.size();
+#else
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	// queries touch a few columns and posting lists, only those pages are read in
+	void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(mapped);
+	size = info.st_size;
+#endif
+
+	if (size < sizeof(header)) {
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, GameDbHeader::MAGIC, sizeof(header.magic)) != 0 || header.version != GameDbHeader::VERSION) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < GameDbHeader::SECTIONS; i++) {
+		if (header.offsets[i] % DB_ALIGNMENT != 0 || header.offsets[i] > size || header.sizes[i] > size - header.offsets[i]) {
+			return false;
+		}
+	}
+
+	// the accessors index the fixed width sections without checking
+	const uint64_t games = header.num_games;
+	const uint64_t expected[][2] = {
+		{GameDbHeader::PlayerCounts, games},
+		{GameDbHeader::Results, games},
+		{GameDbHeader::Lengths, games * sizeof(uint32_t)},
+		{GameDbHeader::MoveStarts, (games + 1) * sizeof(uint64_t)},
+		{GameDbHeader::Seats, games * MAX_PLAYERS * sizeof(uint32_t)},
+		{GameDbHeader::Blocks, header.num_blocks * sizeof(GameDbBlock)},
+		{GameDbHeader::NameOffsets, (header.num_names + uint64_t(1)) * sizeof(uint32_t)},
+		{GameDbHeader::PlayerCountIndex, (MAX_PLAYERS + 2) * sizeof(uint64_t)},
+		{GameDbHeader::ResultIndex, (MAX_PLAYERS + 2) * sizeof(uint64_t)},
+		{GameDbHeader::NameIndex, (header.num_names + uint64_t(1)) * sizeof(uint64_t)},
+	};
+
+	for (const auto &[section, bytes] : expected) {
+		if (header.sizes[section] != bytes) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::string_view GameDatabase::getName(uint32_t id) const {
+	const std::span<const uint32_t> offsets = getSection<uint32_t>(GameDbHeader::NameOffsets);
+	const std::span<const char> names = getSection<char>(GameDbHeader::NameData);
+	if (id >= header.num_names || offsets[id] > offsets[id + 1] || offsets[id + 1] > names.size()) {
+		return {};
+	}
+
+	return std::string_view(names.data() + offsets[id], offsets[id + 1] - offsets[id]);
+}
+
+std::span<const uint32_t> GameDatabase::getPostings(GameDbHeader::Section index, size_t slot) const {
+	const std::span<const uint64_t> offsets = getSection<uint64_t>(index);
+	const std::span<const uint32_t> postings = getSection<uint32_t>(GameDbHeader::Postings);
+	if (slot + 1 >= offsets.size() || offsets[slot] > offsets[slot + 1] || offsets[slot + 1] > postings.size()) {
+		return {};
+	}
+
+	return postings.subspan(offsets[slot], offsets[slot + 1] - offsets[slot]);
+}
+
+std::vector<std::string_view> GameDatabase::getNames(uint32_t game) const {
+	const std::span<const uint32_t> seats = getSection<uint32_t>(GameDbHeader::Seats).subspan(game * MAX_PLAYERS, MAX_PLAYERS);
+
+	std::vector<std::string_view> names;
+	for (uint32_t i = 0; i < std::min<uint32_t>(getPlayerCount(game), MAX_PLAYERS); i++) {
+		names.push_back(seats[i] == NO_NAME ? std::string_view() : getName(seats[i]));
+	}
+	return names;
+}
+
+bool GameDatabase::getMoves(uint32_t game, EventLog &events) const {
+	GameDbBlockCache cache;
+	return getMoves(game, events, cache);
+}
+
+bool GameDatabase::getMoves(uint32_t game, EventLog &events, GameDbBlockCache &cache) const {
+	events.clear();
+
+	const std::span<const uint64_t> starts = getSection<uint64_t>(GameDbHeader::MoveStarts);
+	const std::span<const GameDbBlock> blocks = getSection<GameDbBlock>(GameDbHeader::Blocks);
+	const std::span<const uint8_t> block_data = getSection<uint8_t>(GameDbHeader::BlockData);
+
+	const uint64_t begin = starts[game];
+	const uint64_t end = starts[game + 1];
+	if (begin > end || end > header.num_events) {
+		return false;
+	}
+
+	for (uint64_t first = begin; first < end;) {
+		const uint64_t index = first / EVENTS_PER_BLOCK;
+		if (index >= blocks.size()) {
+			return false;
+		}
+
+		if (index != cache.index) {
+			const GameDbBlock &block = blocks[index];
+			if (block.offset > block_data.size() || block.size > block_data.size() - block.offset || block.raw_size % sizeof(GameEvent) != 0) {
+				return false;
+			}
+
+			cache.index = UINT64_MAX;
+			cache.planes.resize(block.raw_size);
+			if (!decompressBlock(block_data.subspan(block.offset, block.size), cache.planes)) {
+				return false;
+			}
+			joinPlanes(cache.planes, cache.events);
+			cache.index = index;
+		}
+
+		const uint64_t block_start = index * EVENTS_PER_BLOCK;
+		const uint64_t last = std::min<uint64_t>(end, block_start + cache.events.size());
+		if (last <= first) {
+			return false;
+		}
+
+		events.append(std::span<const GameEvent>(cache.events).subspan(first - block_start, last - first));
+		first = last;
+	}
+
+	return true;
+}
+
+std::pair<uint32_t, uint32_t> GameDatabase::getGamesInBlock(uint32_t block) const {
+	const std::span<const uint64_t> starts = getSection<uint64_t>(GameDbHeader::MoveStarts).first(header.num_games);
+	const auto first = std::lower_bound(starts.begin(), starts.end(), uint64_t(block) * EVENTS_PER_BLOCK);
+	const auto last = block + 1 >= header.num_blocks ? starts.end() : std::lower_bound(first, starts.end(), uint64_t(block + 1) * EVENTS_PER_BLOCK);
+	return {uint32_t(first - starts.begin()), uint32_t(last - starts.begin())};
+}
+
+bool GameDatabase::getRecord(uint32_t game, GameRecord &record) const {
+	EventLog events;
+	if (!getMoves(game, events)) {
+		return false;
+	}
+
+	std::vector<std::string> names;
+	for (std::string_view name : getNames(game)) {
+		names.emplace_back(name);
+	}
+
+	record.create(getPlayerCount(game), names, events);
+	return true;
+}
+
+std::span<const uint32_t> GameDatabase::findByPlayerCount(uint32_t num_players) const {
+	return num_players <= MAX_PLAYERS ? getPostings(GameDbHeader::PlayerCountIndex, num_players) : std::span<const uint32_t>();
+}
+
+std::span<const uint32_t> GameDatabase::findByResult(uint8_t winner) const {
+	if (winner == NO_WINNER) {
+		return getPostings(GameDbHeader::ResultIndex, MAX_PLAYERS);
+	}
+	return winner < MAX_PLAYERS ? getPostings(GameDbHeader::ResultIndex, winner) : std::span<const uint32_t>();
+}
+
+std::span<const uint32_t> GameDatabase::findByPlayer(std::string_view name) const {
+	uint32_t low = 0;
+	uint32_t high = header.num_names;
+	while (low < high) {
+		const uint32_t middle = low + (high - low) / 2;
+		if (getName(middle) < name) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	if (low == header.num_names || getName(low) != name) {
+		return {};
+	}
+	return getPostings(GameDbHeader::NameIndex, low);
+}
+
+std::vector<uint32_t> GameDatabase::find(const GameDbQuery &query) const {
+	std::vector<std::span<const uint32_t>> lists;
+	if (query.num_players) {
+		lists.push_back(findByPlayerCount(query.num_players.value()));
+	}
+	if (query.winner) {
+		lists.push_back(query.winner.value() <= NO_WINNER ? findByResult(query.winner.value()) : std::span<const uint32_t>());
+	}
+	if (query.player) {
+		lists.push_back(findByPlayer(query.player.value()));
+	}
+
+	std::vector<uint32_t> found;
+	if (lists.empty()) {
+		found.resize(header.num_games);
+		for (uint32_t i = 0; i < header.num_games; i++) {
+			found[i] = i;
+		}
+		return found;
+	}
+
+	// the shortest list is filtered by the others, a much longer one is searched instead of walked
+	std::sort(lists.begin(), lists.end(), [](std::span<const uint32_t> a, std::span<const uint32_t> b) { return a.size() < b.size(); });
+	found.assign(lists[0].begin(), lists[0].end());
+	for (size_t i = 1; i < lists.size() && !found.empty(); i++) {
+		const std::span<const uint32_t> other = lists[i];
+		if (other.size() > found.size() * 16) {
+			std::erase_if(found, [&](uint32_t game) { return !std::binary_search(other.begin(), other.end(), game); });
+		} else {
+			std::vector<uint32_t> both;
+			std::set_intersection(found.begin(), found.end(), other.begin(), other.end(), std::back_inserter(both));
+			found = std::move(both);
+		}
+	}
+
+	return found;
+}
+
+static std::optional<uint64_t> parseArgument(const std::string &text) {
+	uint64_t value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+	if (error != std::errc() || end != text.data() + text.size()) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+int GameDatabase::run(const std::vector<std::string> &args) {
+	if (args.size() < 4 || (args[2] != "import" && args[2] != "query")) {
+		eprintln("usage: {} --game-db import <db> <records or directories>... [--threads N]", args[0]);
+		eprintln("       {} --game-db query <db> [--players N] [--winner <seat>|none] [--name <player>] [--limit N] [--text]", args[0]);
+		return 1;
+	}
+
+	const std::string &path = args[3];
+	if (args[2] == "import") {
+		uint32_t num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+		std::vector<std::string> records;
+		for (size_t i = 4; i < args.size(); i++) {
+			if (args[i] == "--threads" && i + 1 < args.size()) {
+				num_threads = std::max<uint64_t>(parseArgument(args[++i]).value_or(1), 1);
+			} else if (std::filesystem::is_directory(args[i])) {
+				std::vector<std::string> found;
+				for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(args[i])) {
+					if (entry.path().extension() == ".rec") {
+						found.push_back(entry.path().string());
+					}
+				}
+
+				std::sort(found.begin(), found.end());
+				records.insert(records.end(), found.begin(), found.end());
+			} else {
+				records.push_back(args[i]);
+			}
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		GameDbImportStats stats;
+		if (!build(path, records, num_threads, stats)) {
+			eprintln("couldn't write game database {}", path);
+			return 1;
+		}
+
+		const uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+		println("imported {} games with {} events in {} ms on {} threads, skipped {}, moves {} bytes compressed to {}",
+			stats.games, stats.events, ms, num_threads, stats.skipped, stats.raw_bytes, stats.compressed_bytes);
+		return 0;
+	}
+
+	GameDbQuery query;
+	size_t limit = 20;
+	bool text = false;
+	for (size_t i = 4; i < args.size(); i++) {
+		if (args[i] == "--players" && i + 1 < args.size()) {
+			query.num_players = parseArgument(args[++i]).value_or(0);
+		} else if (args[i] == "--winner" && i + 1 < args.size()) {
+			query.winner = args[++i] == "none" ? NO_WINNER : parseArgument(args[i]).value_or(MAX_PLAYERS);
+		} else if (args[i] == "--name" && i + 1 < args.size()) {
+			query.player = args[++i];
+		} else if (args[i] == "--limit" && i + 1 < args.size()) {
+			limit = parseArgument(args[++i]).value_or(limit);
+		} else if (args[i] == "--text") {
+			text = true;
+		}
+	}
+
+	GameDatabase db;
+	if (!db.open(path)) {
+		eprintln("couldn't open game database {}", path);
+		return 1;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const std::vector<uint32_t> games = db.find(query);
+	const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	println("{} of {} games in {} us", games.size(), db.getGameCount(), us);
+
+	for (size_t i = 0; i < std::min(limit, games.size()); i++) {
+		const uint32_t game = games[i];
+		std::string names;
+		for (std::string_view name : db.getNames(game)) {
+			names += names.empty() ? "" : ", ";
+			names += name;
+		}
+
+		const uint8_t winner = db.getResult(game);
+		println("{}: {} players, {} plies, winner {}, {}", game, db.getPlayerCount(game), db.getLength(game),
+			winner == NO_WINNER ? std::string("none") : std::to_string(winner), names);
+
+		GameRecord record;
+		if (text && db.getRecord(game, record)) {
+			print("{}\n", record.toText());
+		}
+	}
+
+	return 0;
+}
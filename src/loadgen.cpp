@@ -0,0 +1,535 @@
+#include "loadgen.hpp"
+
+#include "io.hpp"
+#include "net.hpp"
+
+#include "httplib.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// false if the text isn't a number or doesn't fit the target, which keeps its value then
+template <typename T>
+static bool parseArgument(const std::string &text, T &target, int base = 10) {
+	uint64_t value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+	if (error != std::errc() || end != text.data() + text.size() || value > std::numeric_limits<T>::max()) {
+		return false;
+	}
+	target = value;
+	return true;
+}
+
+static std::optional<double> parseNumber(const std::string &text) {
+	double value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+	if (error != std::errc() || end != text.data() + text.size()) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+// samples have to be sorted
+static uint64_t getPercentile(const std::vector<uint64_t> &samples, double p) {
+	return samples.empty() ? 0 : samples[std::min<size_t>(samples.size() - 1, samples.size() * p)];
+}
+
+// count, p50, p99, p999 and max of the samples in microseconds
+static std::string formatLatencies(std::vector<uint64_t> &samples) {
+	if (samples.empty()) {
+		return R"({"count":0})";
+	}
+
+	std::sort(samples.begin(), samples.end());
+	return std::format(R"({{"count":{},"p50":{},"p99":{},"p999":{},"max":{}}})", samples.size(),
+		getPercentile(samples, 0.5), getPercentile(samples, 0.99), getPercentile(samples, 0.999), samples.back());
+}
+
+// loadgen [--host <host>] [--port N] [--http-port N] [--clients N] [--players N] [--join-rate N] [--duration s] [--moves N]
+//         [--compare <main binary> [--backends sdl,io_uring]]
+LoadGen::LoadGen(const std::vector<std::string> &args) {
+	const auto parse = [&](size_t &i, auto &target) {
+		if (!parseArgument(args[i + 1], target)) {
+			eprintln("invalid value {} for {}", args[i + 1], args[i]);
+			valid = false;
+		}
+		i++;
+	};
+
+	for (size_t i = 1; i < args.size(); i++) {
+		if (args[i] == "--host" && i + 1 < args.size()) {
+			hostname = args[++i];
+		} else if (args[i] == "--port" && i + 1 < args.size()) {
+			parse(i, port);
+		} else if (args[i] == "--http-port" && i + 1 < args.size()) {
+			parse(i, http_port);
+		} else if (args[i] == "--clients" && i + 1 < args.size()) {
+			parse(i, num_clients);
+		} else if (args[i] == "--players" && i + 1 < args.size()) {
+			parse(i, num_players);
+			num_players = std::clamp<uint32_t>(num_players, 2, MAX_PLAYERS);
+		} else if (args[i] == "--join-rate" && i + 1 < args.size()) {
+			if (const std::optional<double> rate = parseNumber(args[++i])) {
+				join_rate = std::max(rate.value(), 0.001);
+			} else {
+				eprintln("invalid value {} for --join-rate", args[i]);
+				valid = false;
+			}
+		} else if (args[i] == "--duration" && i + 1 < args.size()) {
+			parse(i, duration_s);
+		} else if (args[i] == "--moves" && i + 1 < args.size()) {
+			parse(i, max_moves);
+		} else {
+			eprintln("unknown argument {}", args[i]);
+		}
+	}
+}
+
+LoadGen::~LoadGen() {
+	for (const std::unique_ptr<LoadClient> &client : clients) {
+		if (client->socket) {
+			SDLNet_DestroyStreamSocket(client->socket);
+		}
+	}
+
+	if (address) {
+		SDLNet_UnrefAddress(address);
+	}
+}
+
+int LoadGen::run() {
+	if (!valid) {
+		return 1;
+	}
+
+	address = SDLNet_ResolveHostname(hostname.c_str());
+	if (!address || SDLNet_WaitUntilResolved(address, -1) != 1) {
+		eprintln("couldn't resolve hostname ({}): {}", hostname, SDL_GetError());
+		return 1;
+	}
+
+	if (!createSessions()) {
+		return 1;
+	}
+
+	eprintln("opening {} connections to {}:{} at {} per second, {} players in each of {} sessions", num_clients, hostname, port, join_rate, num_players, sessions.size());
+
+	const uint64_t start = getMonotonicMicros();
+	const uint64_t deadline = start + uint64_t(duration_s) * 1000 * 1000;
+	uint64_t now = start;
+
+	std::vector<void*> sockets;
+	while (now < deadline) {
+		// connections are opened on a fixed schedule, a slow server doesn't slow down the arrivals
+		while (clients.size() < num_clients && double(now - start) * join_rate >= double(clients.size()) * 1000 * 1000) {
+			openClient(clients.size(), now);
+		}
+
+		bool active = clients.size() < num_clients;
+		sockets.clear();
+		for (const std::unique_ptr<LoadClient> &client : clients) {
+			if (client->state == LoadClient::Connecting) {
+				pollConnecting(*client);
+			}
+
+			if (client->state == LoadClient::Connecting || client->state == LoadClient::Joining || client->state == LoadClient::Playing) {
+				active = true;
+			}
+
+			if (client->socket && client->state != LoadClient::Connecting) {
+				sockets.push_back(client->socket);
+			}
+		}
+
+		if (!active) {
+			break;
+		}
+
+		if (sockets.empty()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		} else {
+			SDLNet_WaitUntilInputAvailable(sockets.data(), sockets.size(), 10);
+		}
+
+		now = getMonotonicMicros();
+		for (const std::unique_ptr<LoadClient> &client : clients) {
+			if (client->socket && client->state != LoadClient::Connecting) {
+				readClient(*client, now);
+			}
+
+			if (client->state == LoadClient::Playing && !client->waiting && client->field.current_player == client->player && !client->field.players[client->player].is_checkmate) {
+				makeMove(*client, now);
+			}
+		}
+
+		now = getMonotonicMicros();
+	}
+
+	result = report(now - start);
+	return 0;
+}
+
+bool LoadGen::waitForServer(uint32_t timeout_ms) {
+	httplib::Client http(hostname, http_port);
+	http.set_connection_timeout(std::chrono::milliseconds(100));
+
+	const uint64_t deadline = getMonotonicMicros() + uint64_t(timeout_ms) * 1000;
+	while (getMonotonicMicros() < deadline) {
+		if (httplib::Result result = http.Get("/sessions"); result && result->status == 200) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	return false;
+}
+
+std::string LoadGen::summarize() const {
+	return std::format("{:.1f} moves/s, move rtt p50 {} us p99 {} us p999 {} us, join p99 {} us, {} failed connects, {} disconnects",
+		moves_per_s, getPercentile(move_latencies_us, 0.5), getPercentile(move_latencies_us, 0.99), getPercentile(move_latencies_us, 0.999),
+		getPercentile(join_latencies_us, 0.99), failed_connects, disconnects);
+}
+
+bool LoadGen::createSessions() {
+	httplib::Client http(hostname, http_port);
+
+	const uint32_t count = (num_clients + num_players - 1) / num_players;
+	for (uint32_t i = 0; i < count; i++) {
+		httplib::Result result = http.Post(std::format("/sessions?players={}", num_players), "", "text/plain");
+		if (!result || result->status != 201) {
+			eprintln("couldn't create a session on {}:{}", hostname, http_port);
+			return false;
+		}
+
+		const std::string &body = result->body;
+		const size_t start = body.find(R"("id":")");
+		if (start == std::string::npos) {
+			eprintln("unexpected response {}", body);
+			return false;
+		}
+
+		uint64_t id;
+		if (!parseArgument(body.substr(start + 6, body.find('"', start + 6) - start - 6), id, 16)) {
+			eprintln("unexpected response {}", body);
+			return false;
+		}
+		sessions.push_back(id);
+	}
+
+	return true;
+}
+
+void LoadGen::openClient(uint32_t index, uint64_t now) {
+	std::unique_ptr<LoadClient> client = std::make_unique<LoadClient>();
+	client->index = index;
+	client->session = sessions[index / num_players];
+	client->connect_us = now;
+	client->socket = SDLNet_CreateClient(address, port);
+
+	if (!client->socket) {
+		failed_connects++;
+		client->state = LoadClient::Closed;
+	}
+
+	clients.push_back(std::move(client));
+}
+
+void LoadGen::pollConnecting(LoadClient &client) {
+	const int status = SDLNet_GetConnectionStatus(client.socket);
+	if (status == 0) {
+		return;
+	}
+
+	if (status < 0 || !sendMessage(client, Message::makeJoin(client.session, ~0u, std::format("load{}", client.index)))) {
+		failed_connects++;
+		close(client);
+		return;
+	}
+
+	client.state = LoadClient::Joining;
+}
+
+void LoadGen::readClient(LoadClient &client, uint64_t now) {
+	uint8_t buffer[16384];
+	while (client.socket) {
+		const int received = SDLNet_ReadFromStreamSocket(client.socket, buffer, sizeof(buffer));
+		if (received < 0) {
+			disconnects++;
+			close(client);
+			return;
+		} else if (received == 0) {
+			return;
+		}
+
+		bytes_received += received;
+		receive(client, std::span<const uint8_t>(buffer, received), now);
+	}
+}
+
+void LoadGen::receive(LoadClient &client, std::span<const uint8_t> data, uint64_t now) {
+	client.stream.insert(client.stream.end(), data.begin(), data.end());
+
+	size_t offset = 0;
+	while (client.socket) {
+		if (client.tiles_expected > 0) {
+			if (client.stream.size() - offset < client.tiles_expected) {
+				break;
+			}
+
+			memcpy(client.field.tiles, client.stream.data() + offset, client.tiles_expected);
+			offset += client.tiles_expected;
+			client.tiles_expected = 0;
+
+			// joined once the snapshot is complete, the same moment the native client can draw the board
+			client.state = LoadClient::Playing;
+			join_latencies_us.push_back(now - client.connect_us);
+			continue;
+		}
+
+		if (client.stream.size() - offset < sizeof(Message)) {
+			break;
+		}
+
+		Message msg;
+		memcpy(&msg, client.stream.data() + offset, sizeof(Message));
+		offset += sizeof(Message);
+		messages_received++;
+		handleMessage(client, msg, now);
+	}
+
+	if (client.socket) {
+		client.stream.erase(client.stream.begin(), client.stream.begin() + offset);
+	}
+}
+
+void LoadGen::handleMessage(LoadClient &client, const Message &msg, uint64_t now) {
+	switch (msg.type) {
+		case Message::Accept: {
+			// the snapshot is copied into the tiles, a broken server mustn't make that overflow
+			if (msg.accept.num_players < 2 || msg.accept.num_players > MAX_PLAYERS || msg.player >= msg.accept.num_players) {
+				rejects++;
+				close(client);
+				break;
+			}
+
+			client.field.init(msg.accept.num_players);
+			client.field.current_player = msg.accept.current_player;
+			client.player = msg.player;
+			client.tiles_expected = sizeof(Tile) * 32 * msg.accept.num_players;
+		} break;
+		case Message::Reject: {
+			rejects++;
+			close(client);
+		} break;
+		case Message::Ping: {
+			sendMessage(client, Message::makePong(msg.ping.timestamp_us));
+		} break;
+		case Message::Move: {
+			if (msg.move.from >= client.field.num_players * 32 || msg.move.to >= client.field.num_players * 32) {
+				break;
+			}
+
+			client.field.current_player = msg.move.next_player;
+			client.field.moveFigure(msg.move.from, msg.move.to, msg.move.type);
+
+			if (msg.player == client.player && client.waiting) {
+				move_latencies_us.push_back(now - client.sent_us);
+				client.waiting = false;
+
+				// a pawn that reached the last row has to be promoted before the turn is over
+				if (client.field.tiles[msg.move.to].figure == Figure::Pawn && getY(msg.move.to) == 0) {
+					client.sent_us = now;
+					client.waiting = sendMessage(client, Message::makePromotion(client.player, msg.move.to, Figure::Queen));
+				}
+			}
+		} break;
+		case Message::Promotion: {
+			if (msg.promotion.id >= client.field.num_players * 32) {
+				break;
+			}
+
+			client.field.current_player = msg.promotion.next_player;
+			client.field.tiles[msg.promotion.id].figure = msg.promotion.figure;
+
+			if (msg.player == client.player && client.waiting) {
+				move_latencies_us.push_back(now - client.sent_us);
+				client.waiting = false;
+			}
+		} break;
+		case Message::Clock: {
+			if (msg.player >= client.field.num_players) {
+				break;
+			}
+
+			client.field.current_player = msg.clock.next_player;
+			if (msg.clock.remaining_ms == 0) {
+				client.field.players[msg.player].is_checkmate = true;
+				if (msg.player == client.player) {
+					client.waiting = false;
+					client.state = LoadClient::Done;
+				}
+			}
+		} break;
+		default: break;
+	}
+}
+
+void LoadGen::makeMove(LoadClient &client, uint64_t now) {
+	if (client.moves >= max_moves) {
+		client.state = LoadClient::Done;
+		return;
+	}
+
+	std::vector<MoveCandidate> candidates;
+	client.field.collectMoves(client.player, candidates);
+
+	// stalemate, nobody in this session gets another turn
+	if (candidates.empty()) {
+		stalled++;
+		client.state = LoadClient::Done;
+		return;
+	}
+
+	const MoveCandidate &move = candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(random)];
+	client.sent_us = now;
+	client.waiting = sendMessage(client, Message::makeMove(client.player, move.from, move.to, move.type));
+	client.moves++;
+}
+
+bool LoadGen::sendMessage(LoadClient &client, const Message &msg) {
+	if (SDLNet_WriteToStreamSocket(client.socket, &msg, sizeof(msg)) != 0) {
+		disconnects++;
+		close(client);
+		return false;
+	}
+
+	return true;
+}
+
+void LoadGen::close(LoadClient &client) {
+	if (client.socket) {
+		SDLNet_DestroyStreamSocket(client.socket);
+		client.socket = nullptr;
+	}
+
+	client.state = LoadClient::Closed;
+}
+
+std::string LoadGen::report(uint64_t elapsed_us) {
+	uint32_t connected = 0, playing = 0;
+	uint64_t moves = 0;
+	for (const std::unique_ptr<LoadClient> &client : clients) {
+		connected += client->state != LoadClient::Connecting && client->socket != nullptr;
+		playing += client->state == LoadClient::Playing;
+		moves += client->moves;
+	}
+
+	const double seconds = std::max(double(elapsed_us) / 1000 / 1000, 0.001);
+	moves_per_s = double(moves) / seconds;
+	return std::format(R"({{"clients":{},"players":{},"sessions":{},"elapsed_s":{:.3f},"connected":{},"still_playing":{},"failed_connects":{},"rejects":{},"disconnects":{},"stalled":{},)"
+		R"("moves":{},"moves_per_s":{:.1f},"messages_received":{},"messages_per_s":{:.1f},"bytes_received":{},"join_latency_us":{},"move_rtt_us":{}}})",
+		num_clients, num_players, sessions.size(), seconds, connected, playing, failed_connects, rejects, disconnects, stalled,
+		moves, double(moves) / seconds, messages_received, double(messages_received) / seconds, bytes_received,
+		formatLatencies(join_latencies_us), formatLatencies(move_latencies_us));
+}
+
+// runs the same load against a headless server started once per backend, one after the other on the same ports;
+// a server that falls back to sdl because io_uring isn't available says so in its log
+static int compareBackends(const std::string &binary, const std::vector<std::string> &backends, const std::vector<std::string> &args) {
+#if defined(_WIN32)
+	eprintln("--compare isn't supported on this platform");
+	return 1;
+#else
+	std::string results;
+	std::vector<std::string> summaries;
+
+	for (const std::string &backend : backends) {
+		const pid_t pid = fork();
+		if (pid == 0) {
+			execl(binary.c_str(), binary.c_str(), "--headless", "--net", backend.c_str(), "--log-level", "warn", nullptr);
+			_exit(127);
+		} else if (pid < 0) {
+			eprintln("couldn't start {}: {}", binary, strerror(errno));
+			return 1;
+		}
+
+		LoadGen loadgen(args);
+		const bool ready = loadgen.waitForServer(10000);
+		const int status = ready ? loadgen.run() : 1;
+
+		kill(pid, SIGTERM);
+		waitpid(pid, nullptr, 0);
+
+		if (!ready) {
+			eprintln("the server with the {} backend didn't come up", backend);
+			return 1;
+		} else if (status != 0) {
+			return status;
+		}
+
+		results += std::format("{}\"{}\":{}", results.empty() ? "" : ",", backend, loadgen.getReport());
+		summaries.push_back(std::format("{}: {}", backend, loadgen.summarize()));
+	}
+
+	for (const std::string &summary : summaries) {
+		eprintln("{}", summary);
+	}
+	println("{{{}}}", results);
+	return 0;
+#endif
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<std::string> args(argv, argv + argc);
+
+	// loadgen --compare <main binary> [--backends sdl,io_uring] ...
+	std::string compare_binary;
+	std::vector<std::string> backends = {"sdl", "io_uring"};
+	for (size_t i = 1; i + 1 < args.size();) {
+		if (args[i] == "--compare") {
+			compare_binary = args[i + 1];
+		} else if (args[i] == "--backends") {
+			backends.clear();
+			for (size_t start = 0; start <= args[i + 1].size();) {
+				const size_t end = std::min(args[i + 1].find(',', start), args[i + 1].size());
+				if (end > start) {
+					backends.push_back(args[i + 1].substr(start, end - start));
+				}
+				start = end + 1;
+			}
+		} else {
+			i++;
+			continue;
+		}
+		args.erase(args.begin() + i, args.begin() + i + 2);
+	}
+
+	if (SDLNet_Init() != 0) {
+		panic("Failed to initialize SDL_net");
+	}
+
+	int result;
+	if (!compare_binary.empty()) {
+		result = compareBackends(compare_binary, backends, args);
+	} else {
+		LoadGen loadgen(args);
+		result = loadgen.run();
+		if (result == 0) {
+			println("{}", loadgen.getReport());
+		}
+	}
+
+	SDLNet_Quit();
+	return result;
+}
@@ -0,0 +1,237 @@
+#include "log.hpp"
+
+#include "io.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+// the ring of the calling thread, the writer frees it once the thread exited and it was drained
+static thread_local std::shared_ptr<LogRing> local_ring;
+
+Logger::Logger() {
+	writer = std::thread([this](){ run(); });
+	panic_hook = []() {
+		Logger::get().flush();
+	};
+}
+
+Logger::~Logger() {
+	panic_hook = nullptr;
+	{
+		std::scoped_lock<std::mutex> lock{wakeup_mutex};
+		stopping = true;
+	}
+
+	wakeup.notify_one();
+	writer.join();
+
+	// lines other threads queued while the writer was stopping
+	flush();
+}
+
+std::optional<LogLevel> Logger::parseLevel(std::string_view name) {
+	for (LogLevel level : {LogLevel::Debug, LogLevel::Info, LogLevel::Warn, LogLevel::Error}) {
+		if (name == getLevelName(level)) {
+			return level;
+		}
+	}
+
+	return {};
+}
+
+std::string_view Logger::getLevelName(LogLevel level) {
+	switch (level) {
+		case LogLevel::Debug: return "debug";
+		case LogLevel::Info: return "info";
+		case LogLevel::Warn: return "warn";
+		case LogLevel::Error: return "error";
+	}
+	return "unknown";
+}
+
+void Logger::flush() {
+	std::string out, err;
+	drain(out, err);
+}
+
+void Logger::appendString(std::string_view text, std::string &out) {
+	const bool quote = text.empty() || std::any_of(text.begin(), text.end(), [](char c) {
+		return c == ' ' || c == '"' || c == '=' || c == '\n';
+	});
+
+	if (!quote) {
+		out += text;
+		return;
+	}
+
+	out += '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (c == '\n') {
+			out += "\\n";
+		} else {
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+uint8_t *Logger::reserve(size_t size) {
+	if (!local_ring) {
+		local_ring = std::make_shared<LogRing>();
+		std::scoped_lock<std::mutex> lock{rings_mutex};
+		rings.push_back(local_ring);
+	}
+
+	LogRing &ring = *local_ring;
+	const uint64_t head = ring.head.load(std::memory_order_relaxed);
+	const uint64_t tail = ring.tail.load(std::memory_order_acquire);
+
+	// records don't wrap, the rest of the ring is skipped when it is too small
+	const size_t position = head % LogRing::CAPACITY;
+	const size_t skip = LogRing::CAPACITY - position < size ? LogRing::CAPACITY - position : 0;
+
+	if (size > LogRing::CAPACITY / 2 || LogRing::CAPACITY - (head - tail) < skip + size) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	// a busy thread gets the writer going before its ring fills up, otherwise nobody waits for it
+	if (head - tail + skip + size > LogRing::CAPACITY / 2) {
+		wakeup.notify_one();
+	}
+
+	// the writer skips gaps too small for a header on its own
+	if (skip >= sizeof(LogRecord)) {
+		LogRecord padding;
+		padding.size = skip;
+		padding.render = nullptr;
+		memcpy(&ring.data[position], &padding, sizeof(padding));
+	}
+
+	if (skip > 0) {
+		ring.head.store(head + skip, std::memory_order_release);
+		return &ring.data[0];
+	}
+
+	return &ring.data[position];
+}
+
+void Logger::commit(size_t size) {
+	LogRing &ring = *local_ring;
+	ring.head.store(ring.head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+}
+
+void Logger::run() {
+	std::string out, err;
+	while (true) {
+		const bool drained = drain(out, err);
+
+		std::unique_lock<std::mutex> lock{wakeup_mutex};
+		if (stopping) {
+			lock.unlock();
+			drain(out, err);
+			return;
+		}
+
+		// lines are picked up every few milliseconds when it is quiet
+		if (!drained) {
+			wakeup.wait_for(lock, std::chrono::milliseconds(10));
+		}
+	}
+}
+
+// renders the queued lines of all threads in the order they were written, returns false if there were none
+bool Logger::drain(std::string &out, std::string &err) {
+	std::scoped_lock<std::mutex> drain_lock{drain_mutex};
+
+	std::vector<std::shared_ptr<LogRing>> current;
+	{
+		std::scoped_lock<std::mutex> lock{rings_mutex};
+
+		// rings of threads that exited are only referenced here, they go away once they are empty
+		std::erase_if(rings, [](const std::shared_ptr<LogRing> &ring) {
+			return ring.use_count() == 1 && ring->head.load(std::memory_order_acquire) == ring->tail.load(std::memory_order_relaxed);
+		});
+		current = rings;
+	}
+
+	struct Line {
+		uint64_t time_us;
+		LogLevel level;
+		std::string text;
+	};
+
+	std::vector<Line> lines;
+	for (const std::shared_ptr<LogRing> &ring : current) {
+		uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+		const uint64_t head = ring->head.load(std::memory_order_acquire);
+
+		while (tail < head) {
+			const size_t position = tail % LogRing::CAPACITY;
+			if (LogRing::CAPACITY - position < sizeof(LogRecord)) {
+				tail += LogRing::CAPACITY - position;
+				continue;
+			}
+
+			LogRecord record;
+			memcpy(&record, &ring->data[position], sizeof(record));
+			if (record.render) {
+				Line line{record.time_us, record.level, {}};
+				line.text += getLevelName(record.level);
+				line.text += ' ';
+				line.text += record.message;
+				record.render(&ring->data[position + sizeof(record)], line.text);
+				lines.push_back(std::move(line));
+			}
+
+			tail += record.size;
+		}
+
+		ring->tail.store(tail, std::memory_order_release);
+	}
+
+	const uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+	if (lines.empty() && lost == 0) {
+		return false;
+	}
+
+	if (lost > 0) {
+		const uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		lines.push_back({now, LogLevel::Warn, std::format("warn log lines dropped count={}", lost)});
+	}
+
+	std::stable_sort(lines.begin(), lines.end(), [](const Line &a, const Line &b) {
+		return a.time_us < b.time_us;
+	});
+
+	out.clear();
+	err.clear();
+	for (const Line &line : lines) {
+		std::string &target = line.level >= LogLevel::Warn ? err : out;
+
+		const std::chrono::sys_time<std::chrono::microseconds> time{std::chrono::microseconds(line.time_us)};
+		const std::chrono::sys_days day = std::chrono::floor<std::chrono::days>(time);
+		const std::chrono::year_month_day date{day};
+		const std::chrono::hh_mm_ss<std::chrono::microseconds> clock{time - day};
+
+		std::format_to(std::back_inserter(target), "{:04}-{:02}-{:02}T{:02}:{:02}:{:02}.{:06}Z ", int(date.year()), unsigned(date.month()), unsigned(date.day()),
+			clock.hours().count(), clock.minutes().count(), clock.seconds().count(), clock.subseconds().count());
+		target += line.text;
+		target += '\n';
+	}
+
+	// one write per batch instead of a flush per line
+	if (!out.empty()) {
+		fwrite(out.data(), 1, out.size(), stdout);
+		fflush(stdout);
+	}
+	if (!err.empty()) {
+		fwrite(err.data(), 1, err.size(), stderr);
+		fflush(stderr);
+	}
+
+	return true;
+}
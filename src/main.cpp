@@ -1,5 +1,10 @@
 #include "SDL_oldnames.h"
+#include "book.hpp"
+#include "bot.hpp"
+#include "explorer.hpp"
+#include "gamedb.hpp"
 #include "io.hpp"
+#include "record.hpp"
 #include "server.hpp"
 #include "window.hpp"
 
@@ -11,8 +16,28 @@ int main(int argc, char *argv[]) {
 	std::vector<std::string> args(argv, argv + argc);
 
 	bool headless = args.size() >= 2 && args[1] == "--headless";
+	bool bot = args.size() >= 2 && args[1] == "--ws-bot";
 
-	if (!headless) {
+	// prints a game record as text without touching sdl
+	if (args.size() >= 2 && args[1] == "--export-record") {
+		return GameRecord::exportText(args);
+	}
+
+	if (args.size() >= 2 && args[1] == "--game-db") {
+		return GameDatabase::run(args);
+	}
+
+	// --explorer <file> on its own opens an explorer in the window
+	if (args.size() >= 3 && args[1] == "--explorer" && (args[2] == "build" || args[2] == "merge" || args[2] == "show")) {
+		return OpeningExplorer::run(args);
+	}
+
+	// --book <file> on its own gives the window's engine seats a book
+	if (args.size() >= 3 && args[1] == "--book" && (args[2] == "build" || args[2] == "self-play" || args[2] == "show")) {
+		return OpeningBook::run(args);
+	}
+
+	if (!headless && !bot) {
 		if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMEPAD | SDL_INIT_EVENTS) != 0) {
 			panic("Failed to initialize SDL");
 		}
@@ -29,13 +54,15 @@ int main(int argc, char *argv[]) {
 	int result = 0;
 	if (headless) {
 		result = Server::run(args);
+	} else if (bot) {
+		result = Bot::run(args);
 	} else {
 		result = Window::run(args);
 	}
 
 	SDLNet_Quit();
 
-	if (!headless) {
+	if (!headless && !bot) {
 		IMG_Quit();
 		SDL_Quit();
 	}
@@ -0,0 +1,97 @@
+#include "metrics.hpp"
+
+#include <format>
+
+Gauge Metrics::active_sessions{"chess_sessions_active", "Sessions that are in memory"};
+Gauge Metrics::hibernated_sessions{"chess_sessions_hibernated", "Idle sessions that were written to disk and dropped from memory"};
+Gauge Metrics::connected_clients{"chess_clients_connected", "Connections accepted by the network backend that are still open"};
+Gauge Metrics::measured_clients{"chess_clients_measured", "Open connections that answered at least one heartbeat ping"};
+Gauge Metrics::client_jitter{"chess_client_jitter_microseconds", "Sum of the jitter estimates of the measured connections, RFC 3550"};
+
+Counter Metrics::frames_in{"chess_frames_in_total", "Messages received from clients"};
+Counter Metrics::frames_out{"chess_frames_out_total", "Buffers queued to clients, a broadcast counts once per target"};
+Counter Metrics::bytes_in{"chess_bytes_in_total", "Bytes received from clients"};
+Counter Metrics::bytes_out{"chess_bytes_out_total", "Bytes queued to clients"};
+
+Histogram Metrics::move_handling{"chess_move_handling_seconds", "Time a session spends on a move or promotion from a client"};
+Histogram Metrics::broadcast_fanout{"chess_broadcast_fanout_seconds", "Time to queue and flush a message to all seated clients"};
+Histogram Metrics::switch_player{"chess_switch_player_seconds", "Time spent finding the next player after a move"};
+Histogram Metrics::client_rtt{"chess_client_rtt_seconds", "Round trip time of the heartbeat pings, one sample per pong"};
+
+Counter Metrics::wal_commits{"chess_wal_commits_total", "Group commits of the write-ahead log"};
+Counter Metrics::wal_bytes{"chess_wal_bytes_total", "Bytes written to the write-ahead log"};
+Histogram Metrics::wal_commit{"chess_wal_commit_seconds", "Time to write and sync one group commit of the write-ahead log"};
+Histogram Metrics::session_restore{"chess_session_restore_seconds", "Time to bring a hibernated session back into memory"};
+
+std::string MetricsRegistry::render() const {
+	std::string out;
+	for (const Metric *metric : metrics) {
+		metric->render(out);
+	}
+	return out;
+}
+
+Metric::Metric(const char *name, const char *help) : name(name), help(help) {
+	MetricsRegistry::get().add(this);
+}
+
+uint64_t Counter::getValue() const {
+	uint64_t value = 0;
+	for (const Shard &shard : shards) {
+		value += shard.value.load(std::memory_order_relaxed);
+	}
+	return value;
+}
+
+void Counter::render(std::string &out) const {
+	std::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} counter\n{} {}\n", name, help, name, name, getValue());
+}
+
+void Gauge::render(std::string &out) const {
+	std::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} gauge\n{} {}\n", name, help, name, name, value.load(std::memory_order_relaxed));
+}
+
+uint64_t Histogram::getBucketLimit(uint32_t bucket) {
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+
+	const uint32_t exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+	const uint64_t width = 1ull << (exponent - SUB_BUCKET_BITS);
+	return (SUB_BUCKETS + bucket % SUB_BUCKETS) * width + width - 1;
+}
+
+void Histogram::render(std::string &out) const {
+	// 1 us to 17 s
+	static constexpr uint32_t MIN_EXPONENT = 10;
+	static constexpr uint32_t MAX_EXPONENT = 34;
+
+	uint64_t counts[BUCKETS] = {};
+	uint64_t sum = 0;
+	for (const Shard &shard : shards) {
+		for (uint32_t i = 0; i < BUCKETS; i++) {
+			counts[i] += shard.buckets[i].load(std::memory_order_relaxed);
+		}
+		sum += shard.sum.load(std::memory_order_relaxed);
+	}
+
+	std::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} histogram\n", name, help, name);
+
+	// powers of two are bucket boundaries, so every exported bucket is exact
+	uint64_t cumulative = 0;
+	uint32_t bucket = 0;
+	for (uint32_t exponent = MIN_EXPONENT; exponent <= MAX_EXPONENT; exponent++) {
+		const uint64_t limit = (1ull << exponent) - 1;
+		for (; bucket < BUCKETS && getBucketLimit(bucket) <= limit; bucket++) {
+			cumulative += counts[bucket];
+		}
+
+		std::format_to(std::back_inserter(out), "{}_bucket{{le=\"{}\"}} {}\n", name, double(1ull << exponent) / 1e9, cumulative);
+	}
+
+	for (; bucket < BUCKETS; bucket++) {
+		cumulative += counts[bucket];
+	}
+
+	std::format_to(std::back_inserter(out), "{}_bucket{{le=\"+Inf\"}} {}\n{}_sum {}\n{}_count {}\n", name, cumulative, name, double(sum) / 1e9, name, cumulative);
+}
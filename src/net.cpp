@@ -0,0 +1,64 @@
+#include "net.hpp"
+
+#include "net_sdl.hpp"
+
+#if defined(NET_IO_URING)
+#include "net_uring.hpp"
+#endif
+
+std::unique_ptr<NetBackend> NetBackend::create(Kind kind) {
+	switch (kind) {
+		case SDLNet: return std::make_unique<SDLNetBackend>();
+#if defined(NET_IO_URING)
+		case IoUring: return std::make_unique<IoUringBackend>();
+#else
+		case IoUring: return nullptr;
+#endif
+	}
+
+	return nullptr;
+}
+
+std::optional<NetBackend::Kind> NetBackend::parseKind(std::string_view name) {
+	if (name == "sdl") {
+		return SDLNet;
+	} else if (name == "io_uring") {
+		return IoUring;
+	} else {
+		return {};
+	}
+}
+
+std::string_view NetBackend::getKindName(Kind kind) {
+	switch (kind) {
+		case SDLNet: return "sdl";
+		case IoUring: return "io_uring";
+	}
+
+	return "";
+}
+
+SharedBuffer NetBackend::encode(std::span<const uint8_t> data) {
+	return SharedBuffer::copy(data);
+}
+
+void NetBackend::broadcast(std::span<const std::shared_ptr<Connection>> targets, const SharedBuffer &buffer) {
+	for (const std::shared_ptr<Connection> &connection : targets) {
+		connection->queue(buffer);
+	}
+
+	for (const std::shared_ptr<Connection> &connection : targets) {
+		connection->flush();
+	}
+}
+
+void NetBackend::run() {
+	while (!stopped) {
+		poll(100);
+	}
+}
+
+void NetBackend::stop() {
+	stopped = true;
+	wakeup();
+}
@@ -0,0 +1,181 @@
+#include "net_sdl.hpp"
+
+#include "log.hpp"
+
+#include <chrono>
+#include <thread>
+
+SDLNetConnection::SDLNetConnection(SDLNet_StreamSocket *socket) : socket(socket) {}
+
+SDLNetConnection::~SDLNetConnection() {
+	if (socket) {
+		SDLNet_DestroyStreamSocket(socket);
+	}
+}
+
+std::string SDLNetConnection::getAddress() const {
+	std::scoped_lock<std::mutex> lock{mutex};
+	if (socket) {
+		return SDLNet_GetAddressString(SDLNet_GetStreamSocketAddress(socket));
+	} else {
+		return "<null>";
+	}
+}
+
+void SDLNetConnection::flush() {
+	std::scoped_lock<std::mutex, std::mutex> lock{mutex, outbound_mutex};
+	if (!socket) {
+		clearOutbound();
+		return;
+	}
+
+	std::span<const uint8_t> chunks[64];
+	while (!outbound.empty()) {
+		// SDL_net buffers whatever it can't write right away without limit, leave the rest in the
+		// bounded outbound queue until the socket caught up, poll retries
+		if (SDLNet_GetStreamSocketPendingWrites(socket) > MAX_PENDING_WRITES) {
+			return;
+		}
+
+		const size_t count = gatherOutbound(chunks);
+
+		std::span<const uint8_t> data = chunks[0];
+		if (count > 1) {
+			scratch.clear();
+			for (size_t i = 0; i < count; i++) {
+				scratch.insert(scratch.end(), chunks[i].begin(), chunks[i].end());
+			}
+			data = scratch;
+		}
+
+		if (SDLNet_WriteToStreamSocket(socket, data.data(), data.size()) != 0) {
+			closed = true;
+			clearOutbound();
+			return;
+		}
+
+		consumeOutbound(data.size());
+	}
+}
+
+void SDLNetConnection::close() {
+	closed = true;
+}
+
+void SDLNetConnection::abort() {
+	std::scoped_lock<std::mutex, std::mutex> lock{mutex, outbound_mutex};
+	closed = true;
+	aborted = true;
+	clearOutbound();
+}
+
+SDLNetBackend::~SDLNetBackend() {
+	connections.clear();
+
+	for (const auto &[server, protocol] : servers) {
+		SDLNet_DestroyServer(server);
+	}
+}
+
+bool SDLNetBackend::listen(uint16_t port, Connection::Protocol protocol) {
+	SDLNet_Server *server = SDLNet_CreateServer(nullptr, port);
+	if (!server) {
+		logError("couldn't create server", "error", SDL_GetError());
+		return false;
+	}
+
+	servers.push_back({server, protocol});
+	return true;
+}
+
+void SDLNetBackend::poll(int timeout) {
+	std::vector<void*> sockets;
+	sockets.reserve(connections.size() + servers.size());
+
+	for (const auto &[server, protocol] : servers) {
+		sockets.push_back(server);
+	}
+
+	for (const std::shared_ptr<SDLNetConnection> &connection : connections) {
+		if (!connection->isClosed()) {
+			sockets.push_back(connection->socket);
+		}
+	}
+
+	if (sockets.empty()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeout < 0 ? 100 : timeout));
+		return;
+	}
+
+	if (SDLNet_WaitUntilInputAvailable(sockets.data(), sockets.size(), timeout) < 0) {
+		return;
+	}
+
+	for (const auto &[server, protocol] : servers) {
+		SDLNet_StreamSocket *socket = nullptr;
+		while (SDLNet_AcceptClient(server, &socket) == 0 && socket) {
+			std::shared_ptr<SDLNetConnection> connection = std::make_shared<SDLNetConnection>(socket);
+			connection->setProtocol(protocol);
+			connections.push_back(connection);
+
+			if (callbacks.on_connect) {
+				callbacks.on_connect(connection);
+			}
+		}
+	}
+
+	uint8_t buffer[4096];
+	for (size_t i = 0; i < connections.size();) {
+		const std::shared_ptr<SDLNetConnection> connection = connections[i];
+
+		if (connection->getOutboundBytes() > 0) {
+			connection->flush();
+		}
+
+		bool error = false;
+		while (!connection->isClosed()) {
+			int received;
+			{
+				std::scoped_lock<std::mutex> lock{connection->mutex};
+				received = SDLNet_ReadFromStreamSocket(connection->socket, buffer, sizeof(buffer));
+			}
+
+			if (received < 0) {
+				error = true;
+				break;
+			} else if (received == 0) {
+				break;
+			}
+
+			connection->receive(std::span<const uint8_t>(buffer, received), [&](const Message &msg) {
+				if (callbacks.on_message) {
+					callbacks.on_message(connection, msg);
+				}
+			});
+		}
+
+		if (!error && !connection->isClosed()) {
+			i++;
+			continue;
+		}
+
+		{
+			// give queued writes a chance to go out before the socket is destroyed
+			std::scoped_lock<std::mutex> lock{connection->mutex};
+			if (!error && !connection->aborted && (SDLNet_GetStreamSocketPendingWrites(connection->socket) > 0 || connection->getOutboundBytes() > 0)) {
+				i++;
+				continue;
+			}
+
+			connection->closed = true;
+			SDLNet_DestroyStreamSocket(connection->socket);
+			connection->socket = nullptr;
+		}
+
+		connections.erase(connections.begin() + i);
+
+		if (callbacks.on_disconnect) {
+			callbacks.on_disconnect(connection);
+		}
+	}
+}
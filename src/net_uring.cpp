@@ -0,0 +1,682 @@
+#include "net_uring.hpp"
+
+#include "log.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+
+static inline int io_uring_setup(uint32_t entries, io_uring_params *params) {
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t arg_size) {
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static inline int io_uring_register(int fd, uint32_t opcode, void *arg, uint32_t nr_args) {
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static inline uint64_t encodeUserData(uint8_t op, uint32_t id) {
+	return (uint64_t(op) << 56) | id;
+}
+
+static inline uint8_t getOp(uint64_t user_data) {
+	return user_data >> 56;
+}
+
+static inline uint32_t getConnectionId(uint64_t user_data) {
+	return uint32_t(user_data);
+}
+
+static std::string getPeerAddress(int fd) {
+	sockaddr_storage addr;
+	socklen_t size = sizeof(addr);
+	if (getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &size) != 0) {
+		return "<unknown>";
+	}
+
+	char buffer[INET6_ADDRSTRLEN] = {};
+	if (addr.ss_family == AF_INET6) {
+		inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6*>(&addr)->sin6_addr, buffer, sizeof(buffer));
+	} else {
+		inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(&addr)->sin_addr, buffer, sizeof(buffer));
+	}
+
+	return buffer;
+}
+
+IoUringConnection::IoUringConnection(IoUringBackend *backend, uint32_t id, int fd, const std::string &address)
+	: backend(backend), id(id), fd(fd), address(address) {}
+
+std::string IoUringConnection::getAddress() const {
+	return address;
+}
+
+NetBackend *IoUringConnection::getBackend() const {
+	return backend;
+}
+
+void IoUringConnection::flush() {
+	std::scoped_lock<std::mutex> lock{backend->mutex};
+	backend->submitWrite(this);
+	backend->submit();
+}
+
+void IoUringConnection::close() {
+	std::scoped_lock<std::mutex> lock{backend->mutex};
+	closed = true;
+	backend->requestShutdown(this);
+}
+
+void IoUringConnection::abort() {
+	std::scoped_lock<std::mutex> lock{backend->mutex};
+	closed = true;
+
+	// buffers of a write in flight are still read by the kernel, the failing write clears them
+	{
+		std::scoped_lock<std::mutex> outbound_lock{outbound_mutex};
+		if (!write_in_flight) {
+			clearOutbound();
+		}
+	}
+
+	shutdown(fd, SHUT_RDWR);
+}
+
+IoUringBackend::SendArena::~SendArena() {
+	if (memory) {
+		munmap(memory, size_t(SEND_SLOT_COUNT) * SEND_SLOT_SIZE);
+	}
+}
+
+IoUringBackend::IoUringBackend() {
+	if (!setupRing()) {
+		destroyRing();
+	}
+}
+
+IoUringBackend::~IoUringBackend() {
+	for (auto &[id, connection] : connections) {
+		::close(connection->fd);
+	}
+	connections.clear();
+
+	for (const Listener &listener : listeners) {
+		::close(listener.fd);
+	}
+
+	destroyRing();
+}
+
+bool IoUringBackend::setupRing() {
+	io_uring_params params = {};
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = QUEUE_DEPTH * 4;
+
+	ring_fd = io_uring_setup(QUEUE_DEPTH, &params);
+	if (ring_fd < 0) {
+		logWarn("io_uring_setup failed", "error", strerror(errno));
+		return false;
+	}
+
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+		logWarn("io_uring: kernel is too old");
+		return false;
+	}
+
+	sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+	void *ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED) {
+		return false;
+	}
+
+	sq_ptr = cq_ptr = static_cast<uint8_t*>(ring);
+	sq_head = reinterpret_cast<uint32_t*>(sq_ptr + params.sq_off.head);
+	sq_tail = reinterpret_cast<uint32_t*>(sq_ptr + params.sq_off.tail);
+	sq_mask = reinterpret_cast<uint32_t*>(sq_ptr + params.sq_off.ring_mask);
+	sq_array = reinterpret_cast<uint32_t*>(sq_ptr + params.sq_off.array);
+	cq_head = reinterpret_cast<uint32_t*>(cq_ptr + params.cq_off.head);
+	cq_tail = reinterpret_cast<uint32_t*>(cq_ptr + params.cq_off.tail);
+	cq_mask = reinterpret_cast<uint32_t*>(cq_ptr + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(cq_ptr + params.cq_off.cqes);
+
+	sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	void *sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sqes_ptr == MAP_FAILED) {
+		return false;
+	}
+	sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+	// provided buffers for multishot receive
+	void *buffers = mmap(nullptr, RECV_BUFFER_COUNT * RECV_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffers == MAP_FAILED) {
+		return false;
+	}
+	recv_buffers = static_cast<uint8_t*>(buffers);
+
+	// registered send arena, falls back to plain sends if the kernel refuses to pin it
+	void *arena = mmap(nullptr, size_t(SEND_SLOT_COUNT) * SEND_SLOT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (arena == MAP_FAILED) {
+		return false;
+	}
+
+	send_arena = std::make_shared<SendArena>();
+	send_arena->memory = static_cast<uint8_t*>(arena);
+	send_arena->free_slots.reserve(SEND_SLOT_COUNT);
+	for (uint32_t i = SEND_SLOT_COUNT; i > 0; i--) {
+		send_arena->free_slots.push_back(i - 1);
+	}
+
+	iovec iov = {send_arena->memory, size_t(SEND_SLOT_COUNT) * SEND_SLOT_SIZE};
+	fixed_buffers = io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+	if (!fixed_buffers) {
+		logWarn("io_uring: couldn't register send buffers, using plain sends", "error", strerror(errno));
+	}
+
+	std::scoped_lock<std::mutex> lock{mutex};
+	provideBuffers(0, RECV_BUFFER_COUNT);
+	submit();
+	return true;
+}
+
+void IoUringBackend::destroyRing() {
+	send_arena.reset();
+
+	if (recv_buffers) {
+		munmap(recv_buffers, RECV_BUFFER_COUNT * RECV_BUFFER_SIZE);
+		recv_buffers = nullptr;
+	}
+
+	if (sqes) {
+		munmap(sqes, sqes_size);
+		sqes = nullptr;
+	}
+
+	if (sq_ptr) {
+		munmap(sq_ptr, sq_ring_size);
+		sq_ptr = cq_ptr = nullptr;
+	}
+
+	if (ring_fd >= 0) {
+		::close(ring_fd);
+		ring_fd = -1;
+	}
+}
+
+io_uring_sqe *IoUringBackend::getSqe() {
+	const uint32_t tail = *sq_tail;
+	if (tail - std::atomic_ref<uint32_t>(*sq_head).load(std::memory_order_acquire) >= QUEUE_DEPTH) {
+		submit();
+		if (tail - std::atomic_ref<uint32_t>(*sq_head).load(std::memory_order_acquire) >= QUEUE_DEPTH) {
+			return nullptr;
+		}
+	}
+
+	const uint32_t index = tail & *sq_mask;
+	io_uring_sqe *sqe = &sqes[index];
+	memset(sqe, 0, sizeof(io_uring_sqe));
+	sq_array[index] = index;
+	std::atomic_ref<uint32_t>(*sq_tail).store(tail + 1, std::memory_order_release);
+	sq_pending++;
+	return sqe;
+}
+
+// caller holds mutex
+void IoUringBackend::defer(Op op, uint32_t id, uint32_t count) {
+	if (deferred.empty()) {
+		logWarn("io_uring: submission queue is full, deferring to the next poll", "depth", QUEUE_DEPTH);
+	}
+	deferred.push_back({op, id, count});
+}
+
+// caller holds mutex; whatever still doesn't fit is deferred again
+void IoUringBackend::retryDeferred() {
+	std::vector<Deferred> retry;
+	retry.swap(deferred);
+
+	for (const Deferred &entry : retry) {
+		switch (entry.op) {
+			case Accept: armAccept(entry.id); break;
+			case Provide: provideBuffers(entry.id, entry.count); break;
+			case Receive:
+			case Write: {
+				auto it = connections.find(entry.id);
+				if (it == connections.end()) {
+					break;
+				}
+
+				// a closed connection is re-armed as well, its receive completes right away and cleans it up
+				if (entry.op == Receive) {
+					armReceive(it->second.get());
+				} else {
+					submitWrite(it->second.get());
+				}
+			} break;
+			case Wakeup: break;
+		}
+	}
+}
+
+void IoUringBackend::submit() {
+	while (sq_pending > 0) {
+		const int submitted = io_uring_enter(ring_fd, sq_pending, 0, 0, nullptr, 0);
+		if (submitted < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+				continue;
+			}
+
+			logError("io_uring_enter failed", "error", strerror(errno));
+			return;
+		}
+
+		sq_pending -= submitted;
+	}
+}
+
+void IoUringBackend::provideBuffers(uint16_t bid, uint32_t count) {
+	io_uring_sqe *sqe = getSqe();
+	if (!sqe) {
+		defer(Provide, bid, count);
+		return;
+	}
+
+	sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+	sqe->fd = count;
+	sqe->addr = reinterpret_cast<uint64_t>(recv_buffers + size_t(bid) * RECV_BUFFER_SIZE);
+	sqe->len = RECV_BUFFER_SIZE;
+	sqe->off = bid;
+	sqe->buf_group = 0;
+	sqe->user_data = encodeUserData(Provide, 0);
+}
+
+void IoUringBackend::armAccept(uint32_t listener) {
+	io_uring_sqe *sqe = getSqe();
+	if (!sqe) {
+		defer(Accept, listener);
+		return;
+	}
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = listeners[listener].fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->user_data = encodeUserData(Accept, listener);
+}
+
+void IoUringBackend::armReceive(IoUringConnection *connection) {
+	// counts as receiving while it waits for a free entry, so the connection isn't finalized in between
+	connection->receiving = true;
+	io_uring_sqe *sqe = getSqe();
+	if (!sqe) {
+		defer(Receive, connection->id);
+		return;
+	}
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = connection->fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = encodeUserData(Receive, connection->id);
+}
+
+void IoUringBackend::submitWrite(IoUringConnection *connection) {
+	if (connection->write_in_flight) {
+		return;
+	}
+
+	std::span<const uint8_t> chunks[IoUringConnection::MAX_IOVECS];
+	size_t count;
+	{
+		std::scoped_lock<std::mutex> lock{connection->outbound_mutex};
+		count = connection->gatherOutbound(chunks);
+		connection->outbound_in_flight = count;
+	}
+
+	if (count == 0) {
+		if (connection->shutdown_requested) {
+			shutdown(connection->fd, SHUT_RDWR);
+		}
+		return;
+	}
+
+	io_uring_sqe *sqe = getSqe();
+	if (!sqe) {
+		{
+			std::scoped_lock<std::mutex> lock{connection->outbound_mutex};
+			connection->outbound_in_flight = 0;
+		}
+		defer(Write, connection->id);
+		return;
+	}
+
+	const uint8_t *arena_begin = send_arena->memory;
+	const uint8_t *arena_end = arena_begin + size_t(SEND_SLOT_COUNT) * SEND_SLOT_SIZE;
+
+	if (count == 1 && fixed_buffers && chunks[0].data() >= arena_begin && chunks[0].data() < arena_end) {
+		// a single buffer from the registered arena, no need to pin pages for this write
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->addr = reinterpret_cast<uint64_t>(chunks[0].data());
+		sqe->len = chunks[0].size();
+		sqe->buf_index = 0;
+	} else {
+		for (size_t i = 0; i < count; i++) {
+			connection->iovecs[i].iov_base = const_cast<uint8_t*>(chunks[i].data());
+			connection->iovecs[i].iov_len = chunks[i].size();
+		}
+
+		connection->header = {};
+		connection->header.msg_iov = connection->iovecs;
+		connection->header.msg_iovlen = count;
+
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->addr = reinterpret_cast<uint64_t>(&connection->header);
+		sqe->len = 1;
+		sqe->msg_flags = MSG_NOSIGNAL;
+	}
+
+	sqe->fd = connection->fd;
+	sqe->user_data = encodeUserData(Write, connection->id);
+	connection->write_in_flight = true;
+}
+
+SharedBuffer IoUringBackend::encode(std::span<const uint8_t> data) {
+	if (!send_arena || data.size() > SEND_SLOT_SIZE) {
+		return SharedBuffer::copy(data);
+	}
+
+	uint32_t slot;
+	{
+		std::scoped_lock<std::mutex> lock{send_arena->mutex};
+		if (send_arena->free_slots.empty()) {
+			return SharedBuffer::copy(data);
+		}
+
+		slot = send_arena->free_slots.back();
+		send_arena->free_slots.pop_back();
+	}
+
+	uint8_t *memory = send_arena->memory + size_t(slot) * SEND_SLOT_SIZE;
+	memcpy(memory, data.data(), data.size());
+
+	// the slot goes back to the arena once the slowest connection has written it
+	std::shared_ptr<const uint8_t> storage(memory, [arena = send_arena, slot](const uint8_t*) {
+		std::scoped_lock<std::mutex> lock{arena->mutex};
+		arena->free_slots.push_back(slot);
+	});
+
+	return SharedBuffer(storage, data.size());
+}
+
+void IoUringBackend::requestShutdown(IoUringConnection *connection) {
+	connection->shutdown_requested = true;
+
+	// flushes what is left, the socket is shut down once the queue is empty which
+	// terminates the multishot receive, the connection is cleaned up on its completion
+	submitWrite(connection);
+	submit();
+}
+
+bool IoUringBackend::finalize(IoUringConnection *connection) {
+	if (connection->receiving || connection->write_in_flight) {
+		return false;
+	}
+
+	{
+		std::scoped_lock<std::mutex> lock{connection->outbound_mutex};
+		connection->clearOutbound();
+	}
+	connection->closed = true;
+
+	::close(connection->fd);
+	return true;
+}
+
+bool IoUringBackend::listen(uint16_t port, Connection::Protocol protocol) {
+	if (ring_fd < 0) {
+		return false;
+	}
+
+	const int listen_fd = socket(AF_INET6, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		logError("io_uring: couldn't create socket", "error", strerror(errno));
+		return false;
+	}
+
+	const int yes = 1, no = 0;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no));
+
+	sockaddr_in6 addr = {};
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(port);
+
+	if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd, SOMAXCONN) != 0) {
+		logError("io_uring: couldn't listen", "port", port, "error", strerror(errno));
+		::close(listen_fd);
+		return false;
+	}
+
+	std::scoped_lock<std::mutex> lock{mutex};
+	listeners.push_back({listen_fd, protocol});
+	armAccept(listeners.size() - 1);
+	submit();
+	return true;
+}
+
+void IoUringBackend::poll(int timeout) {
+	if (ring_fd < 0) {
+		return;
+	}
+
+	__kernel_timespec ts = {};
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+
+	io_uring_getevents_arg arg = {};
+	arg.ts = timeout < 0 ? 0 : reinterpret_cast<uint64_t>(&ts);
+
+	if (timeout != 0) {
+		io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	}
+
+	uint32_t head = *cq_head;
+	const uint32_t tail = std::atomic_ref<uint32_t>(*cq_tail).load(std::memory_order_acquire);
+
+	while (head != tail) {
+		const io_uring_cqe cqe = cqes[head & *cq_mask];
+		head++;
+
+		switch (getOp(cqe.user_data)) {
+			case Accept: handleAccept(cqe); break;
+			case Receive: handleReceive(cqe); break;
+			case Write: handleWrite(cqe); break;
+			case Provide:
+			case Wakeup: break;
+		}
+	}
+
+	std::atomic_ref<uint32_t>(*cq_head).store(head, std::memory_order_release);
+
+	std::scoped_lock<std::mutex> lock{mutex};
+	submit();
+	if (!deferred.empty()) {
+		retryDeferred();
+		submit();
+	}
+}
+
+void IoUringBackend::wakeup() {
+	if (ring_fd < 0) {
+		return;
+	}
+
+	std::scoped_lock<std::mutex> lock{mutex};
+	if (io_uring_sqe *sqe = getSqe()) {
+		sqe->opcode = IORING_OP_NOP;
+		sqe->user_data = encodeUserData(Wakeup, 0);
+		submit();
+	}
+}
+
+void IoUringBackend::broadcast(std::span<const std::shared_ptr<Connection>> targets, const SharedBuffer &buffer) {
+	// queued without holding the ring lock, a queue that overflows aborts its connection which takes it;
+	// connections that don't belong to the ring flush themselves
+	for (const std::shared_ptr<Connection> &target : targets) {
+		if (target->queue(buffer) && target->getBackend() != this) {
+			target->flush();
+		}
+	}
+
+	std::scoped_lock<std::mutex> lock{mutex};
+
+	for (const std::shared_ptr<Connection> &target : targets) {
+		if (target->getBackend() == this && !target->isClosed()) {
+			submitWrite(static_cast<IoUringConnection*>(target.get()));
+		}
+	}
+
+	// all writes of this broadcast go to the kernel with a single io_uring_enter
+	submit();
+}
+
+void IoUringBackend::handleAccept(const io_uring_cqe &cqe) {
+	std::shared_ptr<IoUringConnection> connection;
+
+	{
+		std::scoped_lock<std::mutex> lock{mutex};
+		const uint32_t listener = getConnectionId(cqe.user_data);
+		if (!(cqe.flags & IORING_CQE_F_MORE)) {
+			armAccept(listener);
+			submit();
+		}
+
+		if (cqe.res < 0) {
+			logWarn("io_uring: couldn't accept client", "error", strerror(-cqe.res));
+			return;
+		}
+
+		const uint32_t id = next_connection_id++;
+		connection = std::make_shared<IoUringConnection>(this, id, cqe.res, getPeerAddress(cqe.res));
+		connection->setProtocol(listeners[listener].protocol);
+		connections[id] = connection;
+		armReceive(connection.get());
+		submit();
+	}
+
+	if (callbacks.on_connect) {
+		callbacks.on_connect(connection);
+	}
+}
+
+void IoUringBackend::handleReceive(const io_uring_cqe &cqe) {
+	std::shared_ptr<IoUringConnection> connection;
+	{
+		std::scoped_lock<std::mutex> lock{mutex};
+		auto it = connections.find(getConnectionId(cqe.user_data));
+		if (it == connections.end()) {
+			return;
+		}
+		connection = it->second;
+	}
+
+	if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+		const uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		const uint8_t *data = recv_buffers + size_t(bid) * RECV_BUFFER_SIZE;
+
+		if (!connection->isClosed()) {
+			connection->receive(std::span<const uint8_t>(data, cqe.res), [&](const Message &msg) {
+				if (callbacks.on_message) {
+					callbacks.on_message(connection, msg);
+				}
+			});
+		}
+
+		// hand the buffer back to the kernel, submitted together with everything else at the end of poll
+		std::scoped_lock<std::mutex> lock{mutex};
+		provideBuffers(bid, 1);
+	}
+
+	if (cqe.flags & IORING_CQE_F_MORE) {
+		return;
+	}
+
+	bool disconnected = false;
+	{
+		std::scoped_lock<std::mutex> lock{mutex};
+		if (cqe.res == -ENOBUFS || (cqe.res > 0 && !connection->closed)) {
+			// multishot receive stopped early, keep going
+			armReceive(connection.get());
+			submit();
+			return;
+		}
+
+		connection->receiving = false;
+		connection->closed = true;
+		if (finalize(connection.get())) {
+			connections.erase(connection->id);
+			disconnected = true;
+		} else {
+			shutdown(connection->fd, SHUT_RDWR);
+		}
+	}
+
+	if (disconnected && callbacks.on_disconnect) {
+		callbacks.on_disconnect(connection);
+	}
+}
+
+void IoUringBackend::handleWrite(const io_uring_cqe &cqe) {
+	std::shared_ptr<IoUringConnection> connection;
+	bool disconnected = false;
+
+	{
+		std::scoped_lock<std::mutex> lock{mutex};
+		auto it = connections.find(getConnectionId(cqe.user_data));
+		if (it == connections.end()) {
+			return;
+		}
+		connection = it->second;
+		connection->write_in_flight = false;
+
+		if (cqe.res < 0) {
+			// the peer is gone, drop everything and let the receive side clean up
+			{
+				std::scoped_lock<std::mutex> outbound_lock{connection->outbound_mutex};
+				connection->clearOutbound();
+			}
+			connection->closed = true;
+			shutdown(connection->fd, SHUT_RDWR);
+		} else {
+			{
+				std::scoped_lock<std::mutex> outbound_lock{connection->outbound_mutex};
+				connection->outbound_in_flight = 0;
+				connection->consumeOutbound(cqe.res);
+			}
+			submitWrite(connection.get());
+		}
+
+		if (!connection->receiving && finalize(connection.get())) {
+			connections.erase(connection->id);
+			disconnected = true;
+		}
+
+		submit();
+	}
+
+	if (disconnected && callbacks.on_disconnect) {
+		callbacks.on_disconnect(connection);
+	}
+}
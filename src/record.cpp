@@ -0,0 +1,330 @@
+#include "record.hpp"
+
+#include "io.hpp"
+#include "net.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <format>
+
+static bool isValidEvent(const GameEvent &event, uint32_t num_players) {
+	return event.player < num_players && event.from < num_players * 32 && event.to < num_players * 32 && event.kind <= GameEvent::Timeout;
+}
+
+void applyEvent(Field &field, const GameEvent &event) {
+	if (!isValidEvent(event, field.num_players)) {
+		return;
+	}
+
+	switch (event.kind) {
+		case GameEvent::Move:
+		case GameEvent::Capture:
+		case GameEvent::Castle:
+		case GameEvent::EnPassant: {
+			static constexpr MoveType TYPES[] = {MoveType::Move, MoveType::Capture, MoveType::Castle, MoveType::EnPassant};
+			field.moveFigure(event.from, event.to, TYPES[event.kind]);
+
+			// a pawn that reached the last row waits for its promotion before the turn ends
+			if (field.tiles[event.to].figure != Figure::Pawn || getY(event.to) != 0) {
+				field.switchToNextPlayer();
+			}
+		} break;
+		case GameEvent::Promote: {
+			if (field.tiles[event.from].figure == Figure::Pawn && getY(event.from) == 0) {
+				field.tiles[event.from].figure = event.promotion;
+			}
+			field.switchToNextPlayer();
+		} break;
+		case GameEvent::Surrender:
+		case GameEvent::Timeout: {
+			field.players[event.player].is_checkmate = true;
+			field.switchToNextPlayer();
+		} break;
+		case GameEvent::Check:
+		case GameEvent::CheckMate: break;
+	}
+}
+
+void GameRecord::create(uint32_t num_players, const std::vector<std::string> &names, const EventLog &events, uint32_t snapshot_interval) {
+	this->num_players = num_players;
+	this->snapshot_interval = std::max<uint32_t>(snapshot_interval, 1);
+	this->names = names;
+	this->names.resize(num_players);
+	this->events = events;
+	snapshots.clear();
+	snapshot_tiles.clear();
+
+	Field field;
+	field.init(num_players);
+	for (size_t i = 0; i < events.size(); i++) {
+		applyEvent(field, events[i]);
+		if ((i + 1) % this->snapshot_interval == 0) {
+			takeSnapshot(field, i + 1);
+		}
+	}
+}
+
+std::vector<uint8_t> GameRecord::encode() const {
+	std::vector<uint8_t> data;
+	const auto append = [&](std::span<const uint8_t> bytes) {
+		data.insert(data.end(), bytes.begin(), bytes.end());
+	};
+
+	RecordHeader header = {};
+	memcpy(header.magic, RecordHeader::MAGIC, sizeof(header.magic));
+	header.version = RecordHeader::VERSION;
+	header.num_players = num_players;
+	header.snapshot_interval = snapshot_interval;
+	header.num_snapshots = snapshots.size();
+	header.num_events = events.size();
+	append(asBytes(header));
+
+	for (const std::string &name : names) {
+		RecordName record = {};
+		memcpy(record.name, name.data(), std::min(name.size(), sizeof(record.name)));
+		append(asBytes(record));
+	}
+
+	events.forEachSpan(0, events.size(), [&](std::span<const GameEvent> run) {
+		append(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(run.data()), run.size_bytes()));
+	});
+
+	const size_t num_tiles = num_players * 32;
+	for (size_t i = 0; i < snapshots.size(); i++) {
+		append(asBytes(snapshots[i]));
+		append(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(&snapshot_tiles[i * num_tiles]), num_tiles * sizeof(Tile)));
+	}
+
+	return data;
+}
+
+bool GameRecord::decode(std::span<const uint8_t> data) {
+	RecordHeader header;
+	if (data.size() < sizeof(header)) {
+		return false;
+	}
+
+	memcpy(&header, data.data(), sizeof(header));
+	if (memcmp(header.magic, RecordHeader::MAGIC, sizeof(header.magic)) != 0 || header.version != RecordHeader::VERSION) {
+		return false;
+	} else if (header.num_players < 2 || header.num_players > MAX_PLAYERS || header.snapshot_interval == 0) {
+		return false;
+	}
+
+	const size_t num_tiles = header.num_players * 32;
+	const size_t snapshot_size = sizeof(RecordSnapshot) + num_tiles * sizeof(Tile);
+	const size_t fixed_size = sizeof(header) + header.num_players * sizeof(RecordName);
+	if (data.size() < fixed_size || header.num_events > (data.size() - fixed_size) / sizeof(GameEvent)) {
+		return false;
+	} else if (data.size() - fixed_size - header.num_events * sizeof(GameEvent) != header.num_snapshots * snapshot_size) {
+		return false;
+	}
+
+	num_players = header.num_players;
+	snapshot_interval = header.snapshot_interval;
+	names.clear();
+	events.clear();
+	snapshots.clear();
+	snapshot_tiles.clear();
+
+	size_t offset = sizeof(header);
+	for (uint32_t i = 0; i < num_players; i++) {
+		RecordName name;
+		memcpy(&name, data.data() + offset, sizeof(name));
+		names.emplace_back(name.name, strnlen(name.name, sizeof(name.name)));
+		offset += sizeof(name);
+	}
+
+	for (uint64_t i = 0; i < header.num_events; i++) {
+		GameEvent event;
+		memcpy(&event, data.data() + offset, sizeof(event));
+		if (!isValidEvent(event, num_players)) {
+			return false;
+		}
+
+		events.push_back(event);
+		offset += sizeof(event);
+	}
+
+	snapshots.resize(header.num_snapshots);
+	snapshot_tiles.resize(header.num_snapshots * num_tiles);
+	for (uint32_t i = 0; i < header.num_snapshots; i++) {
+		RecordSnapshot &snapshot = snapshots[i];
+		memcpy(&snapshot, data.data() + offset, sizeof(snapshot));
+		memcpy(&snapshot_tiles[i * num_tiles], data.data() + offset + sizeof(snapshot), num_tiles * sizeof(Tile));
+		offset += snapshot_size;
+
+		// seek() relies on finding the snapshot of a ply by dividing it by the interval
+		if (snapshot.ply != (i + 1) * uint64_t(snapshot_interval) || snapshot.ply > events.size() || snapshot.current_player >= num_players) {
+			return false;
+		}
+
+		for (uint32_t player = 0; player < num_players; player++) {
+			if (snapshot.king_positions[player] >= num_tiles) {
+				return false;
+			}
+		}
+
+		for (size_t tile = 0; tile < num_tiles; tile++) {
+			const Tile &value = snapshot_tiles[i * num_tiles + tile];
+			if (value.figure > Figure::King || value.player >= num_players) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool GameRecord::load(const std::string &path) {
+	FILE *in = fopen(path.c_str(), "rb");
+	if (!in) {
+		return false;
+	}
+
+	std::vector<uint8_t> data;
+	uint8_t buffer[64 * 1024];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+		data.insert(data.end(), buffer, buffer + count);
+	}
+	fclose(in);
+
+	return decode(data);
+}
+
+bool GameRecord::save(const std::string &path) const {
+	const std::vector<uint8_t> data = encode();
+
+	FILE *out = fopen(path.c_str(), "wb");
+	if (!out) {
+		return false;
+	}
+
+	const bool written = fwrite(data.data(), 1, data.size(), out) == data.size();
+	return fclose(out) == 0 && written;
+}
+
+std::string GameRecord::toText() const {
+	std::string text = std::format("[Players \"{}\"]\n", num_players);
+	for (uint32_t i = 0; i < names.size(); i++) {
+		std::string name = names[i];
+		std::replace(name.begin(), name.end(), '"', '\'');
+		text += std::format("[Seat{} \"{}\"]\n", i, name);
+	}
+	text += '\n';
+
+	for (size_t i = 0; i < events.size(); i++) {
+		const GameEvent &event = events[i];
+		text += std::format("{}. {} {}", i + 1, event.player, GameEvent::getKindName(event.kind));
+
+		switch (event.kind) {
+			case GameEvent::Move:
+			case GameEvent::Capture:
+			case GameEvent::Castle:
+			case GameEvent::EnPassant: {
+				text += std::format(" ({}, {}, {}) -> ({}, {}, {})",
+					getX(event.from), getY(event.from), getZ(event.from),
+					getX(event.to), getY(event.to), getZ(event.to)
+				);
+			} break;
+			case GameEvent::Promote: {
+				text += std::format(" ({}, {}, {}) to {}", getX(event.from), getY(event.from), getZ(event.from), event.promotion);
+			} break;
+			case GameEvent::Check:
+			case GameEvent::CheckMate:
+			case GameEvent::Surrender:
+			case GameEvent::Timeout: break;
+		}
+
+		text += '\n';
+	}
+
+	return text;
+}
+
+int GameRecord::exportText(const std::vector<std::string> &args) {
+	if (args.size() < 3) {
+		eprintln("usage: {} --export-record <file>", args[0]);
+		return 1;
+	}
+
+	GameRecord record;
+	if (!record.load(args[2])) {
+		eprintln("couldn't read game record {}", args[2]);
+		return 1;
+	}
+
+	print("{}", record.toText());
+	return 0;
+}
+
+void GameRecord::seek(Field &field, uint64_t ply) const {
+	ply = std::min<uint64_t>(ply, events.size());
+
+	const uint64_t start = getSnapshotPly(ply);
+	if (start == 0) {
+		field.init(num_players);
+	} else {
+		restoreSnapshot(field, start / snapshot_interval - 1);
+	}
+
+	for (uint64_t i = start; i < ply; i++) {
+		applyEvent(field, events[i]);
+	}
+}
+
+uint64_t GameRecord::getSnapshotPly(uint64_t ply) const {
+	return std::min<uint64_t>(ply / snapshot_interval, snapshots.size()) * snapshot_interval;
+}
+
+void GameRecord::takeSnapshot(const Field &field, uint64_t ply) {
+	RecordSnapshot snapshot = {};
+	snapshot.ply = ply;
+	snapshot.current_player = field.current_player;
+	for (uint32_t i = 0; i < num_players; i++) {
+		snapshot.checkmates |= uint32_t(field.players[i].is_checkmate) << i;
+		snapshot.king_positions[i] = field.players[i].king_position;
+	}
+	snapshots.push_back(snapshot);
+
+	for (uint32_t i = 0; i < num_players * 32; i++) {
+		Tile tile = field.tiles[i];
+		tile.move = MoveType::None;
+		snapshot_tiles.push_back(tile);
+	}
+}
+
+void GameRecord::restoreSnapshot(Field &field, size_t index) const {
+	const RecordSnapshot &snapshot = snapshots[index];
+
+	// the neighbors and the promotion tiles come from init, the position from the snapshot
+	field.init(num_players);
+	field.current_player = snapshot.current_player;
+	for (uint32_t i = 0; i < num_players; i++) {
+		field.players[i].is_checkmate = snapshot.checkmates & (1u << i);
+		field.players[i].king_position = snapshot.king_positions[i];
+	}
+
+	std::copy_n(&snapshot_tiles[index * num_players * 32], num_players * 32, field.tiles);
+}
+
+GameReplay::GameReplay(std::shared_ptr<const GameRecord> record) : record(std::move(record)) {
+	this->record->seek(field, 0);
+}
+
+void GameReplay::seek(uint64_t target) {
+	target = std::min(target, getLength());
+
+	// going forward from here replays fewer events than starting from the snapshot
+	if (target >= ply && record->getSnapshotPly(target) <= ply) {
+		for (uint64_t i = ply; i < target; i++) {
+			applyEvent(field, record->getEvents()[i]);
+		}
+	} else {
+		record->seek(field, target);
+	}
+
+	ply = target;
+}
@@ -0,0 +1,158 @@
+#include "registry.hpp"
+
+#include "session.hpp"
+
+#include <bit>
+
+SessionRegistry::~SessionRegistry() {
+	clear();
+	EpochDomain::drain();
+}
+
+uint64_t SessionRegistry::insert(const std::shared_ptr<Session> &session, uint64_t requested) {
+	while (true) {
+		uint64_t id = requested;
+		if (id == 0) {
+			std::scoped_lock<std::mutex> lock{random_mutex};
+			id = random();
+		}
+
+		if (id == 0 || id == ~0ull) {
+			if (requested != 0) {
+				return 0;
+			}
+			continue;
+		}
+
+		Shard &shard = shards[getShard(id)];
+		std::scoped_lock<std::mutex> lock{shard.mutex};
+
+		// nobody else publishes to this shard while we hold its mutex
+		const Table *current = shard.table.load(std::memory_order_relaxed);
+		const uint32_t count = current ? current->count : 0;
+
+		bool taken = false;
+		if (current) {
+			for (uint32_t i = getSlot(id, current->mask); current->entries[i].id != 0; i = (i + 1) & current->mask) {
+				taken |= current->entries[i].id == id;
+			}
+		}
+
+		if (taken) {
+			if (requested != 0) {
+				return 0;
+			}
+			continue;
+		}
+
+		Table *table = makeTable(std::bit_ceil<uint32_t>(std::max<uint32_t>((count + 1) * 2, 8)));
+		if (current) {
+			for (uint32_t i = 0; i <= current->mask; i++) {
+				if (current->entries[i].id != 0) {
+					insertEntry(*table, current->entries[i]);
+				}
+			}
+		}
+
+		// clients can find the session as soon as it is published, by then it has to know its id
+		session->setSessionId(id);
+		insertEntry(*table, Entry{id, session});
+		publish(shard, table);
+		return id;
+	}
+}
+
+bool SessionRegistry::erase(uint64_t id) {
+	Shard &shard = shards[getShard(id)];
+	std::scoped_lock<std::mutex> lock{shard.mutex};
+
+	const Table *current = shard.table.load(std::memory_order_relaxed);
+	if (!current || id == 0) {
+		return false;
+	}
+
+	bool found = false;
+	for (uint32_t i = getSlot(id, current->mask); current->entries[i].id != 0; i = (i + 1) & current->mask) {
+		found |= current->entries[i].id == id;
+	}
+
+	if (!found) {
+		return false;
+	}
+
+	// rebuilding also gets rid of the probe chains the erased entry was part of
+	Table *table = nullptr;
+	if (current->count > 1) {
+		table = makeTable(std::bit_ceil<uint32_t>(std::max<uint32_t>((current->count - 1) * 2, 8)));
+		for (uint32_t i = 0; i <= current->mask; i++) {
+			if (current->entries[i].id != 0 && current->entries[i].id != id) {
+				insertEntry(*table, current->entries[i]);
+			}
+		}
+	}
+
+	publish(shard, table);
+	return true;
+}
+
+void SessionRegistry::clear() {
+	for (Shard &shard : shards) {
+		std::scoped_lock<std::mutex> lock{shard.mutex};
+		publish(shard, nullptr);
+	}
+}
+
+std::shared_ptr<Session> SessionRegistry::find(uint64_t id) const {
+	if (id == 0) {
+		return nullptr;
+	}
+
+	EpochDomain::Guard guard;
+	const Table *table = shards[getShard(id)].table.load(std::memory_order_acquire);
+	if (!table) {
+		return nullptr;
+	}
+
+	for (uint32_t i = getSlot(id, table->mask); table->entries[i].id != 0; i = (i + 1) & table->mask) {
+		if (table->entries[i].id == id) {
+			return table->entries[i].session;
+		}
+	}
+
+	return nullptr;
+}
+
+size_t SessionRegistry::size() const {
+	size_t count = 0;
+	for (const Shard &shard : shards) {
+		EpochDomain::Guard guard;
+		const Table *table = shard.table.load(std::memory_order_acquire);
+		count += table ? table->count : 0;
+	}
+	return count;
+}
+
+SessionRegistry::Table *SessionRegistry::makeTable(uint32_t capacity) {
+	Table *table = new Table();
+	table->mask = capacity - 1;
+	table->entries = std::make_unique<Entry[]>(capacity);
+	return table;
+}
+
+void SessionRegistry::insertEntry(Table &table, Entry entry) {
+	uint32_t i = getSlot(entry.id, table.mask);
+	while (table.entries[i].id != 0) {
+		i = (i + 1) & table.mask;
+	}
+
+	table.entries[i] = std::move(entry);
+	table.count++;
+}
+
+void SessionRegistry::publish(Shard &shard, Table *table) {
+	Table *previous = shard.table.exchange(table, std::memory_order_acq_rel);
+	if (previous) {
+		// readers may still be walking it, the sessions it references stay alive until it is freed
+		EpochDomain::retire([previous]() { delete previous; });
+	}
+}
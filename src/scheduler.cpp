@@ -0,0 +1,154 @@
+#include "scheduler.hpp"
+
+#include "log.hpp"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+static thread_local Scheduler *current_scheduler = nullptr;
+static thread_local uint32_t current_worker = 0;
+
+static void pinCurrentThread(uint32_t index) {
+#if defined(__linux__)
+	// pick the index-th cpu this process is allowed to run on
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+		return;
+	}
+
+	uint32_t skip = index % CPU_COUNT(&allowed);
+	uint32_t cpu = 0;
+	for (; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed) && skip-- == 0) {
+			break;
+		}
+	}
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+		logWarn("couldn't pin worker thread", "cpu", cpu);
+	}
+#elif defined(_WIN32)
+	SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (index % (sizeof(DWORD_PTR) * 8)));
+#else
+	(void)index;
+#endif
+}
+
+Scheduler::Scheduler(uint32_t num_workers, bool pin_threads) {
+	if (num_workers == 0) {
+		num_workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	workers.reserve(num_workers);
+	for (uint32_t i = 0; i < num_workers; i++) {
+		workers.push_back(std::make_unique<Worker>());
+	}
+
+	for (uint32_t i = 0; i < num_workers; i++) {
+		workers[i]->thread = std::thread([this, i, pin_threads](){ runWorker(i, pin_threads); });
+	}
+}
+
+Scheduler::~Scheduler() {
+	shutdown();
+}
+
+void Scheduler::post(Task task) {
+	uint32_t index;
+	if (current_scheduler == this) {
+		index = current_worker;
+	} else {
+		index = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+	}
+
+	pending.fetch_add(1);
+
+	{
+		std::scoped_lock<std::mutex> lock{workers[index]->mutex};
+		workers[index]->tasks.push_back(std::move(task));
+	}
+
+	std::scoped_lock<std::mutex> lock{sleep_mutex};
+	sleep_condition.notify_one();
+}
+
+void Scheduler::shutdown() {
+	{
+		std::scoped_lock<std::mutex> lock{sleep_mutex};
+		if (stopped) {
+			return;
+		}
+
+		stopped = true;
+		sleep_condition.notify_all();
+	}
+
+	for (std::unique_ptr<Worker> &worker : workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
+	}
+
+	for (std::unique_ptr<Worker> &worker : workers) {
+		worker->tasks.clear();
+	}
+}
+
+void Scheduler::runWorker(uint32_t index, bool pin_thread) {
+	current_scheduler = this;
+	current_worker = index;
+
+	if (pin_thread) {
+		pinCurrentThread(index);
+	}
+
+	Task task;
+	while (!stopped) {
+		if (popTask(index, task) || stealTask(index, task)) {
+			pending.fetch_sub(1);
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock{sleep_mutex};
+		sleep_condition.wait(lock, [this]() { return pending > 0 || stopped; });
+	}
+}
+
+bool Scheduler::popTask(uint32_t index, Task &task) {
+	Worker &worker = *workers[index];
+	std::scoped_lock<std::mutex> lock{worker.mutex};
+	if (worker.tasks.empty()) {
+		return false;
+	}
+
+	// newest first, its data is most likely still in cache
+	task = std::move(worker.tasks.back());
+	worker.tasks.pop_back();
+	return true;
+}
+
+bool Scheduler::stealTask(uint32_t thief, Task &task) {
+	for (uint32_t i = 1; i < workers.size(); i++) {
+		Worker &victim = *workers[(thief + i) % workers.size()];
+		std::scoped_lock<std::mutex> lock{victim.mutex};
+		if (victim.tasks.empty()) {
+			continue;
+		}
+
+		// oldest first, leaves the victim the work it touched last
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		return true;
+	}
+
+	return false;
+}
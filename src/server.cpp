@@ -1,64 +1,1080 @@
 #include "server.hpp"
 
-#include "SDL3_net/SDL_net.h"
 #include "io.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "json.hpp"
+#include "net.hpp"
+#include "scheduler.hpp"
 #include "session.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include <charconv>
+#include <chrono>
+#include <csignal>
 #include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
-Server::Server(const std::vector<std::string> &) : http_server() {
-	server = SDLNet_CreateServer(nullptr, 1234);
-	if (!server) {
-		panic("couldn't create server: %s\n", SDL_GetError());
+static std::optional<uint64_t> parseNumber(std::string_view text, int base = 10) {
+	uint64_t value = 0;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+	if (error != std::errc() || end != text.data() + text.size()) {
+		return {};
 	}
+	return value;
+}
+
+// the value of a numeric argument times scale, a bad or too large one keeps the default
+template <typename T>
+static void parseArgument(std::string_view name, std::string_view text, T &target, uint64_t scale = 1) {
+	const std::optional<uint64_t> value = parseNumber(text);
+	if (!value || value.value() > std::numeric_limits<T>::max() / scale) {
+		logWarn("invalid number for argument", "argument", name, "value", text, "using", uint64_t(target));
+		return;
+	}
+	target = T(value.value() * scale);
+}
+
+// args[index] is the value of the argument before it
+template <typename T>
+static void parseArgument(const std::vector<std::string> &args, size_t index, T &target, uint64_t scale = 1) {
+	parseArgument(args[index - 1], args[index], target, scale);
+}
+
+Server::Server(const std::vector<std::string> &args) : http_server() {
+	NetBackend::Kind kind = NetBackend::SDLNet;
+	uint32_t num_workers = 0;
+	uint32_t http_threads = 64;
+	uint16_t websocket_port = 8081;
+	bool pin_threads = false;
+	std::string wal_path;
+
+	for (size_t i = 1; i < args.size(); i++) {
+		if (args[i] == "--net" && i + 1 < args.size()) {
+			if (std::optional<NetBackend::Kind> parsed = NetBackend::parseKind(args[++i])) {
+				kind = parsed.value();
+			} else {
+				logWarn("unknown network backend", "name", args[i], "using", NetBackend::getKindName(kind));
+			}
+		} else if (args[i] == "--workers" && i + 1 < args.size()) {
+			parseArgument(args, ++i, num_workers);
+		} else if (args[i] == "--pin-threads") {
+			pin_threads = true;
+		} else if (args[i] == "--ws-port" && i + 1 < args.size()) {
+			parseArgument(args, ++i, websocket_port);
+		} else if (args[i] == "--sse-port" && i + 1 < args.size()) {
+			parseArgument(args, ++i, event_stream_port);
+		} else if (args[i] == "--http-threads" && i + 1 < args.size()) {
+			parseArgument(args, ++i, http_threads);
+		} else if (args[i] == "--heartbeat" && i + 1 < args.size()) {
+			parseArgument(args, ++i, heartbeat_interval_ms);
+		} else if (args[i] == "--dead-timeout" && i + 1 < args.size()) {
+			parseArgument(args, ++i, dead_timeout_ms);
+		} else if (args[i] == "--log-level" && i + 1 < args.size()) {
+			if (std::optional<LogLevel> level = Logger::parseLevel(args[++i])) {
+				Logger::get().setLevel(level.value());
+			} else {
+				logWarn("unknown log level", "name", args[i]);
+			}
+		} else if (args[i] == "--capture" && i + 1 < args.size()) {
+			capture = std::make_unique<CaptureWriter>();
+			if (!capture->open(args[++i])) {
+				capture.reset();
+			}
+		} else if (args[i] == "--replay" && i + 1 < args.size()) {
+			replay_path = args[++i];
+		} else if (args[i] == "--fast") {
+			replay_fast = true;
+		} else if (args[i] == "--hibernate" && i + 1 < args.size()) {
+			hibernate_dir = args[++i];
+		} else if (args[i] == "--idle-timeout" && i + 1 < args.size()) {
+			parseArgument(args, ++i, idle_timeout_ms, 1000);
+		} else if (args[i] == "--records" && i + 1 < args.size()) {
+			records_dir = args[++i];
+		} else if (args[i] == "--explorer" && i + 1 < args.size()) {
+			explorer = std::make_unique<OpeningExplorer>();
+			if (!explorer->open(args[++i])) {
+				logError("couldn't open the opening explorer", "path", args[i]);
+				explorer.reset();
+			}
+		} else if (args[i] == "--wal" && i + 1 < args.size()) {
+			wal_path = args[++i];
+		} else if (args[i] == "--trace") {
+			Tracer::setEnabled(true);
+		} else if (args[i] == "--clock" && i + 1 < args.size()) {
+			// <minutes>+<increment seconds>
+			const std::string_view clock = args[++i];
+			const size_t plus = clock.find('+');
+			parseArgument("--clock", clock.substr(0, plus), clock_base_ms, 60 * 1000);
+			if (plus != std::string_view::npos) {
+				parseArgument("--clock", clock.substr(plus + 1), clock_increment_ms, 1000);
+			}
+		}
+	}
+
+	timers = std::make_unique<TimerWheel>();
+	timer_thread = std::thread([this](){ timers->run(); });
+
+	Tracer::installSignalHandler();
+	scheduleTraceDump();
+
+	// a second signal kills the process the usual way
+	const auto requestStop = [](int signal) {
+		stop_requested.store(true, std::memory_order_relaxed);
+		std::signal(signal, SIG_DFL);
+	};
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
+
+	scheduler = std::make_unique<Scheduler>(num_workers, pin_threads);
+	logInfo("running sessions on worker threads", "workers", scheduler->getWorkerCount(), "pinned", pin_threads);
+
+	// a replay only needs the backend to encode and broadcast, its clients don't have sockets
+	if (!replay_path.empty()) {
+		capture.reset();
+		websocket_port = 0;
+		event_stream_port = 0;
+
+		network = NetBackend::create(kind);
+		if (!network) {
+			network = NetBackend::create(NetBackend::SDLNet);
+		}
+	} else {
+		network = NetBackend::create(kind);
+		if (!network || !network->listen(1234)) {
+			if (kind == NetBackend::SDLNet) {
+				panic("couldn't create server");
+			}
+
+			logWarn("network backend is not available, falling back", "backend", NetBackend::getKindName(kind), "using", NetBackend::getKindName(NetBackend::SDLNet));
+			network = NetBackend::create(NetBackend::SDLNet);
+			if (!network->listen(1234)) {
+				panic("couldn't create server");
+			}
+		}
+	}
+
+	logInfo("using network backend", "backend", NetBackend::getKindName(network->getKind()));
+
+	// browsers speak the same protocol in websocket frames, on the same reactor as the native clients
+	if (websocket_port != 0) {
+		if (network->listen(websocket_port, Connection::WebSocket)) {
+			logInfo("accepting websocket clients", "port", websocket_port);
+		} else {
+			logError("couldn't listen for websocket clients", "port", websocket_port);
+		}
+	}
+
+	// watchers of server-sent events are spectators on the reactor as well, they don't hold an http thread
+	if (event_stream_port != 0) {
+		if (network->listen(event_stream_port, Connection::EventStream)) {
+			logInfo("accepting event stream watchers", "port", event_stream_port);
+		} else {
+			logError("couldn't listen for event stream watchers", "port", event_stream_port);
+			event_stream_port = 0;
+		}
+	}
+
+	http_server.new_task_queue = [http_threads]() {
+		return new httplib::ThreadPool(http_threads);
+	};
+
+	registerRoutes();
+
+	network->callbacks.on_connect = [this](const std::shared_ptr<Connection> &connection) {
+		Metrics::connected_clients.add();
+		if (capture) {
+			capture->write(CaptureRecord::Connect, CaptureWriter::getConnectionId(connection.get()));
+		}
+
+		// half-open sockets and clients that never send a join request don't get to hold a connection
+		timers->schedule(HANDSHAKE_TIMEOUT_MS, [connection = std::weak_ptr<Connection>(connection)]() {
+			std::shared_ptr<Connection> locked = connection.lock();
+			if (locked && !locked->isClosed() && locked->session == ~0ull) {
+				logInfo("client didn't send a join request in time", "address", locked->getAddress());
+				locked->abort();
+			}
+		});
+	};
+
+	network->callbacks.on_message = [this](const std::shared_ptr<Connection> &connection, const Message &msg) {
+		TraceSpan span{"onMessage"};
+		Metrics::frames_in.add();
+		if (capture) {
+			capture->writeObject(CaptureRecord::Frame, CaptureWriter::getConnectionId(connection.get()), msg);
+		}
+
+		if (connection->handleHeartbeat(msg)) {
+			return;
+		}
+
+		const uint64_t id = connection->session;
+		if (id == ~0ull) {
+			handleNewClient(connection, msg);
+		} else if (!withSession(id, [&](const std::shared_ptr<Session> &session) { session->queueMessageFromClient(connection, msg); })) {
+			// the session was destroyed while the client was still connected
+			connection->abort();
+		}
+	};
+
+	network->callbacks.on_disconnect = [this](const std::shared_ptr<Connection> &connection) {
+		Metrics::connected_clients.sub();
+		if (capture) {
+			capture->write(CaptureRecord::Disconnect, CaptureWriter::getConnectionId(connection.get()));
+		}
+
+		if (std::shared_ptr<Session> session = sessions.find(connection->session)) {
+			// wakes up the session, which notices the closed connection
+			session->queueMessageFromClient(connection, Message());
+		}
+	};
+
+	if (!replay_path.empty()) {
+		hibernate_dir.clear();
+		records_dir.clear();
+	}
+
+	if (!records_dir.empty()) {
+		std::error_code error;
+		std::filesystem::create_directories(records_dir, error);
+		if (error) {
+			logError("couldn't create the records directory, games aren't kept", "path", records_dir, "error", error.message());
+			records_dir.clear();
+		}
+	}
+
+	// clients only get to the sessions once the lobby runs, so the recovered ones are in place before anyone reconnects
+	if (!wal_path.empty() && replay_path.empty() && !recoverSessions(wal_path)) {
+		panic("couldn't recover sessions from {}", wal_path);
+	}
+
+	if (!hibernate_dir.empty()) {
+		loadHibernated();
+		scheduleHibernation();
+	}
+
+	if (capture) {
+		scheduleCaptureFlush();
+	}
+}
+
+Server::~Server() {
+	quit = true;
+	network->stop();
+
+	if (lobby_thread.joinable()) {
+		lobby_thread.join();
+	}
+
+	timers->stop();
+	if (timer_thread.joinable()) {
+		timer_thread.join();
+	}
+
+	if (capture) {
+		sessions.forEach([this](uint64_t id, const std::shared_ptr<Session> &session) {
+			writeDigest(id, *session);
+		});
+	}
+
+	// drops all pending session tasks before the sessions go away
+	scheduler->shutdown();
+	sessions.clear();
+
+	const OutboundStats &stats = Connection::outbound_stats;
+	logInfo("outbound queues", "coalesced", stats.coalesced.load(), "dropped_frames", stats.dropped_frames.load(), "evicted", stats.evicted.load());
+}
+
+bool Server::recoverSessions(const std::string &path) {
+	const uint64_t start = getMonotonicMicros();
+
+	std::vector<RecoveredSession> recovered;
+	WalRecoveryStats stats;
+	if (!WriteAheadLog::read(path, recovered, stats)) {
+		return false;
+	}
+
+	const size_t total = recovered.size();
+	std::erase_if(recovered, [](const RecoveredSession &session) {
+		return session.isFinished();
+	});
+
+	const uint64_t read = getMonotonicMicros();
+	if (stats.torn) {
+		logWarn("write-ahead log ends in a torn record, the moves after the last complete one are lost", "path", path, "records", stats.records);
+	}
+
+	wal = std::make_unique<WriteAheadLog>();
+	if (!wal->open(path, recovered)) {
+		return false;
+	}
+
+	const uint64_t compacted = getMonotonicMicros();
+
+	uint64_t events = 0;
+	for (const RecoveredSession &session : recovered) {
+		if (createSession(session.num_players, session.id, &session) != 0) {
+			events += session.events.size();
+		}
+	}
+
+	const uint64_t end = getMonotonicMicros();
+	logInfo("recovered sessions", "path", path, "sessions", recovered.size(), "finished", total - recovered.size(), "events", events, "bytes", stats.bytes,
+		"read_ms", (read - start) / 1000.0, "compact_ms", (compacted - read) / 1000.0, "restore_ms", (end - compacted) / 1000.0, "total_ms", (end - start) / 1000.0);
+	return true;
 }
 
 int Server::run() {
+	if (!replay_path.empty()) {
+		return replay();
+	}
+
 	lobby_thread = std::thread([this](){ runLobby(); });
 	http_server.listen("0.0.0.0", 8080);
 	return 0;
 }
 
 void Server::runLobby() {
-	while (!quit && SDLNet_WaitUntilInputAvailable((void**)&server, 1, 100) >= 0) {
-		SDLNet_StreamSocket *client;
-		if (SDLNet_AcceptClient(server, &client) != 0) {
-			eprintln("couldn't accept client: {}\n", SDL_GetError());
-			break;
+	network->run();
+
+	if (!quit) {
+		// an error occured -> stop httplib server
+		http_server.stop();
+	}
+}
+
+void Server::handleNewClient(const std::shared_ptr<Connection> &connection, const Message &msg) {
+	const uint64_t id = msg.getSession();
+	if (id == ~0ull) {
+		logInfo("client didn't send a join request after connecting", "address", connection->getAddress());
+		connection->close();
+		return;
+	}
+
+	const bool found = withSession(id, [&](const std::shared_ptr<Session> &session) {
+		connection->session = id;
+		session->addClient(connection, msg);
+	});
+
+	if (!found) {
+		connection->sendObject(Message::makeReject());
+		connection->close();
+		return;
+	}
+
+	scheduleHeartbeat(connection);
+}
+
+// pings every seated connection, the pongs keep the round trip estimate up to date and a peer
+// that stayed silent for longer than the dead timeout is dropped
+void Server::scheduleHeartbeat(const std::weak_ptr<Connection> &connection) {
+	timers->schedule(heartbeat_interval_ms, [this, connection]() {
+		std::shared_ptr<Connection> locked = connection.lock();
+		if (!locked || locked->isClosed()) {
+			return;
+		}
+
+		// a watcher of an event stream can't answer, the ping is a comment that makes a dead peer fail the write
+		const uint64_t now = getMonotonicMicros();
+		const uint64_t last_receive = locked->last_receive_us;
+		if (!locked->isEventStream() && now > last_receive && now - last_receive > dead_timeout_ms * 1000) {
+			logInfo("client didn't respond, dropping", "address", locked->getAddress(), "silent_ms", (now - last_receive) / 1000, "rtt_us", locked->rtt.srtt.load(), "jitter_us", locked->rtt.jitter.load());
+			locked->abort();
+			return;
+		}
+
+		locked->sendObject(Message::makePing(now));
+		scheduleHeartbeat(connection);
+	});
+}
+
+// the signal handler only sets a flag, the trace is written from the timer thread
+void Server::scheduleTraceDump() {
+	timers->schedule(TRACE_DUMP_POLL_MS, [this]() {
+		if (stop_requested.exchange(false)) {
+			logInfo("stopping the server");
+			http_server.stop();
 		}
 
-		if (client) {
-			handleNewClient(client);
+		if (Tracer::takeDumpRequest()) {
+			const std::string path = std::format("trace-{}.json", std::time(nullptr));
+			if (Tracer::dumpToFile(path)) {
+				logInfo("wrote trace", "path", path);
+			} else {
+				logError("couldn't write trace", "path", path);
+			}
 		}
+
+		scheduleTraceDump();
+	});
+}
+
+uint64_t Server::createSession(uint32_t num_players, uint64_t requested, const RecoveredSession *recovered) {
+	std::shared_ptr<Session> session = std::make_shared<Session>();
+	session->initHost(num_players, {}, network.get());
+
+	if (recovered) {
+		session->setClocks(timers.get(), recovered->clock_base_ms, recovered->clock_increment_ms);
+		session->recover(*recovered);
+	} else {
+		session->setClocks(timers.get(), clock_base_ms, clock_increment_ms);
 	}
 
-	if (!quit) {
-		// an error occured -> stop httplib server
-		http_server.stop();
+	session->setWriteAheadLog(wal.get());
+	session->attach(scheduler.get());
+
+	const uint64_t id = sessions.insert(session, requested);
+	if (id == 0) {
+		logError("session already exists", "session", LogHex{requested});
+		return 0;
 	}
+
+	if (capture && !recovered) {
+		capture->writeObject(CaptureRecord::Create, id, num_players);
+	}
+
+	// a recovered session is already in the new log; clients only learn the id of a new one after this,
+	// so its creation is logged before anything it appends
+	if (wal && !recovered) {
+		wal->writeCreate(id, num_players, clock_base_ms, clock_increment_ms);
+	}
+
+	Metrics::active_sessions.add();
+	Session::status_changes++;
+	if (recovered) {
+		logDebug("recovered session", "session", LogHex{id}, "players", num_players, "events", recovered->events.size());
+	} else {
+		logInfo("created session", "session", LogHex{id}, "players", num_players);
+	}
+	return id;
 }
 
-void Server::handleNewClient(SDLNet_StreamSocket *socket) {
-	Message msg;
-	if (Session::receiveBlocking<Message>(socket, &msg, 1) == 0) {
-		assert(msg.type == Message::Join);
-		std::string tmp(17, '\0');
-		memcpy(tmp.data(), msg.join.name, 16);
-		Player player{tmp.c_str()};
-		const uint32_t session = msg.join.session;
-		if (session < sessions.size()) {
-			sessions[session]->addClientToQueue(player, msg.player);
-		} else {
-			const Message response = Message::makeReject();
-			SDLNet_WriteToStreamSocket(socket, &response, sizeof(Message));
-			SDLNet_DestroyStreamSocket(socket);
+// the session closes its connections from its own task, pending tasks keep it alive until they ran
+bool Server::destroySession(uint64_t id) {
+	std::unique_lock<std::shared_mutex> lock{hibernation_mutex, std::defer_lock};
+	if (!hibernate_dir.empty()) {
+		lock.lock();
+	}
+
+	std::shared_ptr<Session> session = sessions.find(id);
+	if (!session || !sessions.erase(id)) {
+		const auto it = hibernated.find(id);
+		if (it == hibernated.end()) {
+			return false;
+		}
+
+		for (const std::weak_ptr<Connection> &connection : it->second.connections) {
+			if (std::shared_ptr<Connection> locked = connection.lock()) {
+				locked->close();
+			}
+		}
+
+		if (!records_dir.empty()) {
+			std::vector<RecoveredSession> states;
+			WalRecoveryStats stats;
+			if (it->second.state) {
+				states.push_back(*it->second.state);
+			} else {
+				WriteAheadLog::read(getSnapshotPath(id), states, stats);
+			}
+
+			if (!states.empty()) {
+				GameRecord record;
+				record.create(states[0].num_players, states[0].names, states[0].events);
+				saveRecord(id, record);
+			}
+		}
+
+		// a snapshot that is still being written is removed by the writer when it sees the session is gone
+		if (!it->second.state) {
+			remove(getSnapshotPath(id).c_str());
 		}
+
+		hibernated.erase(it);
+		if (wal) {
+			wal->writeDestroy(id);
+		}
+
+		Metrics::hibernated_sessions.sub();
+		Session::status_changes++;
+		logInfo("destroyed hibernated session", "session", LogHex{id});
+		return true;
+	}
+
+	if (capture) {
+		writeDigest(id, *session);
+		capture->write(CaptureRecord::Destroy, id);
+	}
+
+	if (wal) {
+		wal->writeDestroy(id);
+	}
+
+	if (!records_dir.empty()) {
+		saveRecord(id, session->getRecord());
 	}
+
+	session->close();
+	Metrics::active_sessions.sub();
+	Session::status_changes++;
+	logInfo("destroyed session", "session", LogHex{id});
+	return true;
 }
 
-void Server::createSession(uint32_t num_players) {
-	std::shared_ptr<Session> session = std::make_shared<Session>();
-	session->initHost(num_players, {});
-	session->launchThread();
-	sessions.push_back(session);
+void Server::saveRecord(uint64_t id, const GameRecord &record) {
+	if (record.getEvents().empty()) {
+		return;
+	}
+
+	const std::string path = getRecordPath(id);
+	if (record.save(path)) {
+		logInfo("saved game record", "session", LogHex{id}, "path", path, "events", record.getEvents().size());
+	} else {
+		logError("couldn't write game record", "session", LogHex{id}, "path", path);
+	}
+}
+
+std::shared_ptr<Session> Server::findSession(uint64_t id) {
+	std::shared_ptr<Session> found;
+	withSession(id, [&](const std::shared_ptr<Session> &session) {
+		found = session;
+	});
+	return found;
+}
+
+// snapshots left by an earlier run; sessions the write-ahead log brought back are in memory already
+void Server::loadHibernated() {
+	std::error_code error;
+	std::filesystem::create_directories(hibernate_dir, error);
+	if (error) {
+		logError("couldn't create the hibernation directory, hibernation is disabled", "path", hibernate_dir, "error", error.message());
+		hibernate_dir.clear();
+		return;
+	}
+
+	std::unique_lock<std::shared_mutex> lock{hibernation_mutex};
+	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(hibernate_dir, error)) {
+		if (entry.path().extension() != ".session") {
+			continue;
+		}
+
+		const std::optional<uint64_t> id = parseNumber(entry.path().stem().string(), 16);
+		if (!id || id.value() == 0) {
+			continue;
+		}
+
+		if (sessions.find(id.value())) {
+			std::filesystem::remove(entry.path(), error);
+			continue;
+		}
+
+		hibernated[id.value()];
+	}
+
+	Metrics::hibernated_sessions.set(hibernated.size());
+	logInfo("hibernating idle sessions", "path", hibernate_dir, "idle_timeout_s", idle_timeout_ms / 1000, "hibernated", hibernated.size());
+}
+
+// the check runs on a worker, writing the snapshots would hold up the clocks on the timer thread
+void Server::scheduleHibernation() {
+	timers->schedule(HIBERNATE_CHECK_MS, [this]() {
+		scheduler->post([this]() {
+			hibernateIdleSessions();
+			scheduleHibernation();
+		});
+	});
+}
+
+void Server::hibernateIdleSessions() {
+	const uint64_t now = getMonotonicMicros();
+	const uint64_t idle_us = idle_timeout_ms * 1000;
+
+	std::vector<uint64_t> idle;
+	sessions.forEach([&](uint64_t id, const std::shared_ptr<Session> &session) {
+		if (now - std::min(now, session->getLastActivity()) >= idle_us) {
+			idle.push_back(id);
+		}
+	});
+
+	uint32_t count = 0;
+	for (uint64_t id : idle) {
+		count += hibernateSession(id);
+	}
+
+	if (count > 0) {
+		logInfo("hibernated idle sessions", "sessions", count);
+	}
+}
+
+bool Server::hibernateSession(uint64_t id) {
+	std::shared_ptr<RecoveredSession> state = std::make_shared<RecoveredSession>();
+	{
+		std::unique_lock<std::shared_mutex> lock{hibernation_mutex};
+		std::shared_ptr<Session> session = sessions.find(id);
+		if (!session || !session->hibernate(idle_timeout_ms * 1000, *state) || !sessions.erase(id)) {
+			return false;
+		}
+
+		if (capture) {
+			writeDigest(id, *session);
+		}
+
+		HibernatedSession &entry = hibernated[id];
+		entry.connections.assign(state->connections.begin(), state->connections.end());
+		entry.state = state;
+		state->connections.clear();
+	}
+
+	Metrics::active_sessions.sub();
+	Metrics::hibernated_sessions.add();
+	Session::status_changes++;
+
+	// written without holding the lock, a message for the session in the meantime restores it from the state in memory
+	const std::string path = getSnapshotPath(id);
+	const bool written = WriteAheadLog::write(path, std::span<const RecoveredSession>(state.get(), 1));
+
+	std::unique_lock<std::shared_mutex> lock{hibernation_mutex};
+	const auto it = hibernated.find(id);
+	if (it == hibernated.end() || it->second.state != state) {
+		remove(path.c_str());
+	} else if (written) {
+		it->second.state.reset();
+	} else {
+		logError("couldn't write snapshot, keeping the session in memory", "session", LogHex{id}, "path", path);
+	}
+
+	logDebug("hibernated session", "session", LogHex{id}, "events", state->events.size());
+	return true;
+}
+
+std::shared_ptr<Session> Server::restoreSession(uint64_t id) {
+	std::unique_lock<std::shared_mutex> lock{hibernation_mutex};
+	if (std::shared_ptr<Session> session = sessions.find(id)) {
+		return session;
+	}
+
+	const auto it = hibernated.find(id);
+	if (it == hibernated.end()) {
+		return nullptr;
+	}
+
+	HistogramTimer timer{Metrics::session_restore};
+	const std::string path = getSnapshotPath(id);
+
+	RecoveredSession state;
+	if (it->second.state) {
+		state = *it->second.state;
+	} else {
+		std::vector<RecoveredSession> snapshot;
+		WalRecoveryStats stats;
+		if (!WriteAheadLog::read(path, snapshot, stats) || snapshot.size() != 1 || snapshot[0].id != id) {
+			logError("couldn't read snapshot of hibernated session", "session", LogHex{id}, "path", path);
+			hibernated.erase(it);
+			Metrics::hibernated_sessions.sub();
+			return nullptr;
+		}
+
+		state = std::move(snapshot[0]);
+		remove(path.c_str());
+	}
+
+	state.connections.resize(it->second.connections.size());
+	for (size_t i = 0; i < state.connections.size(); i++) {
+		state.connections[i] = it->second.connections[i].lock();
+	}
+
+	hibernated.erase(it);
+	Metrics::hibernated_sessions.sub();
+
+	if (createSession(state.num_players, id, &state) == 0) {
+		return nullptr;
+	}
+
+	logDebug("restored session", "session", LogHex{id}, "events", state.events.size());
+	return sessions.find(id);
+}
+
+// a session whose game ended gets its digest right away, a server that is killed later still leaves it in the capture
+void Server::scheduleCaptureFlush() {
+	timers->schedule(CAPTURE_FLUSH_MS, [this]() {
+		std::unordered_set<uint64_t> finished;
+		sessions.forEach([&](uint64_t id, const std::shared_ptr<Session> &session) {
+			if (!session->getStatus().isGameOver()) {
+				return;
+			}
+
+			if (!finished_digests.contains(id)) {
+				writeDigest(id, *session);
+			}
+			finished.insert(id);
+		});
+		finished_digests = std::move(finished);
+
+		capture->flush();
+		scheduleCaptureFlush();
+	});
+}
+
+void Server::writeDigest(uint64_t id, Session &session) {
+	CaptureDigest digest;
+	digest.seq = session.getStatus().seq;
+	digest.hash = session.getLogDigest(digest.seq);
+	capture->writeObject(CaptureRecord::Digest, id, digest);
+}
+
+// waits until the replayed session processed as many events as the recorded one, then compares their logs
+bool Server::checkDigest(uint64_t id, const CaptureDigest &digest) {
+	std::shared_ptr<Session> session = sessions.find(id);
+	if (!session) {
+		logError("session doesn't exist in the replay", "session", LogHex{id});
+		return false;
+	}
+
+	uint64_t seq = session->getStatus().seq;
+	uint64_t last_progress = getMonotonicMicros();
+	while (seq < digest.seq && getMonotonicMicros() - last_progress < REPLAY_SETTLE_TIMEOUT_MS * 1000) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		const uint64_t current = session->getStatus().seq;
+		if (current != seq) {
+			seq = current;
+			last_progress = getMonotonicMicros();
+		}
+	}
+
+	if (seq != digest.seq) {
+		logError("replayed session has a different number of events", "session", LogHex{id}, "replayed", seq, "recorded", digest.seq);
+		return false;
+	} else if (session->getLogDigest(digest.seq) != digest.hash) {
+		logError("replayed log differs from the recorded one", "session", LogHex{id});
+		return false;
+	}
+
+	return true;
+}
+
+int Server::replay() {
+	CaptureReader reader;
+	if (!reader.open(replay_path)) {
+		return 1;
+	}
+
+	logInfo("replaying capture", "path", replay_path, "mib", reader.getSize() / (1024 * 1024), "fast", replay_fast);
+
+	std::unordered_map<uint64_t, std::shared_ptr<Connection>> connections;
+	const auto disconnect = [&](const std::shared_ptr<Connection> &connection) {
+		connection->abort();
+		if (network->callbacks.on_disconnect) {
+			network->callbacks.on_disconnect(connection);
+		}
+	};
+
+	uint64_t num_frames = 0, num_connections = 0, num_sessions = 0, num_identical = 0;
+	const uint64_t start = getMonotonicMicros();
+	uint64_t run_start = start;
+
+	CaptureRecord record;
+	std::span<const uint8_t> payload;
+	while (reader.next(record, payload)) {
+		if (!replay_fast && record.kind != CaptureRecord::Start) {
+			const uint64_t now = getMonotonicMicros();
+			if (run_start + record.time_us > now) {
+				std::this_thread::sleep_for(std::chrono::microseconds(run_start + record.time_us - now));
+			}
+		}
+
+		switch (record.kind) {
+			case CaptureRecord::Start: {
+				// the recording server was restarted, its clients are gone
+				for (const auto &[id, connection] : connections) {
+					disconnect(connection);
+				}
+				connections.clear();
+				run_start = getMonotonicMicros();
+			} break;
+			case CaptureRecord::Connect: {
+				std::shared_ptr<Connection> connection = std::make_shared<ReplayConnection>(record.id);
+				connections[record.id] = connection;
+				num_connections++;
+
+				if (network->callbacks.on_connect) {
+					network->callbacks.on_connect(connection);
+				}
+			} break;
+			case CaptureRecord::Frame: {
+				const auto it = connections.find(record.id);
+				if (it == connections.end() || payload.size() != sizeof(Message)) {
+					break;
+				}
+
+				Message msg;
+				memcpy(&msg, payload.data(), sizeof(Message));
+				num_frames++;
+
+				// the backends stamp this on every read, the heartbeat would drop the connection otherwise
+				it->second->last_receive_us = getMonotonicMicros();
+
+				if (network->callbacks.on_message) {
+					network->callbacks.on_message(it->second, msg);
+				}
+			} break;
+			case CaptureRecord::Disconnect: {
+				const auto it = connections.find(record.id);
+				if (it != connections.end()) {
+					disconnect(it->second);
+					connections.erase(it);
+				}
+			} break;
+			case CaptureRecord::Create: {
+				uint32_t num_players = 0;
+				if (payload.size() == sizeof(num_players)) {
+					memcpy(&num_players, payload.data(), sizeof(num_players));
+					createSession(num_players, record.id);
+				}
+			} break;
+			case CaptureRecord::Destroy: {
+				destroySession(record.id);
+			} break;
+			case CaptureRecord::Digest: {
+				CaptureDigest digest;
+				if (payload.size() == sizeof(digest)) {
+					memcpy(&digest, payload.data(), sizeof(digest));
+					num_sessions++;
+					num_identical += checkDigest(record.id, digest);
+				}
+			} break;
+		}
+	}
+
+	const double seconds = std::max(double(getMonotonicMicros() - start) / 1000 / 1000, 0.001);
+	logInfo("replayed capture", "frames", num_frames, "connections", num_connections, "seconds", seconds, "frames_per_s", uint64_t(num_frames / seconds), "bytes_sent", ReplayConnection::bytes_sent.load(), "sessions", num_sessions, "identical", num_identical);
+
+	for (const auto &[id, connection] : connections) {
+		disconnect(connection);
+	}
+
+	// digests are written when a game ends, a session hibernates or is destroyed and when the server stops
+	if (num_sessions == 0) {
+		logError("capture has no digests, nothing was compared", "path", replay_path);
+		return 1;
+	}
+
+	return num_identical == num_sessions ? 0 : 1;
+}
+
+void Server::registerRoutes() {
+	static constexpr const char *SESSION = R"(/sessions/([0-9a-fA-F]{1,16}))";
+	static constexpr size_t MAX_LOG_EVENTS = 1024;
+
+	const auto error = [](httplib::Response &res, int status, std::string_view message) {
+		res.status = status;
+		res.set_content(std::format(R"({{"error":"{}"}})", message), "application/json");
+	};
+
+	// players=<2..8>
+	http_server.Post("/sessions", [this, error](const httplib::Request &req, httplib::Response &res) {
+		const std::optional<uint64_t> num_players = parseNumber(req.get_param_value("players"));
+		if (!num_players || num_players.value() < 2 || num_players.value() > 8) {
+			error(res, 400, "players must be between 2 and 8");
+			return;
+		}
+
+		const uint64_t id = createSession(num_players.value());
+		res.status = 201;
+		res.set_content(std::format(R"({{"id":"{:016x}"}})", id), "application/json");
+	});
+
+	// prometheus scrapes only read the metrics' atomics
+	http_server.Get("/metrics", [](const httplib::Request&, httplib::Response &res) {
+		res.set_content(MetricsRegistry::get().render(), "text/plain; version=0.0.4");
+	});
+
+	// chrome trace event json of the spans that are still in the buffers, load it in perfetto or chrome://tracing
+	http_server.Get("/trace", [](const httplib::Request&, httplib::Response &res) {
+		res.set_content(Tracer::dump(), "application/json");
+	});
+
+	http_server.Post("/trace/start", [](const httplib::Request&, httplib::Response &res) {
+		Tracer::setEnabled(true);
+		res.status = 204;
+	});
+
+	http_server.Post("/trace/stop", [](const httplib::Request&, httplib::Response &res) {
+		Tracer::setEnabled(false);
+		res.status = 204;
+	});
+
+	// players=<2..8> for the start position or key=<hex> of any position
+	http_server.Get("/explorer", [this, error](const httplib::Request &req, httplib::Response &res) {
+		if (!explorer) {
+			error(res, 404, "no explorer loaded");
+			return;
+		}
+
+		std::optional<uint64_t> key;
+		if (req.has_param("key")) {
+			key = parseNumber(req.get_param_value("key"), 16);
+		} else if (const std::optional<uint64_t> num_players = parseNumber(req.get_param_value("players")); num_players && num_players.value() >= 2 && num_players.value() <= 8) {
+			Field field;
+			field.init(num_players.value());
+			key = field.calculateKey();
+		}
+
+		if (!key) {
+			error(res, 400, "players must be between 2 and 8, or a key must be given");
+			return;
+		}
+
+		res.set_content(explorer->toJson(key.value()), "application/json");
+	});
+
+	http_server.Get("/sessions", [this](const httplib::Request&, httplib::Response &res) {
+		res.set_content(getSessionListing(), "application/json");
+	});
+
+	http_server.Get(SESSION, [this, error](const httplib::Request &req, httplib::Response &res) {
+		const uint64_t id = parseNumber(req.matches[1].str(), 16).value();
+		std::shared_ptr<Session> session = findSession(id);
+		if (!session) {
+			error(res, 404, "no such session");
+			return;
+		}
+
+		const SessionStatus status = session->getStatus();
+		const uint64_t now = timers->now();
+
+		std::string body = std::format(R"({{"id":"{:016x}","players":{},"current_player":{},"seq":{},"spectators":{},"clocks_running":{},"seats":[)",
+			id, status.num_players, status.current_player, status.seq, status.spectators, status.clocks_running);
+		for (uint32_t i = 0; i < status.seats.size(); i++) {
+			const SessionStatus::Seat &seat = status.seats[i];
+			// null until the seat answered a heartbeat ping
+			const bool measured = seat.connection && seat.connection->rtt.samples > 0;
+			body += std::format(R"({}{{"name":"{}","connected":{},"out":{},"remaining_ms":{},"rtt_us":{},"jitter_us":{}}})", i > 0 ? "," : "",
+				escapeJson(seat.name), seat.connected, seat.out, status.getRemainingTime(i, now),
+				measured ? std::to_string(seat.connection->rtt.srtt.load()) : "null", measured ? std::to_string(seat.connection->rtt.jitter.load()) : "null");
+		}
+		body += "]}";
+
+		res.set_content(body, "application/json");
+	});
+
+	// since=<seq> limit=<count>, events are numbered like the seq of the messages
+	http_server.Get(std::string(SESSION) + "/log", [this, error](const httplib::Request &req, httplib::Response &res) {
+		const uint64_t id = parseNumber(req.matches[1].str(), 16).value();
+		std::shared_ptr<Session> session = findSession(id);
+		if (!session) {
+			error(res, 404, "no such session");
+			return;
+		}
+
+		const uint64_t since = req.has_param("since") ? parseNumber(req.get_param_value("since")).value_or(0) : 0;
+		const uint64_t limit = req.has_param("limit") ? parseNumber(req.get_param_value("limit")).value_or(MAX_LOG_EVENTS) : MAX_LOG_EVENTS;
+
+		const std::vector<Session::Event> events = session->getEvents(since, std::min<uint64_t>(limit, MAX_LOG_EVENTS));
+
+		std::string body = std::format(R"({{"since":{},"events":[)", since);
+		for (size_t i = 0; i < events.size(); i++) {
+			const Session::Event &event = events[i];
+			body += std::format(R"({}{{"seq":{},"player":{},"kind":"{}","from":{},"to":{},"promotion":"{}"}})", i > 0 ? "," : "",
+				since + i + 1, event.player, Session::Event::getKindName(event.kind), event.from, event.to, event.promotion);
+		}
+		body += "]}";
+
+		res.set_content(body, "application/json");
+	});
+
+	// the game so far as a game record, format=text for the readable export
+	http_server.Get(std::string(SESSION) + "/record", [this, error](const httplib::Request &req, httplib::Response &res) {
+		const uint64_t id = parseNumber(req.matches[1].str(), 16).value();
+		std::shared_ptr<Session> session = findSession(id);
+		if (!session) {
+			error(res, 404, "no such session");
+			return;
+		}
+
+		const GameRecord record = session->getRecord();
+		if (req.get_param_value("format") == "text") {
+			res.set_content(record.toText(), "text/plain");
+		} else {
+			const std::vector<uint8_t> data = record.encode();
+			res.set_content(reinterpret_cast<const char*>(data.data()), data.size(), "application/octet-stream");
+		}
+	});
+
+	// moves played from the session's position in the games of the explorer
+	http_server.Get(std::string(SESSION) + "/explorer", [this, error](const httplib::Request &req, httplib::Response &res) {
+		if (!explorer) {
+			error(res, 404, "no explorer loaded");
+			return;
+		}
+
+		const uint64_t id = parseNumber(req.matches[1].str(), 16).value();
+		std::shared_ptr<Session> session = findSession(id);
+		if (!session) {
+			error(res, 404, "no such session");
+			return;
+		}
+
+		const GameRecord record = session->getRecord();
+		Field field;
+		record.seek(field, record.getEvents().size());
+		res.set_content(explorer->toJson(field.calculateKey()), "application/json");
+	});
+
+	// server-sent events are served by the network backend on their own port, the same path there
+	http_server.Get(std::string(SESSION) + "/events", [this, error](const httplib::Request &req, httplib::Response &res) {
+		if (event_stream_port == 0) {
+			error(res, 404, "server-sent events are disabled");
+			return;
+		}
+
+		std::string host = req.get_header_value("Host");
+		host = host.substr(0, host.starts_with('[') ? host.find(']') + 1 : host.find(':'));
+		res.set_redirect(std::format("http://{}:{}{}", host.empty() ? "localhost" : host, event_stream_port, req.path), 307);
+	});
+
+	http_server.Delete(SESSION, [this, error](const httplib::Request &req, httplib::Response &res) {
+		if (!destroySession(parseNumber(req.matches[1].str(), 16).value())) {
+			error(res, 404, "no such session");
+			return;
+		}
+
+		res.status = 204;
+	});
+}
+
+std::string Server::getSessionListing() {
+	std::scoped_lock<std::mutex> lock{listing_mutex};
+
+	// loaded before serializing, a change in the meantime is picked up by the next request
+	const uint64_t changes = Session::status_changes;
+	if (changes == listing_changes) {
+		return listing;
+	}
+
+	listing = "[";
+	sessions.forEach([&](uint64_t id, const std::shared_ptr<Session> &session) {
+		const SessionStatus status = session->getStatus();
+		listing += std::format(R"({}{{"id":"{:016x}","players":{},"seated":{},"spectators":{},"current_player":{},"seq":{}}})", listing.size() > 1 ? "," : "",
+			id, status.num_players, status.getSeatedCount(), status.spectators, status.current_player, status.seq);
+	});
+
+	// what a hibernated session looks like is only in its snapshot
+	if (!hibernate_dir.empty()) {
+		std::shared_lock<std::shared_mutex> lock{hibernation_mutex};
+		for (const auto &[id, entry] : hibernated) {
+			listing += std::format(R"({}{{"id":"{:016x}","hibernated":true}})", listing.size() > 1 ? "," : "", id);
+		}
+	}
+	listing += "]";
+
+	listing_changes = changes;
+	return listing;
 }
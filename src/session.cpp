@@ -3,8 +3,11 @@
 #include "SDL3_net/SDL_net.h"
 #include "SDL_error.h"
 #include "chess.hpp"
-#include "io.hpp"
+#include "log.hpp"
 #include "message.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "wal.hpp"
 
 #include <algorithm>
 #include <cassert>
@@ -14,7 +17,6 @@
 #include <mutex>
 #include <optional>
 #include <string>
-#include <thread>
 
 Session::Session() {}
 
@@ -27,38 +29,130 @@ void Session::initLocal(uint32_t num_players) {
 	initializeField(num_players);
 }
 
-void Session::initClient(const std::string &hostname, uint16_t port, const std::string &player_name) {
+void Session::initClient(const std::string &hostname, uint16_t port, uint64_t session, const std::string &player_name) {
 	mode = Mode::Client;
+	id = session;
+	server_hostname = hostname;
+	server_port = port;
+	last_seq = 0;
 	connectToServer(hostname, port);
-	sendMessageToServer(Message::makeJoin(0, -1, player_name));
+	sendMessageToServer(Message::makeJoin(id, -1, player_name));
 }
 
-void Session::initHost(uint32_t num_players, std::optional<uint16_t> port) {
+void Session::initSpectator(const std::string &hostname, uint16_t port, uint64_t session) {
+	mode = Mode::Client;
+	id = session;
+	spectating = true;
+	server_hostname = hostname;
+	server_port = port;
+	last_seq = 0;
+	connectToServer(hostname, port);
+	sendMessageToServer(Message::makeSpectate(id));
+}
+
+void Session::resumeClient() {
+	assert(canResume());
+
+	mode = Mode::Client;
+	spectating = resume_player == ~0u;
+	connectToServer(server_hostname, server_port);
+	sendMessageToServer(Message::makeResume(id, resume_player, last_seq));
+}
+
+bool Session::canResume() const {
+	return mode == Mode::None && !server_hostname.empty() && field.num_players > 0;
+}
+
+bool Session::initHost(uint32_t num_players, std::optional<uint16_t> port, NetBackend *network) {
 	mode = Mode::Host;
 	initializeField(num_players);
-	if (port) {
-		server = SDLNet_CreateServer(nullptr, port.value());
+	this->network = network;
+
+	// without a backend every move would be broadcast through a null network
+	if (port && !listen(port.value())) {
+		deinit();
+		return false;
 	}
+	return true;
 }
 
-void Session::initHostHybrid(uint32_t num_players, std::optional<uint16_t> port, const std::string &player_name) {
+bool Session::initHostHybrid(uint32_t num_players, std::optional<uint16_t> port, const std::string &player_name) {
 	mode = Mode::HostHybrid;
 	initializeField(num_players);
-	if (port) {
-		server = SDLNet_CreateServer(nullptr, port.value());
+	if (port && !listen(port.value())) {
+		deinit();
+		return false;
 	}
 
 	players[0] = Player(player_name, true);
+	return true;
 }
 
-void Session::launchThread() {
-	thread = std::thread([this](){
-		while (!stop) {
-			acceptQueuedPlayers();
-			waitForMessagesFromClients();
-			receiveMessagesFromClients();
+void Session::attach(Scheduler *scheduler) {
+	this->scheduler = scheduler;
+	wakeup();
+}
+
+void Session::setClocks(TimerWheel *timers, uint64_t base_ms, uint64_t increment_ms) {
+	this->timers = timers;
+	clock_base_ms = base_ms;
+	clock_increment_ms = increment_ms;
+	clocks.assign(field.num_players, base_ms);
+}
+
+void Session::recover(const RecoveredSession &state) {
+	assert(mode & Mode::Host);
+
+	clocks = state.clocks;
+	for (size_t i = 0; i < players.size() && i < state.names.size(); i++) {
+		players[i].name = state.names[i];
+	}
+
+	for (size_t i = 0; i < players.size() && i < state.connections.size(); i++) {
+		if (state.connections[i] && !state.connections[i]->isClosed()) {
+			players[i].connection = state.connections[i];
 		}
-	});
+	}
+
+	// the same steps as handling the moves from the clients, without the broadcasts and clocks
+	for (const Event &event : state.events) {
+		applyEvent(field, event);
+		if (event.kind == Event::Timeout && event.player < clocks.size()) {
+			clocks[event.player] = 0;
+		}
+
+		log.push_back(event);
+	}
+}
+
+bool Session::hibernate(uint64_t min_idle_us, RecoveredSession &state) {
+	assert(mode & Mode::Host);
+
+	// with the queues locked nothing new reaches the session, and a session without a task
+	// or a pending spectator flush isn't touched by anyone else
+	std::scoped_lock<std::mutex, std::mutex, std::mutex> lock{queue_mutex, inbox_mutex, spectator_mutex};
+	if (closing || clocks_running || getMonotonicMicros() - last_activity_us < min_idle_us) {
+		return false;
+	} else if (scheduled != 0 || spectator_flush_scheduled != 0 || !inbox.empty() || !queue.empty() || !spectator_queue.empty() || !spectators.empty() || !spectator_backlog.empty()) {
+		return false;
+	}
+
+	state.id = id;
+	state.num_players = field.num_players;
+	state.clock_base_ms = clock_base_ms;
+	state.clock_increment_ms = clock_increment_ms;
+	state.events = log;
+	state.clocks = clocks;
+
+	state.names.resize(players.size());
+	state.connections.resize(players.size());
+	for (size_t i = 0; i < players.size(); i++) {
+		state.names[i] = players[i].name;
+		state.connections[i] = std::move(players[i].connection);
+	}
+
+	closing = true;
+	return true;
 }
 
 void Session::initializeField(uint32_t num_players) {
@@ -68,31 +162,164 @@ void Session::initializeField(uint32_t num_players) {
 }
 
 void Session::deinit() {
-	if (server) {
-		SDLNet_DestroyServer(server);
-		server = nullptr;
-	}
-
 	if (socket) {
 		SDLNet_DestroyStreamSocket(socket);
 		socket = nullptr;
 	}
 
 	if (mode & Mode::Host) {
-		for (SDLNet_StreamSocket *socket : clients) {
-			SDLNet_DestroyStreamSocket(socket);
+		closeClients();
+
+		for (const std::shared_ptr<Connection> &connection : resyncing) {
+			connection->close();
 		}
-		clients.clear();
+		resyncing.clear();
+	}
 
-		std::scoped_lock<std::mutex> queue_lock{queue_mutex};
-		queue.clear();
+	if (clocks_running) {
+		timers->cancel(clock_timer);
+		clocks_running = false;
 	}
+	clocks.clear();
+
+	backend.reset();
+	network = nullptr;
 
 	players.clear();
 
+	spectating = false;
 	mode = Mode::None;
 }
 
+void Session::closeClients() {
+	for (Player &player : players) {
+		if (player.connection) {
+			player.connection->close();
+		}
+	}
+
+	std::scoped_lock<std::mutex> queue_lock{queue_mutex};
+	for (QueuedPlayer &queued : queue) {
+		queued.player.connection->close();
+	}
+	queue.clear();
+
+	for (const auto &[connection, resume] : spectator_queue) {
+		connection->close();
+	}
+	spectator_queue.clear();
+
+	std::scoped_lock<std::mutex> spectator_lock{spectator_mutex};
+	for (const std::shared_ptr<Connection> &connection : spectators) {
+		connection->close();
+	}
+
+	for (const auto &[connection, buffer] : spectator_backlog) {
+		if (connection) {
+			connection->close();
+		}
+	}
+
+	spectators.clear();
+	spectator_backlog.clear();
+	num_spectators = 0;
+}
+
+void Session::close() {
+	closing = true;
+	queueMessageFromClient(nullptr, Message::makeReject());
+}
+
+void Session::publishStatus() {
+	SessionStatus current;
+	current.num_players = field.num_players;
+	current.current_player = field.current_player;
+	current.seq = log.size();
+	current.clocks_running = clocks_running;
+	current.clock_started = clock_started;
+	current.seats.resize(players.size());
+	for (uint32_t i = 0; i < players.size(); i++) {
+		SessionStatus::Seat &seat = current.seats[i];
+		seat.name = players[i].name;
+		seat.connected = players[i].connection != nullptr || players[i].is_host;
+		seat.out = field.players[i].is_checkmate;
+		seat.clock_ms = i < clocks.size() ? clocks[i] : 0;
+		seat.connection = players[i].connection;
+	}
+
+	std::scoped_lock<std::mutex> lock{status_mutex};
+	if (current == status) {
+		return;
+	}
+
+	// the log only grows on the host, the published copy catches up with the new events
+	events.append(log, events.size());
+	status = std::move(current);
+	status_changes++;
+}
+
+SessionStatus Session::getStatus() {
+	SessionStatus current;
+	{
+		std::scoped_lock<std::mutex> lock{status_mutex};
+		current = status;
+	}
+
+	std::scoped_lock<std::mutex> lock{spectator_mutex};
+	current.spectators = num_spectators;
+	return current;
+}
+
+GameRecord Session::getRecord() {
+	std::vector<std::string> names;
+	EventLog copy;
+	uint32_t num_players;
+	{
+		std::scoped_lock<std::mutex> lock{status_mutex};
+		num_players = status.num_players;
+		for (const SessionStatus::Seat &seat : status.seats) {
+			names.push_back(seat.name);
+		}
+		copy = events;
+	}
+
+	GameRecord record;
+	record.create(num_players, names, copy);
+	return record;
+}
+
+std::vector<Session::Event> Session::getEvents(uint64_t since, size_t max_count) {
+	std::scoped_lock<std::mutex> lock{status_mutex};
+	if (since >= events.size()) {
+		return {};
+	}
+
+	const size_t count = std::min<size_t>(events.size() - since, max_count);
+	return std::vector<Event>(events.begin() + since, events.begin() + since + count);
+}
+
+uint64_t Session::getLogDigest(uint64_t count) {
+	uint64_t hash = 0xcbf29ce484222325;
+	const auto append = [&](uint64_t value) {
+		for (uint32_t i = 0; i < 8; i++) {
+			hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 0x100000001b3;
+		}
+	};
+
+	std::scoped_lock<std::mutex> lock{status_mutex};
+	append(status.num_players);
+	for (size_t i = 0; i < std::min<size_t>(count, events.size()); i++) {
+		const Event &event = events[i];
+		append(event.player);
+		append(event.from);
+		append(event.to);
+		append(uint64_t(event.promotion));
+		append(event.kind);
+	}
+
+	return hash;
+}
+
 void Session::moveFigure(uint32_t from, uint32_t to, MoveType type) {
 	const uint32_t player = field.current_player;
 
@@ -136,163 +363,364 @@ void Session::promoteFigure(uint32_t id, Figure to) {
 	}
 }
 
+void Session::update() {
+	if (mode & Mode::Host) {
+		if (backend) {
+			backend->poll(0);
+		}
+
+		acceptQueuedPlayers();
+		acceptQueuedSpectators();
+		receiveMessagesFromClients();
+		publishStatus();
+	} else if (mode == Mode::Client) {
+		const uint64_t now = getMonotonicMicros();
+		if (socket && now - last_ping_us >= PING_INTERVAL_US) {
+			sendMessageToServer(Message::makePing(now));
+			last_ping_us = now;
+		}
+
+		receiveMessageFromServer();
+	}
+}
+
 void Session::switchToNextPlayer() {
+	HistogramTimer timer{Metrics::switch_player};
 	field.switchToNextPlayer();
 	if (mode == Mode::Local) {
 		field.player_pov = field.current_player;
 	}
 }
 
+void Session::startClocks() {
+	if (!timers || clock_base_ms == 0 || clocks_running) {
+		return;
+	}
+
+	clocks_running = true;
+	for (uint32_t i = 0; i < clocks.size(); i++) {
+		sendMessageToAllClients(Message::makeClock(i, clocks[i], field.current_player));
+	}
+
+	armClock();
+}
+
+// stops the clock of the player who just moved, adds the increment and starts the clock of the next one
+void Session::switchClocks(uint32_t previous) {
+	if (!clocks_running) {
+		return;
+	}
+
+	timers->cancel(clock_timer);
+
+	const uint64_t elapsed = timers->now() - clock_started;
+	clocks[previous] = (clocks[previous] > elapsed ? clocks[previous] - elapsed : 0) + clock_increment_ms;
+	if (wal) {
+		wal->writeClock(id, previous, clocks[previous]);
+	}
+	sendMessageToAllClients(Message::makeClock(previous, std::max<uint64_t>(clocks[previous], 1), field.current_player));
+
+	armClock();
+}
+
+void Session::armClock() {
+	const uint32_t player = field.current_player;
+	const uint64_t turn = ++clock_turn;
+	clock_started = timers->now();
+
+	// the expiration is delivered through the inbox like a message, so it is ordered with the moves
+	clock_timer = timers->schedule(clocks[player], [session = weak_from_this(), player, turn]() {
+		if (std::shared_ptr<Session> locked = session.lock()) {
+			Message msg = Message::makeClock(player, 0, 0);
+			msg.seq = turn;
+			locked->queueMessageFromClient(nullptr, msg);
+		}
+	});
+}
+
+void Session::handleClockExpired(const Message &msg) {
+	if (!clocks_running || msg.seq != clock_turn || msg.player != field.current_player) {
+		return;
+	}
+
+	const uint32_t player = msg.player;
+	logInfo("player ran out of time", "session", LogHex{id}, "player", player, "name", players[player].name);
+
+	clocks[player] = 0;
+	field.players[player].is_checkmate = true;
+	appendToLog(Event(player, 0, 0, Figure::None, Event::Kind::Timeout));
+
+	switchToNextPlayer();
+	sendMessageToAllClients(Message::makeClock(player, 0, field.current_player));
+
+	uint32_t remaining = 0;
+	for (uint32_t i = 0; i < field.num_players; i++) {
+		if (!field.players[i].is_checkmate) {
+			remaining++;
+		}
+	}
+
+	if (remaining > 1) {
+		armClock();
+	} else {
+		clocks_running = false;
+	}
+}
+
+uint64_t Session::getRemainingTime(uint32_t player) const {
+	if (player >= clocks.size()) {
+		return 0;
+	}
+
+	uint64_t elapsed = 0;
+	if (player == field.current_player && clocks[player] > 0) {
+		if (mode & Mode::Host) {
+			elapsed = clocks_running ? timers->now() - clock_started : 0;
+		} else {
+			elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - clock_updated).count();
+		}
+	}
+
+	return clocks[player] > elapsed ? clocks[player] - elapsed : 0;
+}
+
+bool Session::listen(uint16_t port) {
+	backend = NetBackend::create(NetBackend::SDLNet);
+	if (!backend->listen(port)) {
+		logError("couldn't listen for clients", "session", LogHex{id}, "port", port);
+		backend.reset();
+		return false;
+	}
+
+	network = backend.get();
+
+	backend->callbacks.on_message = [this](const std::shared_ptr<Connection> &connection, const Message &msg) {
+		if (connection->handleHeartbeat(msg)) {
+			return;
+		} else if (connection->session != ~0ull) {
+			queueMessageFromClient(connection, msg);
+		} else if (addClient(connection, msg)) {
+			connection->session = id;
+		} else {
+			logInfo("client didn't send a join request after connecting", "address", connection->getAddress());
+			connection->close();
+		}
+	};
+
+	backend->callbacks.on_disconnect = [this](const std::shared_ptr<Connection> &connection) {
+		queueMessageFromClient(connection, Message());
+	};
+
+	return true;
+}
+
+void Session::wakeup() {
+	if (!scheduler) {
+		return;
+	}
+
+	// only the first wakeup posts a task, later ones are picked up by the running task,
+	// so a session is never processed by two workers at once and its messages stay in order
+	if (scheduled.fetch_add(1) == 0) {
+		scheduler->post([session = shared_from_this()]() {
+			uint32_t count = session->scheduled.load();
+			while (true) {
+				session->acceptQueuedPlayers();
+				session->acceptQueuedSpectators();
+				session->receiveMessagesFromClients();
+				session->publishStatus();
+
+				const uint32_t remaining = session->scheduled.fetch_sub(count) - count;
+				if (remaining == 0) {
+					break;
+				}
+
+				count = remaining;
+			}
+		});
+	}
+}
+
 void Session::disconnectClient(uint64_t player) {
 	assert(mode & Mode::Host);
 
-	println("client ({}) disconnected\n",
-		SDLNet_GetAddressString(SDLNet_GetStreamSocketAddress(players[player].socket))
-	);
+	logInfo("client disconnected", "session", LogHex{id}, "player", player, "name", players[player].name, "address", players[player].getAddress());
 
-	SDLNet_DestroyStreamSocket(players[player].socket);
-	clients.erase(std::find(clients.begin(), clients.end(), players[player].socket));
-	players[player].socket = nullptr;
+	players[player].connection->close();
+	players[player].connection = nullptr;
 }
 
-void Session::waitForMessagesFromClients(int timeout) {
-	SDLNet_WaitUntilInputAvailable((void**)clients.data(), clients.size(), timeout);
+void Session::queueMessageFromClient(const std::shared_ptr<Connection> &connection, const Message &msg) {
+	{
+		std::scoped_lock<std::mutex> lock{inbox_mutex};
+		inbox.push_back({connection, msg});
+		last_activity_us = getMonotonicMicros();
+	}
+
+	wakeup();
 }
 
 void Session::receiveMessagesFromClients() {
 	assert(mode & Mode::Host);
+	TraceSpan span{"receiveMessagesFromClients"};
 
-	for (size_t i = 0; i < players.size(); i++) {
-		if (players[i].socket == nullptr) {
+	std::vector<std::pair<std::shared_ptr<Connection>, Message>> messages;
+	{
+		std::scoped_lock<std::mutex> lock{inbox_mutex};
+		std::swap(messages, inbox);
+	}
+
+	for (const auto &[connection, msg] : messages) {
+		// messages without a connection come from the server itself
+		if (!connection) {
+			if (msg.type == Message::Clock) {
+				handleClockExpired(msg);
+			} else if (msg.type == Message::Reject) {
+				if (clocks_running) {
+					timers->cancel(clock_timer);
+					clocks_running = false;
+				}
+
+				// spectators waiting for a resync belong to the spectator task, it closes them
+				closeClients();
+				scheduleSpectatorFlush();
+			}
 			continue;
 		}
 
-		Message msg;
-		const int size = SDLNet_ReadFromStreamSocket(players[i].socket, &msg, sizeof(Message));
-		if (size == 0) {
-			continue;
-		} else if (size < 0) {
-			println("error while receiving message from client {}[{}], disconnecting ...",
-				players[i].name,
-				SDLNet_GetAddressString(SDLNet_GetStreamSocketAddress(players[i].socket))
-			);
-			disconnectClient(i);
-			continue;
-		} else if (size != sizeof(Message)) {
-			println("received incomplete message from client {}[{}], disconnecting ...",
-				players[i].name,
-				SDLNet_GetAddressString(SDLNet_GetStreamSocketAddress(players[i].socket))
-			);
-			disconnectClient(i);
+		const uint32_t player = connection->player;
+		if (player >= players.size() || players[player].connection != connection) {
 			continue;
 		}
 
-		handleMessageFromClient(i, msg);
+		handleMessageFromClient(player, msg);
+	}
+
+	for (size_t i = 0; i < players.size(); i++) {
+		if (players[i].connection && players[i].connection->isClosed()) {
+			disconnectClient(i);
+		}
 	}
 }
 
 void Session::handleMessageFromClient(uint64_t player, Message msg) {
+	TraceSpan span{"handleMessageFromClient"};
+
 	switch (msg.type) {
 		case Message::None:
 		case Message::Join:
 		case Message::Accept:
-		case Message::Reject: {} break;
+		case Message::Reject:
+		case Message::Spectate:
+		case Message::Resume:
+		case Message::Clock:
+		case Message::Ping:
+		case Message::Pong: {} break;
 
 		case Message::Move: {
-			if (field.current_player != player) {
+			// a move after the flag fell is ignored, the expiration is already on its way
+			if (field.current_player != player || (clocks_running && getRemainingTime(player) == 0)) {
+				break;
+			}
+
+			// the client is trusted with nothing, its ids index the tiles; a pawn waiting for its promotion blocks the turn
+			if (field.findPendingPromotion(player) != UINT32_MAX || !field.isMoveLegal(player, msg.move.from, msg.move.to, msg.move.type)) {
+				logWarn("ignoring an illegal move", "session", LogHex{id}, "player", player, "from", msg.move.from, "to", msg.move.to);
 				break;
 			}
 
+			HistogramTimer timer{Metrics::move_handling};
+			msg.player = player;
 			field.moveFigure(msg.move.from, msg.move.to, msg.move.type);
 			onFigureMoved(msg.player, msg.move.from, msg.move.to, msg.move.type);
 
 			if (field.tiles[msg.move.to].figure != Figure::Pawn || getY(msg.move.to) != 0) {
-				field.switchToNextPlayer();
+				switchToNextPlayer();
 			}
 
 			msg.move.next_player = field.current_player;
 			sendMessageToAllClients(msg);
+
+			if (field.current_player != player) {
+				switchClocks(player);
+			}
 		} break;
 		case Message::Promotion: {
-			if (field.current_player != player) {
+			if (field.current_player != player || (clocks_running && getRemainingTime(player) == 0)) {
 				break;
 			}
 
-			if (field.tiles[msg.promotion.id].figure == Figure::Pawn && getY(msg.promotion.id) == 0) {
-				field.tiles[msg.promotion.id].figure = msg.promotion.figure;
+			// only the player's own pawn on the last row, and not into a king
+			const Figure figure = msg.promotion.figure;
+			if (msg.promotion.id != field.findPendingPromotion(player) || figure < Figure::Bishop || figure > Figure::Queen) {
+				logWarn("ignoring an illegal promotion", "session", LogHex{id}, "player", player, "tile", msg.promotion.id, "figure", uint32_t(figure));
+				break;
 			}
 
+			HistogramTimer timer{Metrics::move_handling};
+			msg.player = player;
+			field.tiles[msg.promotion.id].figure = figure;
+
 			onFigurePromoted(msg.player, msg.promotion.id, msg.promotion.figure);
 
-			field.switchToNextPlayer();
+			switchToNextPlayer();
 			msg.promotion.next_player = field.current_player;
 			sendMessageToAllClients(msg);
+			switchClocks(player);
 		} break;
 	}
 }
 
-void Session::sendMessageToAllClients(const Message &msg) {
+void Session::sendMessageToAllClients(Message msg) {
 	assert(mode & Mode::Host);
 
+	msg.seq = log.size();
+
+	std::vector<std::shared_ptr<Connection>> targets;
+	targets.reserve(players.size());
+
 	for (size_t i = 0; i < players.size(); i++) {
-		if (players[i].socket == nullptr) {
-			continue;
+		if (players[i].connection != nullptr && !players[i].connection->isClosed()) {
+			targets.push_back(players[i].connection);
 		}
+	}
 
-		if (SDLNet_WriteToStreamSocket(players[i].socket, &msg, sizeof(Message)) != 0) {
-			println("error while sending to client {}, disconnecting ...",
-				SDLNet_GetAddressString(SDLNet_GetStreamSocketAddress(players[i].socket))
-			);
-			disconnectClient(i);
-		}
+	// encoded once, every client queues the same buffer; clients whose writes fail are
+	// disconnected afterwards in receiveMessagesFromClients instead of in the middle of the fan-out
+	const SharedBuffer buffer = network->encode(asBytes(msg));
+	{
+		HistogramTimer timer{Metrics::broadcast_fanout};
+		network->broadcast(targets, buffer);
 	}
+	publishToSpectators(buffer);
 }
 
-void Session::sendMessageToClient(uint64_t index, const Message &msg) {
+void Session::sendMessageToClient(uint64_t index, Message msg) {
 	assert(mode & Mode::Host);
 
-	if (players[index].socket == nullptr) {
+	msg.seq = log.size();
+
+	if (players[index].connection == nullptr) {
 		return;
 	}
 
-	if (SDLNet_WriteToStreamSocket(players[index].socket, &msg, sizeof(Message)) != 0) {
-		println("error while sending to client {}({}), disconnecting ...", players[index].name, players[index].getAddress());
+	if (!players[index].connection->sendObject(msg)) {
+		logWarn("error while sending to client, disconnecting", "session", LogHex{id}, "player", index, "name", players[index].name, "address", players[index].getAddress());
 		disconnectClient(index);
 	}
 }
 
 void Session::acceptQueuedPlayers() {
 	assert(mode & Mode::Host);
+	TraceSpan span{"acceptQueuedPlayers"};
 
 	std::scoped_lock<std::mutex> queue_lock{queue_mutex};
 
-	if (server) {
-		Player player;
-		if (SDLNet_AcceptClient(server, &player.socket) != 0) {
-			eprintln("couldn't accept client: {}\n", SDL_GetError());
-		} else if (player.socket) {
-			Message msg;
-			if (receiveBlocking<Message>(player.socket, &msg, 1) == 0) {
-				assert(msg.type == Message::Join);
-				std::string tmp(sizeof(msg.join.name) + 1, '\0');
-				memcpy(tmp.data(), msg.join.name, sizeof(msg.join.name));
-				player.name = tmp.c_str();
-
-				const uint32_t index = msg.player;
-				queue.push_back({player, index});
-
-				println("client {}({}) added to queue as player {}", player.name, player.getAddress(), index);
-			} else {
-				println("client {} didn't send a join request after connecting", player.getAddress());
-			}
-		}
-	}
-
 	if (!queue.empty()) {
-		for (auto [player, index] : queue) {
+		for (auto [player, index, resume] : queue) {
 			if (index == ~0u) {
 				for (size_t i = 0; i < players.size(); i++) {
-					if (players[i].socket == nullptr && !players[i].is_host) {
+					if (players[i].connection == nullptr && !players[i].is_host) {
 						index = i;
 						break;
 					}
@@ -300,71 +728,412 @@ void Session::acceptQueuedPlayers() {
 			}
 
 			if (index >= players.size()) {
-				println("client {}({}) wants to join invalid spot {}", player.name, player.getAddress(), index);
-				const Message msg = Message::makeReject();
-				SDLNet_WriteToStreamSocket(player.socket, &msg, sizeof(Message));
-				SDLNet_DestroyStreamSocket(player.socket);
+				logWarn("client wants to join an invalid seat", "session", LogHex{id}, "player", index, "name", player.name, "address", player.getAddress());
+				player.connection->sendObject(Message::makeReject());
+				player.connection->close();
 				continue;
 			}
 
-			if (players[index].socket != nullptr || players[index].is_host) {
-				println("client {}({}) wants to join already occupied spot {}({})", player.name, player.getAddress(), index, players[index].name);
-				const Message msg = Message::makeReject();
-				SDLNet_WriteToStreamSocket(player.socket, &msg, sizeof(Message));
-				SDLNet_DestroyStreamSocket(player.socket);
+			if (players[index].connection != nullptr || players[index].is_host) {
+				logWarn("client wants to join an occupied seat", "session", LogHex{id}, "player", index, "name", player.name, "address", player.getAddress(), "occupant", players[index].name);
+				player.connection->sendObject(Message::makeReject());
+				player.connection->close();
 				continue;
 			}
 
-			players[index] = player;
-			clients.push_back(player.socket);
+			if (resume) {
+				player.name = players[index].name;
+			}
 
-			sendMessageToClient(index, Message::makeAccept(index, field.num_players));
-			println("accepted client {}({}) as player {}, sending match status", player.name, player.getAddress(), index);
+			// players must see every move, their queue is coalesced and they are evicted when it grows too large
+			OutboundLimits limits;
+			limits.policy = OutboundLimits::Coalesce;
+			player.connection->setOutboundLimits(limits);
 
-			SDLNet_WriteToStreamSocket(player.socket, field.tiles, sizeof(Tile) * 32 * field.num_players);
-			println("sent field to client {}({})", player.name, player.getAddress());
+			players[index] = player;
+			player.connection->player = index;
 
-			for (size_t i = 0; i < players.size(); i++) {
-				if (i == index) {
-					continue;
-				} else if (players[i].socket == nullptr && !players[i].is_host) {
-					continue;
+			player.connection->send(encodeSync(index, resume));
+			if (resume) {
+				logInfo("client resumed", "session", LogHex{id}, "player", index, "name", player.name, "address", player.getAddress(), "from", resume.value(), "seq", log.size());
+			} else {
+				logInfo("accepted client", "session", LogHex{id}, "player", index, "name", player.name, "address", player.getAddress());
+				if (wal) {
+					wal->writeJoin(id, index, player.name);
 				}
-
-				sendMessageToClient(index, Message::makeJoin(0, i, players[i].name));
 			}
 
-			sendMessageToAllClients(Message::makeJoin(0, index, player.name));
+			sendMessageToAllClients(Message::makeJoin(id, index, player.name));
 		}
 
 		queue.clear();
+
+		// the clocks start once every seat is taken
+		const bool seated = std::all_of(players.begin(), players.end(), [](const Player &player) {
+			return player.connection != nullptr || player.is_host;
+		});
+
+		if (seated) {
+			startClocks();
+		}
 	}
 }
 
-void Session::addClientToQueue(Player player, uint64_t index) {
+void Session::addClientToQueue(Player player, uint64_t index, std::optional<uint64_t> resume) {
 	assert(mode & Mode::Host);
 
-	std::scoped_lock<std::mutex> queue_lock{queue_mutex};
-	queue.push_back({player, index});
+	if (closing) {
+		player.connection->close();
+		return;
+	}
+
+	{
+		std::scoped_lock<std::mutex> queue_lock{queue_mutex};
+		queue.push_back({player, static_cast<uint32_t>(index), resume});
+		last_activity_us = getMonotonicMicros();
+	}
+
+	logDebug("client added to queue", "session", LogHex{id}, "player", index, "name", player.name, "address", player.getAddress());
+	wakeup();
+}
+
+bool Session::addClient(const std::shared_ptr<Connection> &connection, const Message &msg) {
+	switch (msg.type) {
+		case Message::Join: {
+			addClientToQueue(Player(msg.getJoinName(), connection), msg.player);
+		} break;
+		case Message::Spectate: {
+			addSpectator(connection);
+		} break;
+		case Message::Resume: {
+			if (msg.player == ~0u) {
+				addSpectator(connection, msg.seq);
+			} else {
+				addClientToQueue(Player("", connection), msg.player, msg.seq);
+			}
+		} break;
+		default: return false;
+	}
+
+	return true;
+}
+
+// everything a client needs to catch up: either a Resume followed by the moves it missed or an Accept
+// with a snapshot of the field, followed by the names of the seated players
+std::vector<uint8_t> Session::encodeSync(uint32_t player, std::optional<uint64_t> resume) {
+	std::vector<uint8_t> data;
+	const auto append = [&](std::span<const uint8_t> bytes) {
+		data.insert(data.end(), bytes.begin(), bytes.end());
+	};
+
+	if (resume && resume.value() <= log.size() && log.size() - resume.value() <= MAX_RESUME_DELTAS) {
+		Message msg = Message::makeResume(id, player, log.size());
+		append(asBytes(msg));
+		encodeDeltas(data, resume.value());
+	} else {
+		Message msg = Message::makeAccept(player, field.num_players, field.current_player);
+		msg.seq = log.size();
+		append(asBytes(msg));
+		append(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(field.tiles), sizeof(Tile) * 32 * field.num_players));
+	}
+
+	for (size_t i = 0; i < players.size(); i++) {
+		if (i == player || (players[i].connection == nullptr && !players[i].is_host)) {
+			continue;
+		}
+
+		Message msg = Message::makeJoin(id, i, players[i].name);
+		msg.seq = log.size();
+		append(asBytes(msg));
+	}
+
+	if (clocks_running) {
+		for (uint32_t i = 0; i < clocks.size(); i++) {
+			Message msg = Message::makeClock(i, clocks[i] == 0 ? 0 : std::max<uint64_t>(getRemainingTime(i), 1), field.current_player);
+			msg.seq = log.size();
+			append(asBytes(msg));
+		}
+	}
+
+	return data;
+}
+
+// replays the log since the given position, events that don't change the field have no message
+void Session::encodeDeltas(std::vector<uint8_t> &data, uint64_t since) {
+	std::vector<Message> deltas;
+
+	// the log doesn't store whose turn it was afterwards, that's whoever made the next change
+	uint32_t next_player = field.current_player;
+	for (uint64_t i = log.size(); i-- > since;) {
+		const Event &event = log[i];
+
+		Message msg;
+		switch (event.kind) {
+			case Event::Move: msg = Message::makeMove(event.player, event.from, event.to, MoveType::Move); break;
+			case Event::Capture: msg = Message::makeMove(event.player, event.from, event.to, MoveType::Capture); break;
+			case Event::Castle: msg = Message::makeMove(event.player, event.from, event.to, MoveType::Castle); break;
+			case Event::EnPassant: msg = Message::makeMove(event.player, event.from, event.to, MoveType::EnPassant); break;
+			case Event::Promote: msg = Message::makePromotion(event.player, event.from, event.promotion); break;
+			case Event::Timeout: msg = Message::makeClock(event.player, 0, 0); break;
+			case Event::Check:
+			case Event::CheckMate:
+			case Event::Surrender: continue;
+		}
+
+		if (msg.type == Message::Move) {
+			msg.move.next_player = next_player;
+		} else if (msg.type == Message::Promotion) {
+			msg.promotion.next_player = next_player;
+		} else {
+			msg.clock.next_player = next_player;
+		}
+
+		msg.seq = i + 1;
+		next_player = event.player;
+		deltas.push_back(msg);
+	}
+
+	for (auto it = deltas.rbegin(); it != deltas.rend(); it++) {
+		const std::span<const uint8_t> bytes = asBytes(*it);
+		data.insert(data.end(), bytes.begin(), bytes.end());
+	}
+}
+
+void Session::addSpectator(const std::shared_ptr<Connection> &connection, std::optional<uint64_t> resume) {
+	assert(mode & Mode::Host);
+
+	if (closing) {
+		connection->close();
+		return;
+	}
+
+	// a spectator that falls behind loses frames instead and gets a new snapshot once it caught up
+	OutboundLimits limits;
+	limits.high_water_bytes = MAX_SPECTATOR_BACKLOG;
+	limits.policy = OutboundLimits::DropFrames;
+	connection->setOutboundLimits(limits);
+
+	{
+		std::scoped_lock<std::mutex> queue_lock{queue_mutex};
+		spectator_queue.push_back({connection, resume});
+		last_activity_us = getMonotonicMicros();
+	}
+
+	logDebug("spectator added to queue", "session", LogHex{id}, "address", connection->getAddress());
+	wakeup();
+}
+
+void Session::acceptQueuedSpectators() {
+	assert(mode & Mode::Host);
+
+	std::vector<std::pair<std::shared_ptr<Connection>, std::optional<uint64_t>>> accepted;
+	{
+		std::scoped_lock<std::mutex> queue_lock{queue_mutex};
+		std::swap(accepted, spectator_queue);
+	}
+
+	// the snapshot is taken between two moves and goes through the same backlog as the moves,
+	// so a spectator sees exactly the moves made after it; fresh spectators share one snapshot
+	SharedBuffer snapshot;
+	for (const auto &[connection, resume] : accepted) {
+		if (resume) {
+			publishToSpectators(network->encode(encodeSync(~0u, resume)), connection);
+			continue;
+		}
+
+		if (!snapshot) {
+			snapshot = network->encode(encodeSync(~0u, {}));
+		}
+
+		publishToSpectators(snapshot, connection);
+	}
+}
+
+void Session::publishToSpectators(const SharedBuffer &buffer, const std::shared_ptr<Connection> &joining) {
+	{
+		std::scoped_lock<std::mutex> lock{spectator_mutex};
+		if (joining) {
+			num_spectators++;
+			status_changes++;
+		} else if (num_spectators == 0) {
+			return;
+		}
+
+		spectator_backlog.push_back({joining, buffer});
+	}
+
+	scheduleSpectatorFlush();
+}
+
+void Session::scheduleSpectatorFlush() {
+	if (!scheduler) {
+		flushSpectators();
+		return;
+	}
+
+	// a strand of its own, counted like wakeup() but with spectator_flush_scheduled: at most one flush task
+	// runs at a time so the backlog stays in order, and it runs concurrently with the session task, the
+	// spectators and their backlog are shared with it under spectator_mutex
+	if (spectator_flush_scheduled.fetch_add(1) == 0) {
+		Scheduler::Task task = [session = shared_from_this()]() {
+			uint32_t count = session->spectator_flush_scheduled.load();
+			while (true) {
+				session->flushSpectators();
+
+				const uint32_t remaining = session->spectator_flush_scheduled.fetch_sub(count) - count;
+				if (remaining == 0) {
+					break;
+				}
+
+				count = remaining;
+			}
+		};
+
+		// with a delay, frames published in the meantime go out together
+		const uint32_t delay = spectator_batch_ms;
+		if (timers && delay > 0) {
+			timers->schedule(delay, [scheduler = scheduler, task = std::move(task)]() {
+				scheduler->post(task);
+			});
+		} else {
+			scheduler->post(std::move(task));
+		}
+	}
+}
+
+void Session::flushSpectators() {
+	if (closing) {
+		for (const std::shared_ptr<Connection> &connection : resyncing) {
+			connection->close();
+		}
+		resyncing.clear();
+		return;
+	}
+
+	std::vector<std::pair<std::shared_ptr<Connection>, SharedBuffer>> backlog;
+	std::vector<std::shared_ptr<Connection>> targets;
+	{
+		std::scoped_lock<std::mutex> lock{spectator_mutex};
+		std::swap(backlog, spectator_backlog);
+		targets = spectators;
+	}
+
+	// consecutive frames are merged, so every spectator gets them with a single write
+	std::vector<SharedBuffer> frames;
+	const auto broadcastFrames = [&]() {
+		if (frames.size() == 1) {
+			network->broadcast(targets, frames[0]);
+		} else if (frames.size() > 1) {
+			std::vector<uint8_t> batch;
+			for (const SharedBuffer &frame : frames) {
+				batch.insert(batch.end(), frame.data(), frame.data() + frame.size());
+			}
+			network->broadcast(targets, network->encode(batch));
+		}
+		frames.clear();
+	};
+
+	for (const auto &[joining, buffer] : backlog) {
+		if (joining) {
+			broadcastFrames();
+			joining->send(buffer);
+			targets.push_back(joining);
+			logInfo("accepted spectator", "session", LogHex{id}, "address", joining->getAddress(), "spectators", targets.size());
+		} else {
+			frames.push_back(buffer);
+		}
+	}
+
+	broadcastFrames();
+
+	// far away spectators don't notice a few ms of delay, the batching window follows their round trip times
+	uint64_t total_rtt = 0;
+	size_t measured = 0;
+	for (const std::shared_ptr<Connection> &connection : targets) {
+		if (connection->rtt.samples > 0) {
+			total_rtt += connection->rtt.srtt;
+			measured++;
+		}
+	}
+	spectator_batch_ms = measured > 0 ? std::min<uint64_t>(total_rtt / measured / 4000, MAX_SPECTATOR_BATCH_MS) : 0;
+
+	// spectators that missed frames leave the broadcast until their queue drained,
+	// then they are queued for a fresh snapshot like a new spectator
+	const size_t count = targets.size();
+	std::erase_if(targets, [&](const std::shared_ptr<Connection> &connection) {
+		if (connection->isClosed()) {
+			return true;
+		} else if (connection->takeDroppedFrames()) {
+			logInfo("spectator is too slow, resyncing", "session", LogHex{id}, "address", connection->getAddress());
+			resyncing.push_back(connection);
+			return true;
+		}
+
+		return false;
+	});
+
+	std::vector<std::shared_ptr<Connection>> drained;
+	std::erase_if(resyncing, [&](const std::shared_ptr<Connection> &connection) {
+		if (connection->isClosed()) {
+			return true;
+		} else if (connection->getOutboundBytes() == 0) {
+			drained.push_back(connection);
+			return true;
+		}
+
+		return false;
+	});
+
+	{
+		std::scoped_lock<std::mutex> lock{spectator_mutex};
+		if (count != targets.size()) {
+			num_spectators -= count - targets.size();
+			status_changes++;
+		}
+		spectators = std::move(targets);
+	}
+
+	for (const std::shared_ptr<Connection> &connection : drained) {
+		addSpectator(connection);
+	}
+}
+
+// quality of the connection to the server as seen by the client
+Session::ConnectionQuality Session::getConnectionQuality() const {
+	if (server_rtt.samples == 0) {
+		return ConnectionQuality::Unknown;
+	} else if (getMonotonicMicros() - last_receive_us > 3 * PING_INTERVAL_US) {
+		return ConnectionQuality::NotResponding;
+	} else if (server_rtt.srtt < 80000 && server_rtt.jitter < 20000) {
+		return ConnectionQuality::Good;
+	} else if (server_rtt.srtt < 250000) {
+		return ConnectionQuality::Fair;
+	} else {
+		return ConnectionQuality::Poor;
+	}
 }
 
 void Session::connectToServer(const std::string &hostname, uint16_t port) {
 	assert(hostname.c_str()[hostname.size()] == '\0');
 	SDLNet_Address *addr = SDLNet_ResolveHostname(hostname.c_str());
 	if (!addr) {
-		eprintln("Couldn't resolve hostname ({}): {}\n", hostname, SDL_GetError());
+		logError("couldn't resolve hostname", "host", hostname, "error", SDL_GetError());
 		return;
 	}
 
 	if (SDLNet_WaitUntilResolved(addr, -1) != 1) {
-		eprintln("Couldn't resolve hostname ({}): {}\n", hostname, SDL_GetError());
+		logError("couldn't resolve hostname", "host", hostname, "error", SDL_GetError());
 		SDLNet_UnrefAddress(addr);
 		return;
 	}
 
+	server_rtt.reset();
+	last_ping_us = 0;
+	last_receive_us = getMonotonicMicros();
+
 	socket = SDLNet_CreateClient(addr, port);
 	if (SDLNet_WaitUntilConnected(socket, -1) != 1) {
-		eprintln("Couldn't connect to server ({}): {}\n", SDLNet_GetAddressString(addr), SDL_GetError());
+		logError("couldn't connect to server", "address", SDLNet_GetAddressString(addr), "error", SDL_GetError());
 		SDLNet_UnrefAddress(addr);
 		socket = nullptr;
 		return;
@@ -388,43 +1157,93 @@ void Session::receiveMessageFromServer() {
 	if (received == 0) {
 		return;
 	} else if (received != sizeof(Message)) {
-		println("received incomplete message from server");
+		logWarn("received incomplete message from server");
 		disconnectFromServer();
 		return;
 	}
 
+	last_receive_us = getMonotonicMicros();
+
 	switch (msg.type) {
 		case None: break;
 		case Message::Join: {
-			std::string tmp(sizeof(msg.join.name) + 1, '\0');
-			memcpy(tmp.data(), msg.join.name, sizeof(msg.join.name));
-			players[msg.player].name = tmp.c_str();
+			players[msg.player].name = msg.getJoinName();
+		} break;
+		case Message::Ping: {
+			sendMessageToServer(Message::makePong(msg.ping.timestamp_us));
+		} break;
+		case Message::Pong: {
+			if (msg.ping.timestamp_us <= last_receive_us) {
+				server_rtt.update(std::min<uint64_t>(last_receive_us - msg.ping.timestamp_us, UINT32_MAX));
+			}
 		} break;
 		case Message::Accept: {
 			initializeField(msg.accept.num_players);
-			field.player_pov = msg.player;
-
-			println("joined server as player {}, receiving field ...", msg.player);
+			field.current_player = msg.accept.current_player;
+			field.player_pov = spectating ? 0 : msg.player;
+			resume_player = msg.player;
+			last_seq = msg.seq;
+			log.clear();
+			clocks.clear();
+
+			if (spectating) {
+				logInfo("joined server as spectator, receiving field");
+			} else {
+				logInfo("joined server, receiving field", "player", msg.player);
+			}
 			if (receiveBlocking(socket, field.tiles, 32 * field.num_players) != 0) {
-				println("received incomplete field from server, disconnecting ...");
+				logWarn("received incomplete field from server, disconnecting");
 				disconnectFromServer();
 			} else {
-				println("received field from server, ready to play");
+				logInfo("received field from server, ready to play");
 			}
 		} break;
 		case Message::Reject: {
 			disconnectFromServer();
 		} break;
 		case Message::Move: {
+			last_seq = msg.seq;
+			clock_updated = std::chrono::steady_clock::now();
 			field.current_player = msg.move.next_player;
 			field.moveFigure(msg.move.from, msg.move.to, msg.move.type);
 			onFigureMoved(msg.player, msg.move.from, msg.move.to, msg.move.type);
 		} break;
 		case Message::Promotion: {
+			last_seq = msg.seq;
+			clock_updated = std::chrono::steady_clock::now();
 			field.current_player = msg.promotion.next_player;
 			field.tiles[msg.promotion.id].figure = msg.promotion.figure;
 			onFigurePromoted(msg.player, msg.promotion.id, msg.promotion.figure);
 		} break;
+		case Message::Resume: {
+			// the field is still the one from before the connection dropped, the missed moves follow
+			players.resize(field.num_players);
+			field.player_pov = spectating ? 0 : msg.player;
+			logInfo("resumed", "from", last_seq, "seq", msg.seq);
+		} break;
+		case Message::Clock: {
+			if (clocks.size() < field.num_players) {
+				clocks.resize(field.num_players);
+			}
+
+			last_seq = msg.seq;
+			clocks[msg.player] = msg.clock.remaining_ms;
+			clock_updated = std::chrono::steady_clock::now();
+			field.current_player = msg.clock.next_player;
+
+			if (msg.clock.remaining_ms == 0) {
+				field.players[msg.player].is_checkmate = true;
+				appendToLog(Event(msg.player, 0, 0, Figure::None, Event::Kind::Timeout));
+			}
+		} break;
+		case Message::Spectate: break;
+	}
+}
+
+void Session::appendToLog(const Event &event) {
+	log.push_back(event);
+	if (wal) {
+		wal->writeEvent(id, event);
 	}
 }
 
@@ -442,28 +1261,28 @@ void Session::onFigureMoved(uint32_t player, uint32_t from, uint32_t to, MoveTyp
 	switch (type) {
 		case MoveType::None: break;
 		case MoveType::Move: {
-			log.push_back(Event(player, from, to, Figure::None, Event::Kind::Move));
+			appendToLog(Event(player, from, to, Figure::None, Event::Kind::Move));
 		} break;
 		case MoveType::Capture: {
-			log.push_back(Event(player, from, to, Figure::None, Event::Kind::Capture));
+			appendToLog(Event(player, from, to, Figure::None, Event::Kind::Capture));
 		} break;
 		case MoveType::Castle: {
-			log.push_back(Event(player, from, to, Figure::None, Event::Kind::Castle));
+			appendToLog(Event(player, from, to, Figure::None, Event::Kind::Castle));
 		} break;
 		case MoveType::EnPassant: {
-			log.push_back(Event(player, from, to, Figure::None, Event::Kind::EnPassant));
+			appendToLog(Event(player, from, to, Figure::None, Event::Kind::EnPassant));
 		} break;
 	}
 }
 
 void Session::onFigurePromoted(uint32_t player, uint32_t id, Figure to) {
-	log.push_back(Event(player, id, 0, to, Event::Kind::Promote));
+	appendToLog(Event(player, id, 0, to, Event::Kind::Promote));
 }
 
 void Session::onCheck(uint32_t player) {
-	log.push_back(Event(player, 0, 0, Figure::None, Event::Kind::Check));
+	appendToLog(Event(player, 0, 0, Figure::None, Event::Kind::Check));
 }
 
 void Session::onCheckMate(uint32_t player) {
-	log.push_back(Event(player, 0, 0, Figure::None, Event::Kind::CheckMate));
+	appendToLog(Event(player, 0, 0, Figure::None, Event::Kind::CheckMate));
 }
@@ -0,0 +1,160 @@
+#include "sse.hpp"
+
+#include "chess.hpp"
+#include "json.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <string_view>
+
+static constexpr std::string_view RESPONSE_HEADER =
+	"HTTP/1.1 200 OK\r\n"
+	"Content-Type: text/event-stream\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Access-Control-Allow-Origin: *\r\n"
+	"Connection: keep-alive\r\n"
+	"\r\n";
+
+static constexpr std::string_view BAD_REQUEST =
+	"HTTP/1.1 404 Not Found\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n"
+	"\r\n";
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+		return std::tolower(uint8_t(x)) == std::tolower(uint8_t(y));
+	});
+}
+
+static std::optional<uint64_t> parseNumber(std::string_view text, int base = 10) {
+	uint64_t value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+	if (text.empty() || error != std::errc() || end != text.data() + text.size()) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+EventStreamCodec::State EventStreamCodec::receive(std::span<const uint8_t> data, std::optional<Message> &request, std::vector<uint8_t> &reply) {
+	if (state != Request) {
+		return state;
+	}
+
+	pending.insert(pending.end(), data.begin(), data.end());
+	if (!parseRequest(request, reply) && pending.size() > MAX_REQUEST_SIZE) {
+		reply.assign(BAD_REQUEST.begin(), BAD_REQUEST.end());
+		state = Failed;
+	}
+
+	return state;
+}
+
+// false while the request isn't complete yet
+bool EventStreamCodec::parseRequest(std::optional<Message> &request, std::vector<uint8_t> &reply) {
+	const std::string_view text(reinterpret_cast<const char*>(pending.data()), pending.size());
+	const size_t end = text.find("\r\n\r\n");
+	if (end == std::string_view::npos) {
+		return false;
+	}
+
+	std::optional<uint64_t> session;
+	std::optional<uint64_t> last_event_id;
+
+	size_t start = 0;
+	for (size_t line = 0; start < end; line++) {
+		const size_t next = std::min(text.find("\r\n", start), end);
+		const std::string_view current = text.substr(start, next - start);
+		start = next + 2;
+
+		if (line == 0) {
+			// GET /sessions/<id>/events[?...] HTTP/1.1
+			constexpr std::string_view PREFIX = "GET /sessions/";
+			constexpr std::string_view SUFFIX = "/events";
+			const size_t path_end = current.find(' ', PREFIX.size());
+			if (!current.starts_with(PREFIX) || path_end == std::string_view::npos) {
+				break;
+			}
+
+			std::string_view path = current.substr(PREFIX.size(), path_end - PREFIX.size());
+			path = path.substr(0, path.find('?'));
+			if (path.ends_with(SUFFIX)) {
+				session = parseNumber(path.substr(0, path.size() - SUFFIX.size()), 16);
+			}
+			continue;
+		}
+
+		const size_t colon = current.find(':');
+		if (colon != std::string_view::npos && equalsIgnoreCase(current.substr(0, colon), "Last-Event-ID")) {
+			std::string_view value = current.substr(colon + 1);
+			value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+			last_event_id = parseNumber(value);
+		}
+	}
+
+	if (!session) {
+		reply.assign(BAD_REQUEST.begin(), BAD_REQUEST.end());
+		state = Failed;
+		return true;
+	}
+
+	// a reconnecting watcher resumes like a spectator of the native client
+	request = last_event_id ? Message::makeResume(session.value(), ~0u, last_event_id.value()) : Message::makeSpectate(session.value());
+	reply.assign(RESPONSE_HEADER.begin(), RESPONSE_HEADER.end());
+	pending.clear();
+	pending.shrink_to_fit();
+	state = Open;
+	return true;
+}
+
+void EventStreamCodec::render(std::span<const uint8_t> data, std::string &events) {
+	while (data.size() >= sizeof(Message)) {
+		Message msg;
+		memcpy(&msg, data.data(), sizeof(Message));
+		data = data.subspan(sizeof(Message));
+
+		switch (msg.type) {
+			case Message::Accept: {
+				const size_t count = std::min<size_t>(32 * std::min<uint32_t>(msg.accept.num_players, MAX_PLAYERS), data.size() / sizeof(Tile));
+				std::string board;
+				for (size_t i = 0; i < count; i++) {
+					Tile tile;
+					memcpy(&tile, data.data() + i * sizeof(Tile), sizeof(Tile));
+					board += std::format("{}[{},{}]", i > 0 ? "," : "", uint32_t(tile.figure), tile.player);
+				}
+				data = data.subspan(count * sizeof(Tile));
+
+				events += std::format("id: {}\nevent: snapshot\ndata: {{\"players\":{},\"current_player\":{},\"tiles\":[{}]}}\n\n",
+					msg.seq, msg.accept.num_players, msg.accept.current_player, board);
+			} break;
+			case Message::Resume: {
+				events += std::format("id: {}\nevent: resume\ndata: {{\"seq\":{}}}\n\n", msg.seq, msg.seq);
+			} break;
+			case Message::Reject: {
+				events += "event: reject\ndata: {}\n\n";
+			} break;
+			case Message::Join: {
+				events += std::format("id: {}\nevent: join\ndata: {{\"player\":{},\"name\":\"{}\"}}\n\n", msg.seq, msg.player, escapeJson(msg.getJoinName()));
+			} break;
+			case Message::Move: {
+				events += std::format("id: {}\nevent: move\ndata: {{\"player\":{},\"from\":{},\"to\":{},\"type\":\"{}\",\"next_player\":{}}}\n\n",
+					msg.seq, msg.player, msg.move.from, msg.move.to, msg.move.type, msg.move.next_player);
+			} break;
+			case Message::Promotion: {
+				events += std::format("id: {}\nevent: promotion\ndata: {{\"player\":{},\"id\":{},\"figure\":\"{}\",\"next_player\":{}}}\n\n",
+					msg.seq, msg.player, msg.promotion.id, msg.promotion.figure, msg.promotion.next_player);
+			} break;
+			case Message::Clock: {
+				events += std::format("id: {}\nevent: clock\ndata: {{\"player\":{},\"remaining_ms\":{},\"next_player\":{}}}\n\n",
+					msg.seq, msg.player, msg.clock.remaining_ms, msg.clock.next_player);
+			} break;
+			case Message::Ping: {
+				events += ": ping\n\n";
+			} break;
+			default: break;
+		}
+	}
+}
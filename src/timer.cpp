@@ -0,0 +1,155 @@
+#include "timer.hpp"
+
+#include <algorithm>
+#include <thread>
+
+TimerWheel::TimerWheel(uint32_t tick_ms) : tick_ms(tick_ms), start(std::chrono::steady_clock::now()) {
+	std::fill(std::begin(slots), std::end(slots), NIL);
+}
+
+TimerHandle TimerWheel::schedule(uint64_t delay_ms, Callback callback) {
+	// rounded up, a timer never fires early; the wheel spans 2^32 ticks, longer delays are capped
+	const uint64_t ticks = std::clamp<uint64_t>((delay_ms + tick_ms - 1) / tick_ms, 1, (1ull << (SLOT_BITS * LEVELS)) - 1);
+
+	// relative to the actual time, the wheel may lag behind by a few ticks
+	const uint64_t base = now() / tick_ms;
+
+	std::scoped_lock<std::mutex> lock{mutex};
+
+	uint32_t index;
+	if (!free_nodes.empty()) {
+		index = free_nodes.back();
+		free_nodes.pop_back();
+	} else {
+		index = nodes.size();
+		nodes.emplace_back();
+	}
+
+	Node &node = nodes[index];
+	node.expires = std::max(current, base) + ticks;
+	node.callback = std::move(callback);
+	insert(index);
+
+	return TimerHandle(index, node.generation);
+}
+
+bool TimerWheel::cancel(TimerHandle &handle) {
+	const TimerHandle timer = handle;
+	handle = TimerHandle();
+
+	if (!timer) {
+		return false;
+	}
+
+	std::scoped_lock<std::mutex> lock{mutex};
+	if (timer.index >= nodes.size() || nodes[timer.index].generation != timer.generation || nodes[timer.index].slot == NIL) {
+		return false;
+	}
+
+	unlink(timer.index);
+	release(timer.index);
+	return true;
+}
+
+uint64_t TimerWheel::now() const {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TimerWheel::advance() {
+	const uint64_t target = now() / tick_ms;
+
+	std::vector<Callback> expired;
+	{
+		std::scoped_lock<std::mutex> lock{mutex};
+		while (current < target) {
+			current++;
+
+			// when a level wraps around, the next slot of the level above is due and gets spread out below
+			for (uint32_t level = 1; level < LEVELS; level++) {
+				if (((current >> (SLOT_BITS * (level - 1))) & (SLOTS - 1)) != 0) {
+					break;
+				}
+
+				cascade(level);
+			}
+
+			uint32_t &head = slots[current & (SLOTS - 1)];
+			while (head != NIL) {
+				const uint32_t index = head;
+				unlink(index);
+				expired.push_back(std::move(nodes[index].callback));
+				release(index);
+			}
+		}
+	}
+
+	for (Callback &callback : expired) {
+		callback();
+	}
+}
+
+void TimerWheel::run() {
+	while (!stopped) {
+		advance();
+		std::this_thread::sleep_for(std::chrono::milliseconds(tick_ms));
+	}
+}
+
+void TimerWheel::stop() {
+	stopped = true;
+}
+
+void TimerWheel::insert(uint32_t index) {
+	Node &node = nodes[index];
+	const uint64_t delta = node.expires > current ? node.expires - current : 0;
+
+	uint32_t level = 0;
+	while (level < LEVELS - 1 && delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+		level++;
+	}
+
+	node.slot = level * SLOTS + ((node.expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+	node.prev = NIL;
+	node.next = slots[node.slot];
+	if (node.next != NIL) {
+		nodes[node.next].prev = index;
+	}
+	slots[node.slot] = index;
+}
+
+void TimerWheel::unlink(uint32_t index) {
+	Node &node = nodes[index];
+	if (node.prev != NIL) {
+		nodes[node.prev].next = node.next;
+	} else {
+		slots[node.slot] = node.next;
+	}
+
+	if (node.next != NIL) {
+		nodes[node.next].prev = node.prev;
+	}
+
+	node.prev = NIL;
+	node.next = NIL;
+	node.slot = NIL;
+}
+
+void TimerWheel::release(uint32_t index) {
+	Node &node = nodes[index];
+	node.callback = nullptr;
+	node.generation++;
+	free_nodes.push_back(index);
+}
+
+void TimerWheel::cascade(uint32_t level) {
+	const uint32_t slot = level * SLOTS + ((current >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+	uint32_t index = slots[slot];
+	slots[slot] = NIL;
+
+	while (index != NIL) {
+		const uint32_t next = nodes[index].next;
+		insert(index);
+		index = next;
+	}
+}
@@ -0,0 +1,388 @@
+#include "tournament.hpp"
+
+#include "io.hpp"
+#include "record.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <random>
+
+static std::optional<uint64_t> parseArgument(const std::string &text) {
+	uint64_t value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+	if (error != std::errc() || end != text.data() + text.size()) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+static std::optional<double> parseNumber(const std::string &text) {
+	double value;
+	const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+	if (error != std::errc() || end != text.data() + text.size()) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+// name=<name>,depth=N,ms=N,book=<file>, every key is optional
+static bool parseEngine(const std::string &spec, TournamentEngine &engine) {
+	size_t start = 0;
+	while (start < spec.size()) {
+		const size_t end = std::min(spec.find(',', start), spec.size());
+		const std::string item = spec.substr(start, end - start);
+		start = end + 1;
+
+		const size_t equals = item.find('=');
+		if (equals == std::string::npos) {
+			return false;
+		}
+
+		const std::string key = item.substr(0, equals);
+		const std::string value = item.substr(equals + 1);
+		if (key == "name" && !value.empty()) {
+			engine.name = value;
+		} else if (key == "book") {
+			engine.book_path = value;
+		} else if (key == "depth" && parseArgument(value)) {
+			engine.options.max_depth = parseArgument(value).value();
+		} else if (key == "ms" && parseArgument(value)) {
+			engine.options.think_ms = parseArgument(value).value();
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+static inline double getExpectedScore(double elo) {
+	return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+double Sprt::getLlr() const {
+	if (games < 2) {
+		return 0.0;
+	}
+
+	// the variance is taken with a won and a lost game added, a run of equal results would make it zero otherwise
+	const double mean = sum / games;
+	const double prior_mean = (sum + 1.0) / (games + 2);
+	const double variance = (sum_squares + 1.0) / (games + 2) - prior_mean * prior_mean;
+
+	const double s0 = getExpectedScore(elo0);
+	const double s1 = getExpectedScore(elo1);
+	return games * (s1 - s0) * (2.0 * mean - s0 - s1) / (2.0 * variance);
+}
+
+double Sprt::getElo() const {
+	if (games == 0) {
+		return 0.0;
+	}
+
+	const double mean = std::clamp(sum / games, 1e-6, 1.0 - 1e-6);
+	return -400.0 * std::log10(1.0 / mean - 1.0);
+}
+
+Sprt::Result Sprt::getResult() const {
+	const double llr = getLlr();
+	if (llr >= getUpperBound()) {
+		return AcceptH1;
+	} else if (llr <= getLowerBound()) {
+		return AcceptH0;
+	}
+	return Continue;
+}
+
+// tournament [--engine <spec>] [--engine <spec>] [--players N] [--games N] [--plies N] [--tc <base ms>[+<increment ms>]]
+//     [--threads N] [--records <dir>] [--elo0 N] [--elo1 N] [--alpha N] [--beta N] [--seed N]
+Tournament::Tournament(const std::vector<std::string> &args) : seed(std::random_device()()) {
+	engines[0].name = "candidate";
+	engines[1].name = "baseline";
+	for (TournamentEngine &engine : engines) {
+		engine.options.think_ms = 50;
+	}
+
+	uint32_t num_engines = 0;
+	for (size_t i = 1; i < args.size(); i++) {
+		if (args[i] == "--engine" && i + 1 < args.size()) {
+			if (num_engines >= 2 || !parseEngine(args[++i], engines[num_engines++])) {
+				eprintln("invalid engine {}, it takes name=<name>,depth=N,ms=N,book=<file> and is given at most twice", args[i]);
+				valid = false;
+			}
+		} else if (args[i] == "--players" && i + 1 < args.size()) {
+			num_players = std::clamp<uint64_t>(parseArgument(args[++i]).value_or(2), 2, MAX_PLAYERS);
+		} else if (args[i] == "--games" && i + 1 < args.size()) {
+			max_games = parseArgument(args[++i]).value_or(max_games);
+		} else if (args[i] == "--plies" && i + 1 < args.size()) {
+			max_plies = parseArgument(args[++i]).value_or(max_plies);
+		} else if (args[i] == "--tc" && i + 1 < args.size()) {
+			const std::string &tc = args[++i];
+			const size_t plus = std::min(tc.find('+'), tc.size());
+			const std::optional<uint64_t> base = parseArgument(tc.substr(0, plus));
+			const std::optional<uint64_t> increment = plus < tc.size() ? parseArgument(tc.substr(plus + 1)) : 0;
+			if (!base || !increment) {
+				eprintln("invalid time control {}, it takes <base ms>[+<increment ms>]", tc);
+				valid = false;
+			}
+			base_ms = base.value_or(0);
+			increment_ms = increment.value_or(0);
+		} else if (args[i] == "--threads" && i + 1 < args.size()) {
+			num_threads = parseArgument(args[++i]).value_or(0);
+		} else if (args[i] == "--records" && i + 1 < args.size()) {
+			records_dir = args[++i];
+		} else if (args[i] == "--elo0" && i + 1 < args.size()) {
+			sprt.elo0 = parseNumber(args[++i]).value_or(sprt.elo0);
+		} else if (args[i] == "--elo1" && i + 1 < args.size()) {
+			sprt.elo1 = parseNumber(args[++i]).value_or(sprt.elo1);
+		} else if (args[i] == "--alpha" && i + 1 < args.size()) {
+			sprt.alpha = std::clamp(parseNumber(args[++i]).value_or(sprt.alpha), 1e-6, 0.5);
+		} else if (args[i] == "--beta" && i + 1 < args.size()) {
+			sprt.beta = std::clamp(parseNumber(args[++i]).value_or(sprt.beta), 1e-6, 0.5);
+		} else if (args[i] == "--seed" && i + 1 < args.size()) {
+			seed = parseArgument(args[++i]).value_or(seed);
+		} else {
+			eprintln("unknown argument {}", args[i]);
+		}
+	}
+
+	if (sprt.elo1 <= sprt.elo0) {
+		eprintln("elo1 has to be above elo0");
+		valid = false;
+	}
+}
+
+Tournament::~Tournament() {
+	stopped = true;
+	if (scheduler) {
+		scheduler->shutdown();
+	}
+}
+
+int Tournament::run() {
+	if (!valid) {
+		return 1;
+	}
+
+	for (TournamentEngine &engine : engines) {
+		if (engine.book_path.empty()) {
+			continue;
+		}
+
+		engine.book = std::make_unique<OpeningBook>();
+		if (!engine.book->open(engine.book_path)) {
+			eprintln("couldn't open book {}", engine.book_path);
+			return 1;
+		}
+		engine.options.book = engine.book.get();
+	}
+
+	if (!records_dir.empty()) {
+		std::error_code error;
+		std::filesystem::create_directories(records_dir, error);
+		if (error) {
+			eprintln("couldn't create {}: {}", records_dir, error.message());
+			return 1;
+		}
+	}
+
+	scheduler = std::make_unique<Scheduler>(num_threads);
+
+	const std::string clock = base_ms > 0 ? std::format("{} ms + {} ms per move", base_ms, increment_ms) : "no clock";
+	println("{} (depth {}, {} ms) against {} (depth {}, {} ms), {} players, {}, {} threads, elo {} to {}",
+		engines[0].name, engines[0].options.max_depth, engines[0].options.think_ms,
+		engines[1].name, engines[1].options.max_depth, engines[1].options.think_ms,
+		num_players, clock, scheduler->getWorkerCount(), sprt.elo0, sprt.elo1);
+
+	const auto start = std::chrono::steady_clock::now();
+
+	// a game per worker, each one queues the next when it is over
+	for (uint32_t i = 0; i < scheduler->getWorkerCount(); i++) {
+		scheduler->post([this]() { startGame(); });
+	}
+
+	{
+		std::unique_lock<std::mutex> lock{mutex};
+		finished.wait(lock, [this]() { return stopped || num_finished == max_games; });
+	}
+
+	// the games that are running stop at their next move
+	stopped = true;
+	scheduler->shutdown();
+
+	const uint64_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	std::scoped_lock<std::mutex> lock{mutex};
+	report(elapsed_ms);
+
+	switch (sprt.getResult()) {
+		case Sprt::AcceptH1: println("H1 accepted, {} is at least {} elo better than {}", engines[0].name, sprt.elo0, engines[1].name); break;
+		case Sprt::AcceptH0: println("H0 accepted, {} isn't {} elo better than {}", engines[0].name, sprt.elo1, engines[1].name); break;
+		case Sprt::Continue: println("no decision after {} games", num_finished); break;
+	}
+
+	if (failed_records > 0) {
+		eprintln("couldn't write {} records to {}", failed_records, records_dir);
+	}
+	return 0;
+}
+
+void Tournament::startGame() {
+	const uint64_t index = next_game.fetch_add(1, std::memory_order_relaxed);
+	if (stopped || index >= max_games) {
+		return;
+	}
+
+	playGame(index);
+	if (!stopped) {
+		scheduler->post([this]() { startGame(); });
+	}
+}
+
+void Tournament::playGame(uint64_t index) {
+	GameResult result = {};
+	result.index = index;
+	result.candidate = index % num_players;
+
+	// every seat has its own engine, so the baseline seats don't share a random sequence
+	std::vector<Engine> seats;
+	std::vector<std::string> names;
+	for (uint32_t i = 0; i < num_players; i++) {
+		const TournamentEngine &engine = engines[i == result.candidate ? 0 : 1];
+		seats.emplace_back(engine.options, seed + index * MAX_PLAYERS + i);
+		names.push_back(engine.name);
+	}
+
+	uint64_t clocks[MAX_PLAYERS];
+	std::fill(std::begin(clocks), std::end(clocks), base_ms);
+
+	Field field;
+	field.init(num_players);
+	EventLog log;
+
+	std::fill(std::begin(result.out_order), std::end(result.out_order), UINT32_MAX);
+	uint32_t remaining = num_players;
+	uint32_t eliminated = 0;
+	bool timeout = false;
+
+	std::vector<GameEvent> events;
+	while (remaining > 1 && result.plies < max_plies) {
+		if (stopped) {
+			return;
+		}
+
+		const uint32_t player = field.current_player;
+		events.clear();
+
+		// a seat that lost its king or can't move surrenders when it is its turn
+		if (Engine::isOut(field, player)) {
+			events.push_back(GameEvent(player, 0, 0, Figure::None, GameEvent::Surrender));
+		} else {
+			Engine &engine = seats[player];
+			if (base_ms > 0) {
+				// a twentieth of what's left and the increment, but never so much of the clock that an overshoot loses on time
+				engine.setThinkTime(std::clamp<uint64_t>(clocks[player] / 20 + increment_ms, 1, std::max<uint64_t>(clocks[player] / 2, 1)));
+			}
+
+			const auto begin = std::chrono::steady_clock::now();
+			const std::optional<EngineMove> move = engine.think(field);
+			const uint64_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+			if (base_ms > 0 && elapsed_ms > clocks[player]) {
+				events.push_back(GameEvent(player, 0, 0, Figure::None, GameEvent::Timeout));
+				timeout = true;
+			} else if (!move) {
+				events.push_back(GameEvent(player, 0, 0, Figure::None, GameEvent::Surrender));
+			} else {
+				clocks[player] = clocks[player] - elapsed_ms + increment_ms;
+				Engine::appendEvents(field, move.value(), events);
+				result.plies++;
+			}
+		}
+
+		for (const GameEvent &event : events) {
+			applyEvent(field, event);
+			log.push_back(event);
+		}
+
+		// players that went out with the same move share their place
+		bool out = false;
+		for (uint32_t i = 0; i < num_players; i++) {
+			if (result.out_order[i] == UINT32_MAX && Engine::isOut(field, i)) {
+				result.out_order[i] = eliminated;
+				remaining--;
+				out = true;
+			}
+		}
+		eliminated += out;
+	}
+
+	// seats that lost their king since their last turn surrender too, so the record ends with the winner
+	for (uint32_t i = 0; i < num_players; i++) {
+		if (!field.players[i].is_checkmate && Engine::isOut(field, i)) {
+			const GameEvent event(i, 0, 0, Figure::None, GameEvent::Surrender);
+			applyEvent(field, event);
+			log.push_back(event);
+		}
+	}
+
+	// a half point for every seat that went out with the candidate or is still playing with it
+	double score = 0.0;
+	for (uint32_t i = 0; i < num_players; i++) {
+		if (i != result.candidate) {
+			const uint32_t candidate = result.out_order[result.candidate];
+			score += candidate > result.out_order[i] ? 1.0 : candidate == result.out_order[i] ? 0.5 : 0.0;
+		}
+	}
+	result.score = score / (num_players - 1);
+
+	bool recorded = true;
+	if (!records_dir.empty()) {
+		GameRecord record;
+		record.create(num_players, names, log);
+		recorded = record.save(std::format("{}/{:06}.rec", records_dir, index));
+	}
+
+	std::scoped_lock<std::mutex> lock{mutex};
+	timeouts += timeout;
+	failed_records += !recorded;
+	finishGame(result);
+}
+
+void Tournament::finishGame(const GameResult &result) {
+	num_finished++;
+	total_plies += result.plies;
+	sprt.add(result.score);
+	if (result.score > 0.5) {
+		wins++;
+	} else if (result.score < 0.5) {
+		losses++;
+	} else {
+		draws++;
+	}
+
+	if (num_finished % 100 == 0) {
+		report(0);
+	}
+
+	if (sprt.getResult() != Sprt::Continue) {
+		stopped = true;
+	}
+
+	if (stopped || num_finished == max_games) {
+		finished.notify_all();
+	}
+}
+
+void Tournament::report(uint64_t elapsed_ms) {
+	const std::string speed = elapsed_ms > 0 ? std::format(", {:.0f} plies/s", total_plies * 1000.0 / elapsed_ms) : "";
+	println("{} games: +{} ={} -{}, score {:.3f}, elo {:+.1f}, llr {:.2f} ({:.2f}, {:.2f}), {} timeouts{}",
+		num_finished, wins, draws, losses, sprt.games > 0 ? sprt.sum / sprt.games : 0.5, sprt.getElo(),
+		sprt.getLlr(), sprt.getLowerBound(), sprt.getUpperBound(), timeouts, speed);
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<std::string> args(argv, argv + argc);
+	return Tournament(args).run();
+}
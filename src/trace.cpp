@@ -0,0 +1,111 @@
+#include "trace.hpp"
+
+#include "json.hpp"
+
+#include <cstdio>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <csignal>
+#endif
+
+static std::mutex buffers_mutex;
+static std::vector<std::shared_ptr<TraceBuffer>> buffers;
+// buffers of exited threads, the next new thread takes one over instead of allocating
+static std::vector<std::shared_ptr<TraceBuffer>> free_buffers;
+static std::atomic<uint32_t> next_thread = 1;
+static std::atomic<bool> dump_requested = false;
+
+// buffers stay registered after their thread exited, so its last spans still show up in a dump,
+// a thread taking one over keeps its thread id and overwrites the oldest spans
+struct LocalBuffer {
+	std::shared_ptr<TraceBuffer> buffer;
+
+	~LocalBuffer() {
+		if (buffer) {
+			std::scoped_lock<std::mutex> lock{buffers_mutex};
+			free_buffers.push_back(std::move(buffer));
+		}
+	}
+};
+
+static thread_local LocalBuffer local_buffer;
+
+void Tracer::record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+	if (!local_buffer.buffer) {
+		std::scoped_lock<std::mutex> lock{buffers_mutex};
+		if (!free_buffers.empty()) {
+			local_buffer.buffer = std::move(free_buffers.back());
+			free_buffers.pop_back();
+		} else {
+			local_buffer.buffer = std::make_shared<TraceBuffer>();
+			local_buffer.buffer->thread = next_thread++;
+			buffers.push_back(local_buffer.buffer);
+		}
+	}
+
+	TraceBuffer &buffer = *local_buffer.buffer;
+	const uint64_t count = buffer.count.load(std::memory_order_relaxed);
+	TraceEvent &event = buffer.events[count % TraceBuffer::CAPACITY];
+	event.name.store(name, std::memory_order_relaxed);
+	event.start_ns.store(start_ns, std::memory_order_relaxed);
+	event.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+	buffer.count.store(count + 1, std::memory_order_release);
+}
+
+std::string Tracer::dump() {
+	std::vector<std::shared_ptr<TraceBuffer>> current;
+	{
+		std::scoped_lock<std::mutex> lock{buffers_mutex};
+		current = buffers;
+	}
+
+	std::string json = R"({"displayTimeUnit":"ns","traceEvents":[)";
+	bool first = true;
+	for (const std::shared_ptr<TraceBuffer> &buffer : current) {
+		const uint64_t count = buffer->count.load(std::memory_order_acquire);
+		const uint64_t start = count > TraceBuffer::CAPACITY ? count - TraceBuffer::CAPACITY : 0;
+
+		for (uint64_t i = start; i < count; i++) {
+			const TraceEvent &event = buffer->events[i % TraceBuffer::CAPACITY];
+			const char *name = event.name.load(std::memory_order_relaxed);
+			if (!name) {
+				continue;
+			}
+
+			// timestamps are in microseconds, fractions keep the nanoseconds
+			std::format_to(std::back_inserter(json), R"({}{{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}})",
+				first ? "" : ",", escapeJson(name), buffer->thread, event.start_ns.load(std::memory_order_relaxed) / 1000.0, event.duration_ns.load(std::memory_order_relaxed) / 1000.0);
+			first = false;
+		}
+	}
+
+	json += "]}";
+	return json;
+}
+
+bool Tracer::dumpToFile(const std::string &path) {
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+
+	const std::string json = dump();
+	const bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+	return fclose(file) == 0 && written;
+}
+
+void Tracer::installSignalHandler() {
+#if !defined(_WIN32)
+	signal(SIGUSR1, [](int) {
+		dump_requested.store(true, std::memory_order_relaxed);
+	});
+#endif
+}
+
+bool Tracer::takeDumpRequest() {
+	return dump_requested.load(std::memory_order_relaxed) && dump_requested.exchange(false);
+}
@@ -0,0 +1,398 @@
+#include "wal.hpp"
+
+#include "log.hpp"
+#include "metrics.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static constexpr size_t WAL_ALIGNMENT = 8;
+
+static inline size_t alignRecord(size_t size) {
+	return (size + WAL_ALIGNMENT - 1) & ~(WAL_ALIGNMENT - 1);
+}
+
+static uint32_t getChecksum(const WalRecord &record, std::span<const uint8_t> payload) {
+	WalRecord copy = record;
+	copy.checksum = 0;
+
+	uint32_t hash = 2166136261u;
+	const auto mix = [&](std::span<const uint8_t> bytes) {
+		for (uint8_t byte : bytes) {
+			hash = (hash ^ byte) * 16777619u;
+		}
+	};
+
+	mix(asBytes(copy));
+	mix(payload);
+	return hash;
+}
+
+static WalJoin makeJoin(const std::string &name) {
+	WalJoin join = {};
+	memcpy(join.name, name.data(), std::min(name.size(), sizeof(join.name)));
+	return join;
+}
+
+static WalEvent makeEvent(const Session::Event &event) {
+	WalEvent record = {};
+	record.from = event.from;
+	record.to = event.to;
+	record.kind = event.kind;
+	record.promotion = event.promotion;
+	return record;
+}
+
+static WalCreate makeCreate(uint32_t num_players, uint64_t clock_base_ms, uint64_t clock_increment_ms) {
+	WalCreate create = {};
+	create.num_players = num_players;
+	create.clock_base_ms = clock_base_ms;
+	create.clock_increment_ms = clock_increment_ms;
+	return create;
+}
+
+static bool syncFile(FILE *file) {
+	if (fflush(file) != 0) {
+		return false;
+	}
+
+#if defined(_WIN32)
+	return _commit(_fileno(file)) == 0;
+#else
+	return fdatasync(fileno(file)) == 0;
+#endif
+}
+
+WriteAheadLog::~WriteAheadLog() {
+	{
+		std::scoped_lock<std::mutex> lock{mutex};
+		stopping = true;
+	}
+	wakeup.notify_one();
+
+	// the writer commits what is still pending before it exits
+	if (writer.joinable()) {
+		writer.join();
+	}
+
+	if (file) {
+		fclose(file);
+	}
+}
+
+bool RecoveredSession::isFinished() const {
+	if (num_players < 2 || num_players > MAX_PLAYERS) {
+		return true;
+	}
+
+	// the same steps as Session::recover, switching to the next player marks the ones that are checkmate
+	Field field;
+	field.init(num_players);
+	for (const Session::Event &event : events) {
+		applyEvent(field, event);
+	}
+
+	uint32_t remaining = 0;
+	for (uint32_t i = 0; i < num_players; i++) {
+		remaining += !field.players[i].is_checkmate;
+	}
+	return remaining <= 1;
+}
+
+bool WriteAheadLog::read(const std::string &path, std::vector<RecoveredSession> &sessions, WalRecoveryStats &stats) {
+	FILE *in = fopen(path.c_str(), "rb");
+	if (!in) {
+		return true;
+	}
+
+	std::vector<uint8_t> data;
+	uint8_t buffer[64 * 1024];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+		data.insert(data.end(), buffer, buffer + count);
+	}
+	fclose(in);
+
+	stats.bytes = data.size();
+	if (data.empty()) {
+		return true;
+	}
+
+	WalHeader header;
+	if (data.size() < sizeof(header)) {
+		logError("not a write-ahead log", "path", path);
+		return false;
+	}
+
+	memcpy(&header, data.data(), sizeof(header));
+	if (memcmp(header.magic, WalHeader::MAGIC, sizeof(header.magic)) != 0 || header.version == 0 || header.version > WalHeader::VERSION) {
+		logError("not a write-ahead log", "path", path);
+		return false;
+	}
+
+	std::vector<RecoveredSession> all;
+	std::unordered_map<uint64_t, size_t> indices;
+
+	size_t offset = sizeof(header);
+	while (offset < data.size()) {
+		WalRecord record;
+		if (data.size() - offset < sizeof(record)) {
+			stats.torn = true;
+			break;
+		}
+
+		memcpy(&record, data.data() + offset, sizeof(record));
+		if (data.size() - offset - sizeof(record) < record.size) {
+			stats.torn = true;
+			break;
+		}
+
+		const std::span<const uint8_t> payload(data.data() + offset + sizeof(record), record.size);
+		if (getChecksum(record, payload) != record.checksum) {
+			stats.torn = true;
+			break;
+		}
+
+		offset += sizeof(record) + alignRecord(record.size);
+		stats.records++;
+
+		if (record.kind == WalRecord::Create) {
+			WalCreate create;
+			if (payload.size() != sizeof(create)) {
+				continue;
+			}
+
+			memcpy(&create, payload.data(), sizeof(create));
+			if (create.num_players < 2 || create.num_players > MAX_PLAYERS) {
+				continue;
+			}
+
+			RecoveredSession session;
+			session.id = record.session;
+			session.num_players = create.num_players;
+			session.clock_base_ms = create.clock_base_ms;
+			session.clock_increment_ms = create.clock_increment_ms;
+			session.names.resize(create.num_players);
+			session.clocks.assign(create.num_players, create.clock_base_ms);
+
+			indices[record.session] = all.size();
+			all.push_back(std::move(session));
+			continue;
+		}
+
+		const auto it = indices.find(record.session);
+		if (it == indices.end()) {
+			continue;
+		}
+
+		RecoveredSession &session = all[it->second];
+		if (record.kind != WalRecord::Destroy && record.player >= session.num_players) {
+			continue;
+		}
+
+		switch (record.kind) {
+			case WalRecord::Create: break;
+			case WalRecord::Join: {
+				WalJoin join;
+				if (payload.size() == sizeof(join)) {
+					memcpy(&join, payload.data(), sizeof(join));
+					session.names[record.player] = std::string(join.name, strnlen(join.name, sizeof(join.name)));
+				}
+			} break;
+			case WalRecord::Event: {
+				WalEvent event;
+				if (payload.size() == sizeof(event)) {
+					memcpy(&event, payload.data(), sizeof(event));
+					session.events.push_back(Session::Event(record.player, event.from, event.to, event.promotion, event.kind));
+				}
+			} break;
+			case WalRecord::Events: {
+				if (payload.size() % sizeof(Session::Event) != 0) {
+					break;
+				}
+
+				// a run is dropped as a whole if any of its events has a player the session doesn't have
+				std::vector<Session::Event> events(payload.size() / sizeof(Session::Event));
+				memcpy(events.data(), payload.data(), payload.size());
+				if (std::all_of(events.begin(), events.end(), [&](const Session::Event &event) { return event.player < session.num_players; })) {
+					session.events.append(events);
+				}
+			} break;
+			case WalRecord::Clock: {
+				uint64_t remaining_ms;
+				if (payload.size() == sizeof(remaining_ms)) {
+					memcpy(&remaining_ms, payload.data(), sizeof(remaining_ms));
+					session.clocks[record.player] = remaining_ms;
+				}
+			} break;
+			case WalRecord::Destroy: {
+				session.destroyed = true;
+			} break;
+		}
+	}
+
+	for (RecoveredSession &session : all) {
+		if (!session.destroyed) {
+			sessions.push_back(std::move(session));
+		}
+	}
+
+	return true;
+}
+
+bool WriteAheadLog::write(const std::string &path, std::span<const RecoveredSession> sessions) {
+	std::vector<uint8_t> data;
+
+	WalHeader header = {};
+	memcpy(header.magic, WalHeader::MAGIC, sizeof(header.magic));
+	header.version = WalHeader::VERSION;
+	const std::span<const uint8_t> bytes = asBytes(header);
+	data.insert(data.end(), bytes.begin(), bytes.end());
+
+	for (const RecoveredSession &session : sessions) {
+		appendSession(data, session);
+	}
+
+	// the old file stays in place until the new one is complete, a crash in between leaves the old one
+	const std::string temporary = path + ".tmp";
+	FILE *out = fopen(temporary.c_str(), "wb");
+	if (!out) {
+		logError("couldn't create file", "path", temporary);
+		return false;
+	}
+
+	const bool written = fwrite(data.data(), 1, data.size(), out) == data.size() && syncFile(out);
+	fclose(out);
+
+#if defined(_WIN32)
+	// rename doesn't replace an existing file on windows
+	remove(path.c_str());
+#endif
+
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		logError("couldn't write file", "path", path);
+		remove(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool WriteAheadLog::open(const std::string &path, std::span<const RecoveredSession> sessions) {
+	if (!write(path, sessions)) {
+		return false;
+	}
+
+	file = fopen(path.c_str(), "ab");
+	if (!file) {
+		logError("couldn't open write-ahead log", "path", path);
+		return false;
+	}
+
+	writer = std::thread([this]() { run(); });
+	return true;
+}
+
+void WriteAheadLog::writeCreate(uint64_t session, uint32_t num_players, uint64_t clock_base_ms, uint64_t clock_increment_ms) {
+	append(session, WalRecord::Create, 0, asBytes(makeCreate(num_players, clock_base_ms, clock_increment_ms)));
+}
+
+void WriteAheadLog::writeJoin(uint64_t session, uint32_t player, const std::string &name) {
+	append(session, WalRecord::Join, player, asBytes(makeJoin(name)));
+}
+
+void WriteAheadLog::writeEvent(uint64_t session, const Session::Event &event) {
+	append(session, WalRecord::Event, event.player, asBytes(makeEvent(event)));
+}
+
+void WriteAheadLog::writeClock(uint64_t session, uint32_t player, uint64_t remaining_ms) {
+	append(session, WalRecord::Clock, player, asBytes(remaining_ms));
+}
+
+void WriteAheadLog::writeDestroy(uint64_t session) {
+	append(session, WalRecord::Destroy, 0);
+}
+
+void WriteAheadLog::appendRecord(std::vector<uint8_t> &out, uint64_t session, WalRecord::Kind kind, uint32_t player, std::span<const uint8_t> payload) {
+	WalRecord record;
+	record.session = session;
+	record.kind = kind;
+	record.player = player;
+	record.size = payload.size();
+	record.checksum = getChecksum(record, payload);
+
+	const std::span<const uint8_t> bytes = asBytes(record);
+	out.insert(out.end(), bytes.begin(), bytes.end());
+	out.insert(out.end(), payload.begin(), payload.end());
+	out.resize(out.size() + alignRecord(payload.size()) - payload.size(), 0);
+}
+
+void WriteAheadLog::appendSession(std::vector<uint8_t> &out, const RecoveredSession &session) {
+	appendRecord(out, session.id, WalRecord::Create, 0, asBytes(makeCreate(session.num_players, session.clock_base_ms, session.clock_increment_ms)));
+
+	for (uint32_t i = 0; i < session.names.size(); i++) {
+		if (!session.names[i].empty()) {
+			appendRecord(out, session.id, WalRecord::Join, i, asBytes(makeJoin(session.names[i])));
+		}
+	}
+
+	// the log is written straight from its chunks, split where a chunk is larger than a record can be
+	static constexpr size_t MAX_RUN = UINT16_MAX / sizeof(Session::Event);
+	session.events.forEachSpan(0, session.events.size(), [&](std::span<const Session::Event> events) {
+		for (size_t i = 0; i < events.size(); i += MAX_RUN) {
+			const std::span<const Session::Event> run = events.subspan(i, std::min(events.size() - i, MAX_RUN));
+			appendRecord(out, session.id, WalRecord::Events, 0, std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(run.data()), run.size_bytes()));
+		}
+	});
+
+	for (uint32_t i = 0; i < session.clocks.size(); i++) {
+		if (session.clocks[i] != session.clock_base_ms) {
+			appendRecord(out, session.id, WalRecord::Clock, i, asBytes(session.clocks[i]));
+		}
+	}
+}
+
+void WriteAheadLog::append(uint64_t session, WalRecord::Kind kind, uint32_t player, std::span<const uint8_t> payload) {
+	bool idle;
+	{
+		std::scoped_lock<std::mutex> lock{mutex};
+		idle = pending.empty();
+		appendRecord(pending, session, kind, player, payload);
+	}
+
+	// a busy writer picks the record up after its current sync
+	if (idle) {
+		wakeup.notify_one();
+	}
+}
+
+void WriteAheadLog::run() {
+	std::vector<uint8_t> batch;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock{mutex};
+			wakeup.wait(lock, [this]() { return stopping || !pending.empty(); });
+
+			if (pending.empty()) {
+				return;
+			}
+
+			std::swap(batch, pending);
+		}
+
+		HistogramTimer timer{Metrics::wal_commit};
+		if (fwrite(batch.data(), 1, batch.size(), file) != batch.size() || !syncFile(file)) {
+			logError("couldn't write to the write-ahead log", "bytes", batch.size());
+		}
+
+		Metrics::wal_commits.add();
+		Metrics::wal_bytes.add(batch.size());
+		batch.clear();
+	}
+}
@@ -0,0 +1,328 @@
+#include "websocket.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <random>
+#include <string_view>
+
+static constexpr std::string_view WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static inline uint32_t rotateLeft(uint32_t value, uint32_t bits) {
+	return (value << bits) | (value >> (32 - bits));
+}
+
+// only used for the handshake, a few bytes per connection
+static std::array<uint8_t, 20> sha1(std::string_view data) {
+	uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+	std::vector<uint8_t> message(data.begin(), data.end());
+	const uint64_t bits = uint64_t(data.size()) * 8;
+	message.push_back(0x80);
+	while (message.size() % 64 != 56) {
+		message.push_back(0);
+	}
+	for (int i = 7; i >= 0; i--) {
+		message.push_back(bits >> (i * 8));
+	}
+
+	for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+		uint32_t w[80];
+		for (uint32_t i = 0; i < 16; i++) {
+			const uint8_t *p = &message[chunk + i * 4];
+			w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+		}
+		for (uint32_t i = 16; i < 80; i++) {
+			w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (uint32_t i = 0; i < 80; i++) {
+			uint32_t f, k;
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			const uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rotateLeft(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	std::array<uint8_t, 20> digest;
+	for (uint32_t i = 0; i < 20; i++) {
+		digest[i] = h[i / 4] >> (24 - (i % 4) * 8);
+	}
+	return digest;
+}
+
+static std::string encodeBase64(std::span<const uint8_t> data) {
+	static constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string result;
+	for (size_t i = 0; i < data.size(); i += 3) {
+		const uint32_t n = (uint32_t(data[i]) << 16) | (i + 1 < data.size() ? uint32_t(data[i + 1]) << 8 : 0) | (i + 2 < data.size() ? data[i + 2] : 0);
+		result += ALPHABET[(n >> 18) & 63];
+		result += ALPHABET[(n >> 12) & 63];
+		result += i + 1 < data.size() ? ALPHABET[(n >> 6) & 63] : '=';
+		result += i + 2 < data.size() ? ALPHABET[n & 63] : '=';
+	}
+	return result;
+}
+
+static uint32_t makeMask() {
+	thread_local std::mt19937 random{std::random_device()()};
+	return random();
+}
+
+// value of a header in an http request or response, names are case insensitive
+static std::string_view findHeader(std::string_view head, std::string_view name) {
+	size_t line = head.find("\r\n");
+	while (line != std::string_view::npos && line + 2 < head.size()) {
+		const size_t start = line + 2;
+		const size_t end = head.find("\r\n", start);
+		const std::string_view field = head.substr(start, end - start);
+
+		const size_t colon = field.find(':');
+		if (colon == name.size() && std::equal(name.begin(), name.end(), field.begin(), [](char a, char b) { return std::tolower(a) == std::tolower(b); })) {
+			std::string_view value = field.substr(colon + 1);
+			while (!value.empty() && value.front() == ' ') {
+				value.remove_prefix(1);
+			}
+			while (!value.empty() && value.back() == ' ') {
+				value.remove_suffix(1);
+			}
+			return value;
+		}
+
+		line = end;
+	}
+
+	return {};
+}
+
+WebSocketCodec::WebSocketCodec(Role role) : role(role) {}
+
+WebSocketCodec::State WebSocketCodec::receive(std::span<const uint8_t> data, std::vector<uint8_t> &payload, std::vector<uint8_t> &reply) {
+	if (state == Closing || state == Failed) {
+		return state;
+	}
+
+	pending.insert(pending.end(), data.begin(), data.end());
+
+	if (state == Handshake && !receiveHandshake(reply)) {
+		state = Failed;
+	}
+
+	if (state == Open && !receiveFrames(payload, reply)) {
+		state = Failed;
+	}
+
+	return state;
+}
+
+size_t WebSocketCodec::encodeHeader(uint8_t *header, uint64_t length) {
+	header[0] = 0x80 | Binary;
+	if (length < 126) {
+		header[1] = length;
+		return 2;
+	} else if (length <= UINT16_MAX) {
+		header[1] = 126;
+		header[2] = length >> 8;
+		header[3] = length;
+		return 4;
+	}
+
+	header[1] = 127;
+	for (uint32_t i = 0; i < 8; i++) {
+		header[2 + i] = length >> ((7 - i) * 8);
+	}
+	return 10;
+}
+
+std::vector<uint8_t> WebSocketCodec::encodeClientFrame(std::span<const uint8_t> payload) {
+	std::vector<uint8_t> frame(MAX_HEADER_SIZE + payload.size());
+	size_t size = encodeHeader(frame.data(), payload.size());
+	frame[1] |= 0x80;
+
+	const uint32_t mask = makeMask();
+	memcpy(&frame[size], &mask, 4);
+	const uint8_t *mask_bytes = &frame[size];
+	size += 4;
+
+	for (size_t i = 0; i < payload.size(); i++) {
+		frame[size + i] = payload[i] ^ mask_bytes[i % 4];
+	}
+
+	frame.resize(size + payload.size());
+	return frame;
+}
+
+std::string WebSocketCodec::makeHandshake(const std::string &host) {
+	uint8_t nonce[16];
+	for (uint32_t i = 0; i < sizeof(nonce); i += 4) {
+		const uint32_t random = makeMask();
+		memcpy(&nonce[i], &random, 4);
+	}
+	key = encodeBase64(nonce);
+
+	return "GET / HTTP/1.1\r\nHost: " + host + "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: " + key + "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+}
+
+std::string WebSocketCodec::computeAccept(const std::string &key) {
+	return encodeBase64(sha1(key + std::string(WEBSOCKET_GUID)));
+}
+
+bool WebSocketCodec::receiveHandshake(std::vector<uint8_t> &reply) {
+	const std::string_view received(reinterpret_cast<const char*>(pending.data()), pending.size());
+	const size_t end = received.find("\r\n\r\n");
+	if (end == std::string_view::npos) {
+		return pending.size() <= MAX_HANDSHAKE_SIZE;
+	}
+
+	const std::string_view head = received.substr(0, end + 2);
+
+	if (role == Server) {
+		const std::string_view client_key = findHeader(head, "Sec-WebSocket-Key");
+		if (!head.starts_with("GET ") || client_key.empty()) {
+			return false;
+		}
+
+		const std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + computeAccept(std::string(client_key)) + "\r\n\r\n";
+		reply.insert(reply.end(), response.begin(), response.end());
+	} else {
+		if (!head.starts_with("HTTP/1.1 101") || findHeader(head, "Sec-WebSocket-Accept") != computeAccept(key)) {
+			return false;
+		}
+	}
+
+	// frames may follow the handshake in the same read
+	pending.erase(pending.begin(), pending.begin() + end + 4);
+	state = Open;
+	return true;
+}
+
+bool WebSocketCodec::receiveFrames(std::vector<uint8_t> &payload, std::vector<uint8_t> &reply) {
+	size_t offset = 0;
+	while (state == Open && pending.size() - offset >= 2) {
+		const uint8_t *frame = pending.data() + offset;
+		const size_t available = pending.size() - offset;
+
+		const bool fin = frame[0] & 0x80;
+		const Opcode opcode = Opcode(frame[0] & 0x0f);
+		const bool masked = frame[1] & 0x80;
+		uint64_t length = frame[1] & 0x7f;
+
+		// clients mask everything they send, servers nothing
+		if (masked != (role == Server)) {
+			return false;
+		}
+
+		size_t header = 2;
+		if (length == 126) {
+			if (available < 4) {
+				break;
+			}
+			length = (uint64_t(frame[2]) << 8) | frame[3];
+			header = 4;
+		} else if (length == 127) {
+			if (available < 10) {
+				break;
+			}
+			length = 0;
+			for (uint32_t i = 0; i < 8; i++) {
+				length = (length << 8) | frame[2 + i];
+			}
+			header = 10;
+		}
+
+		if (length > MAX_PAYLOAD_SIZE) {
+			return false;
+		}
+
+		const uint8_t *mask = frame + header;
+		if (masked) {
+			header += 4;
+		}
+
+		if (available < header + length) {
+			break;
+		}
+
+		const auto unmask = [&](std::vector<uint8_t> &out) {
+			const size_t start = out.size();
+			out.insert(out.end(), frame + header, frame + header + length);
+			if (masked) {
+				for (size_t i = 0; i < length; i++) {
+					out[start + i] ^= mask[i % 4];
+				}
+			}
+		};
+
+		switch (opcode) {
+			case Continuation:
+			case Binary: {
+				unmask(payload);
+			} break;
+			case Close:
+			case Ping: {
+				if (!fin || length > 125) {
+					return false;
+				}
+
+				std::vector<uint8_t> body;
+				unmask(body);
+
+				// a close is answered with the status code it carried
+				if (opcode == Close) {
+					body.resize(std::min<size_t>(body.size(), 2));
+					encodeControl(Close, body, reply);
+					state = Closing;
+				} else {
+					encodeControl(Pong, body, reply);
+				}
+			} break;
+			case Pong: break;
+			case Text:
+			default: return false;
+		}
+
+		offset += header + length;
+	}
+
+	pending.erase(pending.begin(), pending.begin() + offset);
+	return true;
+}
+
+void WebSocketCodec::encodeControl(Opcode opcode, std::span<const uint8_t> payload, std::vector<uint8_t> &reply) {
+	if (role == Client) {
+		std::vector<uint8_t> frame = encodeClientFrame(payload);
+		frame[0] = 0x80 | opcode;
+		reply.insert(reply.end(), frame.begin(), frame.end());
+		return;
+	}
+
+	reply.push_back(0x80 | opcode);
+	reply.push_back(payload.size());
+	reply.insert(reply.end(), payload.begin(), payload.end());
+}
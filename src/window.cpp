@@ -3,6 +3,7 @@
 #include "chess.hpp"
 #include "io.hpp"
 #include "session.hpp"
+#include "trace.hpp"
 
 #include "SDL3_image/SDL_image.h"
 
@@ -12,8 +13,10 @@
 #include "backends/imgui_impl_opengl3.h"
 
 #include <algorithm>
+#include <charconv>
 #include <cmath>
 #include <cstdint>
+#include <ctime>
 
 #define PI 3.141592654f
 
@@ -33,7 +36,12 @@ namespace ImGui {
 	}
 }
 
-Window::Window(const std::vector<std::string> &) : viewport(1000, 1000) {
+Window::Window(const std::vector<std::string> &args) : viewport(1000, 1000) {
+	if (std::find(args.begin(), args.end(), "--trace") != args.end()) {
+		Tracer::setEnabled(true);
+		Tracer::installSignalHandler();
+	}
+
 	// init sdl
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
@@ -108,9 +116,55 @@ Window::Window(const std::vector<std::string> &) : viewport(1000, 1000) {
 
 	ImGui_ImplSDL3_InitForOpenGL(window, gl_context);
 	ImGui_ImplOpenGL3_Init("#version 460");
+
+	const auto explorer_arg = std::find(args.begin(), args.end(), "--explorer");
+	if (explorer_arg != args.end() && explorer_arg + 1 != args.end()) {
+		explorer = std::make_unique<OpeningExplorer>();
+		if (!explorer->open(*(explorer_arg + 1))) {
+			eprintln("couldn't open explorer {}", *(explorer_arg + 1));
+			explorer.reset();
+		}
+	}
+
+	// engine seats of local games take their first moves from --book <file> and search for --think-ms N otherwise
+	EngineOptions options;
+	const auto book_arg = std::find(args.begin(), args.end(), "--book");
+	if (book_arg != args.end() && book_arg + 1 != args.end()) {
+		book = std::make_unique<OpeningBook>();
+		if (book->open(*(book_arg + 1))) {
+			options.book = book.get();
+		} else {
+			eprintln("couldn't open book {}", *(book_arg + 1));
+			book.reset();
+		}
+	}
+
+	const auto think_arg = std::find(args.begin(), args.end(), "--think-ms");
+	if (think_arg != args.end() && think_arg + 1 != args.end()) {
+		const std::string &text = *(think_arg + 1);
+		std::from_chars(text.data(), text.data() + text.size(), options.think_ms);
+	}
+
+	engine = std::make_unique<Engine>(options);
+	engine_thread = std::thread([this]() { runEngine(); });
+
+	// --replay <file> opens a saved game right away
+	const auto replay_arg = std::find(args.begin(), args.end(), "--replay");
+	if (replay_arg != args.end() && replay_arg + 1 != args.end()) {
+		ui_state.record_path = *(replay_arg + 1);
+		openReplay(ui_state.record_path);
+	}
 }
 
 Window::~Window() {
+	// a search in progress is finished first, it can take up to --think-ms
+	{
+		std::scoped_lock<std::mutex> lock{engine_mutex};
+		engine_stopped = true;
+	}
+	engine_wakeup.notify_one();
+	engine_thread.join();
+
 	palette.destroy();
 	spritesheet.destroy();
 
@@ -131,6 +185,15 @@ int Window::run() {
 	SDL_ShowWindow(window);
 
 	while (!quit) {
+		if (Tracer::takeDumpRequest()) {
+			const std::string path = std::format("trace-{}.json", std::time(nullptr));
+			if (Tracer::dumpToFile(path)) {
+				println("wrote trace to {}", path);
+			} else {
+				eprintln("couldn't write trace to {}", path);
+			}
+		}
+
 		handleEvents();
 
 		glClear(GL_COLOR_BUFFER_BIT);
@@ -166,24 +229,26 @@ void Window::handleEvents() {
 		}
 	}
 
-	if (mode == Mode::Client) {
-		receiveMessageFromServer();
-	} else if (mode & Mode::Host) {
-		acceptQueuedPlayers();
-		receiveMessagesFromClients();
-	}
+	update();
+	updateEngine();
 }
 
 void Window::render() {
-	viewport_uniform_buffer.bind(GL_UNIFORM_BUFFER);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(Viewport), &viewport, GL_DYNAMIC_DRAW);
+	TraceSpan span{"render"};
 
-	field_uniform_buffer.bind(GL_UNIFORM_BUFFER);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(field.tiles) + sizeof(uint32_t) * 5, &field.tiles, GL_DYNAMIC_DRAW);
+	{
+		TraceSpan upload_span{"uploadUniforms"};
 
-	float time = float(SDL_GetTicks()) / 1000.0f;
-	time_uniform_buffer.bind(GL_UNIFORM_BUFFER);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(float), &time, GL_DYNAMIC_DRAW);
+		viewport_uniform_buffer.bind(GL_UNIFORM_BUFFER);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Viewport), &viewport, GL_DYNAMIC_DRAW);
+
+		field_uniform_buffer.bind(GL_UNIFORM_BUFFER);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(field.tiles) + sizeof(uint32_t) * 5, &field.tiles, GL_DYNAMIC_DRAW);
+
+		float time = float(SDL_GetTicks()) / 1000.0f;
+		time_uniform_buffer.bind(GL_UNIFORM_BUFFER);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(float), &time, GL_DYNAMIC_DRAW);
+	}
 
 	glUseProgram(field_shader);
 
@@ -209,100 +274,330 @@ void Window::render() {
 }
 
 void Window::renderUI() {
+	TraceSpan span{"renderUI"};
+
 	if (ImGui::Begin("main menu")) {
 		ImGui::InputText("player name", &ui_state.player_name);
 
 		ImGui::Separator();
 
-		if (mode != Mode::None) {
+		if (mode != Mode::None || replay) {
 			for (size_t i = 0; i < players.size(); i++) {
 				ImVec4 color = i == field.current_player ? ImVec4(0.5, 1, 0.5, 1) : ImVec4(1, 1, 1, 1);
-				if (i == field.player_pov && mode & Mode::Client) {
+				if (i == field.player_pov && mode & Mode::Client && !spectating) {
 					ImGui::TextColored(color, "%lu: %s (you)", i, players[i].name.c_str());
 				} else {
 					ImGui::TextColored(color, "%lu: %s", i, players[i].name.c_str());
 				}
+
+				if (i < clocks.size()) {
+					const uint64_t remaining = getRemainingTime(i) / 1000;
+					ImGui::SameLine();
+					ImGui::TextColored(color, "%lu:%02lu", remaining / 60, remaining % 60);
+				}
 			}
 
 			ImGui::Separator();
 		}
 
-		if (mode == Mode::None) {
+		if (replay) {
+			int ply = replay->getPly();
+			if (ImGui::SliderInt("ply", &ply, 0, replay->getLength())) {
+				seekReplay(ply);
+			}
+
+			if (ImGui::Button("<")) {
+				seekReplay(ply > 0 ? ply - 1 : 0);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button(">")) {
+				seekReplay(ply + 1);
+			}
+
+			if (ImGui::Button("close replay")) {
+				closeReplay();
+			}
+		} else if (mode == Mode::None) {
 			static int num_players = 2;
 			ImGui::SliderInt("players", &num_players, 2, 8);
+			for (int i = 0; i < num_players; i++) {
+				const std::string label = std::format("engine plays {}", i);
+				ImGui::CheckboxFlags(label.c_str(), &ui_state.engine_seats, 1u << i);
+			}
+
 			if (ImGui::Button("start local game")) {
 				initLocal(num_players);
 			}
 
 			if (ImGui::Button("host LAN game")) {
-				initHostHybrid(num_players, ui_state.server_port, ui_state.player_name);
+				const bool hosting = initHostHybrid(num_players, ui_state.server_port, ui_state.player_name);
+				ui_state.error = hosting ? "" : std::format("couldn't listen on port {}", ui_state.server_port);
 			}
 
 			if (ImGui::Button("host LAN game & spectate")) {
-				initHost(num_players, ui_state.server_port);
+				const bool hosting = initHost(num_players, ui_state.server_port);
+				ui_state.error = hosting ? "" : std::format("couldn't listen on port {}", ui_state.server_port);
+			}
+
+			if (!ui_state.error.empty()) {
+				ImGui::FTextColored(ImVec4(1, 0.5, 0.5, 1), "{}", ui_state.error);
 			}
 
 			ImGui::InputText("address", &ui_state.server_address);
 			ImGui::InputInt("port", &ui_state.server_port);
+			ImGui::InputScalar("session", ImGuiDataType_U64, &ui_state.session, nullptr, nullptr, "%016llx", ImGuiInputTextFlags_CharsHexadecimal);
 
 			if (ImGui::Button("join LAN game")) {
-				initClient(ui_state.server_address, ui_state.server_port, ui_state.player_name);
+				initClient(ui_state.server_address, ui_state.server_port, ui_state.session, ui_state.player_name);
+			}
+
+			if (ImGui::Button("spectate LAN game")) {
+				initSpectator(ui_state.server_address, ui_state.server_port, ui_state.session);
+			}
+
+			if (canResume() && ImGui::Button("reconnect")) {
+				resumeClient();
+			}
+
+			ImGui::InputText("record", &ui_state.record_path);
+			if (ImGui::Button("open replay")) {
+				openReplay(ui_state.record_path);
+			}
+		} else if (mode == Mode::Local) {
+			if (engine_move.valid()) {
+				ImGui::TextColored(ImVec4(0.7, 0.7, 0.7, 1), "engine is thinking ...");
+			}
+
+			if (ImGui::Button("save game")) {
+				saveRecord();
 			}
 		} else if (mode & Mode::Host) {
+			if (ImGui::Button("save game")) {
+				saveRecord();
+			}
+
 			if (ImGui::Button("cancel match")) {
 				deinit();
 			}
 		} else if (mode == Mode::Client) {
+			switch (getConnectionQuality()) {
+				case ConnectionQuality::Unknown: {
+					ImGui::TextColored(ImVec4(0.7, 0.7, 0.7, 1), "measuring connection ...");
+				} break;
+				case ConnectionQuality::Good:
+				case ConnectionQuality::Fair:
+				case ConnectionQuality::Poor: {
+					const ConnectionQuality quality = getConnectionQuality();
+					const ImVec4 color = quality == ConnectionQuality::Good ? ImVec4(0.5, 1, 0.5, 1) : quality == ConnectionQuality::Fair ? ImVec4(1, 1, 0.5, 1) : ImVec4(1, 0.5, 0.5, 1);
+					ImGui::TextColored(color, "ping %u ms, jitter %u ms", server_rtt.srtt / 1000, server_rtt.jitter / 1000);
+				} break;
+				case ConnectionQuality::NotResponding: {
+					ImGui::TextColored(ImVec4(1, 0.5, 0.5, 1), "server not responding");
+				} break;
+			}
+
 			if (ImGui::Button("disconnect")) {
 				disconnectFromServer();
 			}
 		}
 
+		// what was played from the shown position in the games of the explorer
+		if (explorer && (mode != Mode::None || replay) && ImGui::CollapsingHeader("opening explorer")) {
+			const uint32_t node = explorer->findNode(field);
+			const std::span<const ExplorerMove> moves = explorer->getMoves(node);
+			if (moves.empty()) {
+				ImGui::TextColored(ImVec4(0.7, 0.7, 0.7, 1), "no games from here");
+			}
+
+			for (const ExplorerMove &move : moves.first(std::min<size_t>(moves.size(), MAX_EXPLORER_MOVES))) {
+				const uint32_t wins = field.current_player < MAX_PLAYERS ? move.wins[field.current_player] : 0;
+				ImGui::FText("({}, {}, {}) -> ({}, {}, {}): {} games, {} won by {}", getX(move.from), getY(move.from), getZ(move.from),
+					getX(move.to), getY(move.to), getZ(move.to), move.games, wins, field.current_player);
+			}
+		}
+
 		ImGui::Separator();
 
-		for (const Event &event : log) {
-			switch (event.kind) {
-				case Session::Event::Move: {
-					ImGui::FTextColored(ImVec4(1, 1, 1, 1), "{}: Move ({}, {}, {}) -> ({}, {}, {})", event.player,
-						getX(event.from), getY(event.from), getZ(event.from),
-						getX(event.to), getY(event.to), getZ(event.to)
-					);
-				} break;
-				case Session::Event::Capture: {
-					ImGui::FTextColored(ImVec4(1, 0.8, 0.5, 1), "{}: Capture ({}, {}, {}) -> ({}, {}, {})", event.player,
-						getX(event.from), getY(event.from), getZ(event.from),
-						getX(event.to), getY(event.to), getZ(event.to)
-					);
-				} break;
-				case Session::Event::Castle: {
-					ImGui::FTextColored(ImVec4(0.5, 1, 0.5, 1), "{}: Castle ({}, {}, {}) -> ({}, {}, {})", event.player,
-						getX(event.from), getY(event.from), getZ(event.from),
-						getX(event.to), getY(event.to), getZ(event.to)
-					);
-				} break;
-				case Session::Event::EnPassant: {
-					ImGui::FTextColored(ImVec4(1, 0.8, 0.5, 1), "{}: Capture en passant ({}, {}, {}) -> ({}, {}, {})", event.player,
-						getX(event.from), getY(event.from), getZ(event.from),
-						getX(event.to), getY(event.to), getZ(event.to)
-					);
-				} break;
-				case Session::Event::Promote: {
-					ImGui::FTextColored(ImVec4(0.5, 0.5, 1, 1), "{}: Promote ({}, {}, {}) to {}", event.player,
-						getX(event.from), getY(event.from), getZ(event.from),
-						event.promotion
-					);
-				} break;
-				case Session::Event::Check: {
-				} break;
-				case Session::Event::CheckMate: {
-				} break;
-				case Session::Event::Surrender: {
-				} break;
+		// only the lines in view are formatted, every line has to produce exactly one row for that
+		ImGuiListClipper clipper;
+		clipper.Begin(log.size());
+		while (clipper.Step()) {
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+				const Event &event = log[i];
+
+				// moves after the shown position of a replay are dimmed
+				const bool upcoming = replay && uint64_t(i) >= replay->getPly();
+				if (upcoming) {
+					ImGui::PushStyleVar(ImGuiStyleVar_Alpha, 0.4f);
+				}
+
+				switch (event.kind) {
+					case Session::Event::Move: {
+						ImGui::FTextColored(ImVec4(1, 1, 1, 1), "{}: Move ({}, {}, {}) -> ({}, {}, {})", event.player,
+							getX(event.from), getY(event.from), getZ(event.from),
+							getX(event.to), getY(event.to), getZ(event.to)
+						);
+					} break;
+					case Session::Event::Capture: {
+						ImGui::FTextColored(ImVec4(1, 0.8, 0.5, 1), "{}: Capture ({}, {}, {}) -> ({}, {}, {})", event.player,
+							getX(event.from), getY(event.from), getZ(event.from),
+							getX(event.to), getY(event.to), getZ(event.to)
+						);
+					} break;
+					case Session::Event::Castle: {
+						ImGui::FTextColored(ImVec4(0.5, 1, 0.5, 1), "{}: Castle ({}, {}, {}) -> ({}, {}, {})", event.player,
+							getX(event.from), getY(event.from), getZ(event.from),
+							getX(event.to), getY(event.to), getZ(event.to)
+						);
+					} break;
+					case Session::Event::EnPassant: {
+						ImGui::FTextColored(ImVec4(1, 0.8, 0.5, 1), "{}: Capture en passant ({}, {}, {}) -> ({}, {}, {})", event.player,
+							getX(event.from), getY(event.from), getZ(event.from),
+							getX(event.to), getY(event.to), getZ(event.to)
+						);
+					} break;
+					case Session::Event::Promote: {
+						ImGui::FTextColored(ImVec4(0.5, 0.5, 1, 1), "{}: Promote ({}, {}, {}) to {}", event.player,
+							getX(event.from), getY(event.from), getZ(event.from),
+							event.promotion
+						);
+					} break;
+					case Session::Event::Check: {
+						ImGui::FTextColored(ImVec4(1, 1, 0.5, 1), "{}: Check", event.player);
+					} break;
+					case Session::Event::CheckMate: {
+						ImGui::FTextColored(ImVec4(1, 0.5, 0.5, 1), "{}: Checkmate", event.player);
+					} break;
+					case Session::Event::Surrender: {
+						ImGui::FTextColored(ImVec4(1, 0.5, 0.5, 1), "{}: Surrender", event.player);
+					} break;
+					case Session::Event::Timeout: {
+						ImGui::FTextColored(ImVec4(1, 0.5, 0.5, 1), "{}: Out of time", event.player);
+					} break;
+				}
+
+				if (upcoming) {
+					ImGui::PopStyleVar();
+				}
 			}
 		}
 	} ImGui::End();
 }
 
+void Window::openReplay(const std::string &path) {
+	std::shared_ptr<GameRecord> record = std::make_shared<GameRecord>();
+	if (!record->load(path)) {
+		eprintln("couldn't read game record {}", path);
+		return;
+	}
+
+	initializeField(record->getPlayerCount());
+	for (size_t i = 0; i < players.size(); i++) {
+		players[i].name = record->getNames()[i];
+	}
+
+	log = record->getEvents();
+	replay.emplace(std::move(record));
+	seekReplay(0);
+}
+
+void Window::closeReplay() {
+	replay.reset();
+	log.clear();
+	deinit();
+}
+
+void Window::seekReplay(uint64_t ply) {
+	replay->seek(ply);
+
+	// the cursor stays where the mouse is
+	const uint32_t cursor_id = field.cursor_id;
+	field = replay->getField();
+	field.cursor_id = cursor_id;
+}
+
+void Window::saveRecord() {
+	std::vector<std::string> names;
+	for (const Player &player : players) {
+		names.push_back(player.name);
+	}
+
+	GameRecord record;
+	record.create(field.num_players, names, log);
+
+	const std::string path = std::format("game-{}.rec", std::time(nullptr));
+	if (record.save(path)) {
+		println("saved game to {}", path);
+	} else {
+		eprintln("couldn't write game record {}", path);
+	}
+}
+
+void Window::updateEngine() {
+	if (mode != Mode::Local || replay || field.num_players == 0) {
+		return;
+	}
+
+	if (engine_move.valid()) {
+		if (engine_move.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			return;
+		}
+
+		// the game could have been restarted while the engine was thinking
+		const std::optional<EngineMove> move = engine_move.get();
+		if (move && field.calculateKey() == engine_key) {
+			for (uint32_t i = 0; i < field.num_players * 32; i++) {
+				field.tiles[i].move = MoveType::None;
+			}
+
+			moveFigure(move->from, move->to, move->type);
+			if (ui_state.show_promotion_dialog) {
+				promoteFigure(move->to, move->promotion);
+			}
+		}
+		return;
+	}
+
+	uint32_t remaining = 0;
+	for (uint32_t i = 0; i < field.num_players; i++) {
+		remaining += !field.players[i].is_checkmate;
+	}
+
+	if (remaining < 2 || !(ui_state.engine_seats & (1u << field.current_player))) {
+		return;
+	}
+
+	engine_key = field.calculateKey();
+	std::packaged_task<std::optional<EngineMove>()> task([this, position = field]() {
+		return engine->think(position);
+	});
+	engine_move = task.get_future();
+
+	{
+		std::scoped_lock<std::mutex> lock{engine_mutex};
+		engine_task = std::move(task);
+	}
+	engine_wakeup.notify_one();
+}
+
+void Window::runEngine() {
+	while (true) {
+		std::packaged_task<std::optional<EngineMove>()> task;
+		{
+			std::unique_lock<std::mutex> lock{engine_mutex};
+			engine_wakeup.wait(lock, [this]() { return engine_stopped || engine_task; });
+			if (engine_stopped) {
+				return;
+			}
+
+			task = std::move(*engine_task);
+			engine_task.reset();
+		}
+
+		task();
+	}
+}
+
 void Window::updateVertexBuffer() {
 	field_mesh_vertex_count = (field.num_players * 32 * 2) * 6 + 4 * 6;
 	Vertex *vertices = (Vertex*)malloc(field_mesh_vertex_count * sizeof(Vertex));
@@ -396,7 +691,11 @@ void Window::updateVertexBuffer() {
 		#undef addVertex
 	}
 
-	field_mesh.data(GL_ARRAY_BUFFER, std::span<Vertex>(vertices, field_mesh_vertex_count), GL_STATIC_DRAW);
+	{
+		TraceSpan upload_span{"uploadFieldMesh"};
+		field_mesh.data(GL_ARRAY_BUFFER, std::span<Vertex>(vertices, field_mesh_vertex_count), GL_STATIC_DRAW);
+	}
+
 	free(vertices);
 }
 
@@ -449,7 +748,12 @@ void Window::onFramebufferResized(const SDL_WindowEvent &event) {
 }
 
 void Window::onMouseButtonUp(const SDL_MouseButtonEvent &event) {
-	if (ImGui::GetIO().WantCaptureMouse) {
+	if (ImGui::GetIO().WantCaptureMouse || replay) {
+		return;
+	}
+
+	// the engine moves for its seats
+	if (mode == Mode::Local && ui_state.engine_seats & (1u << field.current_player)) {
 		return;
 	}
 
@@ -464,7 +768,7 @@ void Window::onMouseButtonUp(const SDL_MouseButtonEvent &event) {
 
 			if (type != MoveType::None) {
 				moveFigure(field.selected_id, field.cursor_id, type);
-			} else if (field.tiles[field.cursor_id].player == field.player_pov && field.player_pov == field.current_player) {
+			} else if (field.tiles[field.cursor_id].player == field.player_pov && field.player_pov == field.current_player && !spectating) {
 				field.calculateMoves(field.cursor_id, true);
 				field.selected_id = field.cursor_id;
 			}